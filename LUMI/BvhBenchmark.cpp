@@ -0,0 +1,171 @@
+// CPU only benchmark of bvh.h on sponza: build and refit times of the mesh (instance) and
+// triangle hierarchies, throughput of nearest hit rays, frustum culling and sphere overlaps.
+// Built in place of main.cpp like the other samples, no window or GL context is needed
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bvh.h"
+
+#define BENCHMARK_MODEL "models/sponza/sponza.obj"
+#define BENCHMARK_BUILD_REPEATS 100
+#define BENCHMARK_RAYS 1000000
+#define BENCHMARK_FRUSTA 10000
+#define BENCHMARK_OVERLAPS 100000
+
+using namespace std;
+
+
+static double elapsedMs(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+int main()
+{
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(BENCHMARK_MODEL, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        return -1;
+    }
+
+    // one instance per mesh, the scene has no transforms worth applying
+    vector<vector<glm::vec3>> positions(scene->mNumMeshes);
+    vector<vector<unsigned int>> indices(scene->mNumMeshes);
+    vector<BvhBox> boxes(scene->mNumMeshes);
+    BvhBox sceneBounds = BvhBox::empty();
+    size_t triangleCount = 0;
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+    {
+        const aiMesh* mesh = scene->mMeshes[m];
+        boxes[m] = BvhBox::empty();
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        {
+            positions[m].push_back(glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z));
+            boxes[m].grow(positions[m].back());
+        }
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+            if (mesh->mFaces[i].mNumIndices == 3)
+                indices[m].insert(indices[m].end(), mesh->mFaces[i].mIndices, mesh->mFaces[i].mIndices + 3);
+        sceneBounds.grow(boxes[m]);
+        triangleCount += indices[m].size() / 3;
+    }
+    cout << "BVH_BENCHMARK:: " << BENCHMARK_MODEL << ": " << boxes.size() << " meshes, " << triangleCount
+        << " triangles" << endl;
+
+    // build
+    Bvh instances;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < BENCHMARK_BUILD_REPEATS; i++)
+        instances.build(boxes);
+    cout << "BVH_BENCHMARK:: mesh BVH build " << elapsedMs(start) / BENCHMARK_BUILD_REPEATS << " ms, "
+        << instances.nodes.size() << " nodes, SAH cost " << instances.sahCost() << endl;
+
+    vector<TriangleBvh> triangles(boxes.size());
+    start = chrono::steady_clock::now();
+    size_t triangleNodes = 0;
+    for (size_t m = 0; m < boxes.size(); m++)
+    {
+        triangles[m].build(positions[m], indices[m].data(), indices[m].size());
+        triangleNodes += triangles[m].getBvh().nodes.size();
+    }
+    double triangleBuildMs = elapsedMs(start);
+    size_t triangleBytes = 0;
+    for (const TriangleBvh& collision : triangles)
+        triangleBytes += collision.cpuBytes();
+    cout << "BVH_BENCHMARK:: triangle BVHs build " << triangleBuildMs << " ms ("
+        << triangleCount / triangleBuildMs / 1000.0 << " M triangles/s), " << triangleNodes << " nodes, "
+        << triangleBytes / 1024 << " KB" << endl;
+
+    // refit after moving every mesh a little
+    mt19937 random(1234);
+    glm::vec3 sceneSize = sceneBounds.max - sceneBounds.min;
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    vector<BvhBox> moved = boxes;
+    for (BvhBox& box : moved)
+    {
+        glm::vec3 offset = (glm::vec3(unit(random), unit(random), unit(random)) - 0.5f) * sceneSize * 0.01f;
+        box.min += offset;
+        box.max += offset;
+    }
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < BENCHMARK_BUILD_REPEATS; i++)
+        instances.refit(i & 1 ? boxes : moved);
+    cout << "BVH_BENCHMARK:: mesh BVH refit " << elapsedMs(start) / BENCHMARK_BUILD_REPEATS << " ms" << endl;
+
+    // nearest hit rays from inside the scene in random directions, through both levels
+    vector<BvhRay> rays(BENCHMARK_RAYS);
+    for (BvhRay& ray : rays)
+    {
+        ray.origin = sceneBounds.min + sceneSize * (0.1f + 0.8f * glm::vec3(unit(random), unit(random), unit(random)));
+        ray.direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) - 0.5f + 1e-4f);
+        ray.tMax = FLT_MAX;
+    }
+    auto intersectMesh = [&triangles](unsigned int mesh, const BvhRay& ray, BvhHit& hit) {
+        BvhRay clipped = ray;
+        clipped.tMax = hit.t;
+        BvhHit triangleHit;
+        if (!triangles[mesh].raycast(clipped, triangleHit))
+            return false;
+        hit = triangleHit;
+        hit.primitive = mesh;
+        return true;
+    };
+    size_t hits = 0;
+    start = chrono::steady_clock::now();
+    for (const BvhRay& ray : rays)
+    {
+        BvhHit hit;
+        hits += instances.raycast(ray, intersectMesh, hit);
+    }
+    double rayMs = elapsedMs(start);
+    cout << "BVH_BENCHMARK:: " << rays.size() / rayMs / 1000.0 << " M rays/s, " << hits * 100 / rays.size()
+        << "% hit" << endl;
+
+    // camera frusta inside the scene looking in random horizontal directions
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, glm::length(sceneSize));
+    vector<Frustum> frusta(BENCHMARK_FRUSTA);
+    for (Frustum& frustum : frusta)
+    {
+        glm::vec3 eye = sceneBounds.min + sceneSize * (0.1f + 0.8f * glm::vec3(unit(random), unit(random), unit(random)));
+        float yaw = unit(random) * 6.2831853f;
+        glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(cos(yaw), 0.0f, sin(yaw)), glm::vec3(0.0f, 1.0f, 0.0f));
+        frustum = Frustum::fromMatrix(projection * view);
+    }
+    vector<uint8_t> visible;
+    size_t visibleCount = 0;
+    start = chrono::steady_clock::now();
+    for (const Frustum& frustum : frusta)
+        visibleCount += instances.cullFrustum(frustum, visible);
+    double cullMs = elapsedMs(start);
+    cout << "BVH_BENCHMARK:: frustum culling " << cullMs * 1000.0 / frusta.size() << " us per frustum, "
+        << visibleCount / frusta.size() << "/" << boxes.size() << " visible on average" << endl;
+
+    // light sized spheres
+    float radius = glm::length(sceneSize) * 0.05f;
+    vector<unsigned int> overlaps;
+    size_t overlapCount = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < BENCHMARK_OVERLAPS; i++)
+    {
+        glm::vec3 center = sceneBounds.min + sceneSize * glm::vec3(unit(random), unit(random), unit(random));
+        overlaps.clear();
+        instances.overlapSphere(center, radius, overlaps);
+        overlapCount += overlaps.size();
+    }
+    double overlapMs = elapsedMs(start);
+    cout << "BVH_BENCHMARK:: " << BENCHMARK_OVERLAPS / overlapMs / 1000.0 << " M sphere overlaps/s, "
+        << overlapCount / BENCHMARK_OVERLAPS << " meshes each" << endl;
+    return 0;
+}
\ No newline at end of file
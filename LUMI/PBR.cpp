@@ -10,11 +10,14 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "uniform_blocks.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+// scene and render loop, every GL object is destroyed before main() terminates GLFW
+int run(GLFWwindow* window);
 
 // settings
 const unsigned int SCR_WIDTH = 1600;
@@ -67,9 +70,17 @@ int main()
 		return -1;
 	}
 
+	int result = run(window);
+	glfwTerminate();
+	return result;
+}
+
+
+int run(GLFWwindow* window)
+{
 	// OpenGLѡ
-	glEnable(GL_MULTISAMPLE);
-	glEnable(GL_DEPTH_TEST);
+	GLState::enable(GL_MULTISAMPLE);
+	GLState::enable(GL_DEPTH_TEST);
 
 	// ģ
 	// stbi_set_flip_vertically_on_load(true);
@@ -79,9 +90,6 @@ int main()
 	//  Shader 
 	Shader shader("glsl/pbr.vert", "glsl/pbr.frag");
 
-	shader.use();
-	shader.setFloat("ao", 1.0f);
-
 	// lights
 	glm::vec3 lightPositions[] = {
 		glm::vec3(-11.0f, 13.0f, 10.0f),
@@ -101,8 +109,32 @@ int main()
 
 	// initialize static shader uniforms before rendering
 	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-	shader.use();
-	shader.setMat4("projection", projection);
+
+	// one material record per sphere in a single buffer, each draw binds its own range
+	GLsizeiptr materialStride = UniformBuffer::alignedSize(sizeof(MaterialBlock));
+	vector<unsigned char> materialData(materialStride * nrRows * nrColumns);
+	for (int row = 0; row < nrRows; ++row)
+	{
+		for (int col = 0; col < nrColumns; ++col)
+		{
+			MaterialBlock material = {};
+			material.albedo = glm::vec4(1.0f);
+			material.metallic = (float)row / (float)nrRows;
+			// we clamp the roughness to 0.05 - 1.0 as perfectly smooth surfaces (roughness of 0.0) tend to look a bit off
+			// on direct lighting.
+			material.roughness = glm::clamp((float)col / (float)nrColumns, 0.05f, 1.0f);
+			material.ao = 1.0f;
+			memcpy(&materialData[(row * nrColumns + col) * materialStride], &material, sizeof(material));
+		}
+	}
+	UniformBuffer materialBuffer(UNIFORM_BINDING_MATERIAL, (GLsizeiptr)materialData.size(), materialData.data(), GL_STATIC_DRAW);
+
+	// the lights never move
+	LightBlock lights = {};
+	for (unsigned int i = 0; i < sizeof(lightPositions) / sizeof(lightPositions[0]); ++i)
+		lights.add(lightPositions[i], lightColors[i]);
+	UniformBuffer lightBuffer(UNIFORM_BINDING_LIGHTS, sizeof(LightBlock), &lights, GL_STATIC_DRAW);
+	UniformBuffer frameBuffer(UNIFORM_BINDING_FRAME, sizeof(FrameBlock));
 
 
 	// Ⱦѭ
@@ -117,24 +149,22 @@ int main()
 		processInput(window);
 
 		// ɫȻ
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		GLState::clearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		shader.use();
 		glm::mat4 view = camera.GetViewMatrix();
-		shader.setMat4("view", view);
-		shader.setVec3("camPos", camera.Position);
+		FrameBlock frame = FrameBlock::fromCamera(projection, view, camera.Position,
+			(float)SCR_WIDTH, (float)SCR_HEIGHT, 0.1f, 100.0f);
+		frameBuffer.update(&frame);
 
 		// render rows*column number of spheres with varying metallic/roughness values scaled by rows and columns respectively
 		glm::mat4 model = glm::mat4(1.0f);
 		for (int row = 0; row < nrRows; ++row)
 		{
-			shader.setFloat("metallic", (float)row / (float)nrRows);
 			for (int col = 0; col < nrColumns; ++col)
 			{
-				// we clamp the roughness to 0.05 - 1.0 as perfectly smooth surfaces (roughness of 0.0) tend to look a bit off
-				// on direct lighting.
-				shader.setFloat("roughness", glm::clamp((float)col / (float)nrColumns, 0.05f, 1.0f));
+				materialBuffer.bindRange((row * nrColumns + col) * materialStride, sizeof(MaterialBlock));
 
 				model = glm::mat4(1.0f);
 				model = glm::translate(model, glm::vec3(
@@ -155,13 +185,8 @@ int main()
 		// keeps the codeprint small.
 		for (unsigned int i = 0; i < sizeof(lightPositions) / sizeof(lightPositions[0]); ++i)
 		{
-			glm::vec3 newPos = lightPositions[i] + glm::vec3(sin(glfwGetTime() * 5.0) * 5.0, 0.0, 0.0);
-			newPos = lightPositions[i];
-			shader.setVec3("lightPositions[" + std::to_string(i) + "]", newPos);
-			shader.setVec3("lightColors[" + std::to_string(i) + "]", lightColors[i]);
-
 			//model = glm::mat4(1.0f);
-			//model = glm::translate(model, newPos);
+			//model = glm::translate(model, lightPositions[i]);
 			//model = glm::scale(model, glm::vec3(0.5f));
 			//shader.setMat4("model", model);
 			//shader.setMat3("normalMatrix", glm::transpose(glm::inverse(glm::mat3(model))));
@@ -173,7 +198,6 @@ int main()
 		glfwPollEvents();		// ûдʲô¼(롢ƶ)
 	}
 
-	glfwTerminate();		// ȷͷ/ɾ֮ǰķԴ
 	return 0;
 }
 
@@ -204,7 +228,7 @@ void processInput(GLFWwindow* window)
 */
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
+	GLState::viewport(0, 0, width, height);
 }
 
 
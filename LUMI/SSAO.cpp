@@ -13,6 +13,7 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "uniform_blocks.h"
 #include "skybox.h"
 #include "prefab.h"
 
@@ -20,6 +21,8 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+// scene and render loop, every GL object is destroyed before main() terminates GLFW
+int run(GLFWwindow* window);
 void renderQuad();
 
 // settings
@@ -78,7 +81,15 @@ int main()
 		return -1;
 	}
 
-	glEnable(GL_DEPTH_TEST);
+	int result = run(window);
+	glfwTerminate();
+	return result;
+}
+
+
+int run(GLFWwindow* window)
+{
+	GLState::enable(GL_DEPTH_TEST);
 
 	// ģ
 	// stbi_set_flip_vertically_on_load(true);
@@ -93,11 +104,11 @@ int main()
 	// configure g-buffer framebuffer
 	unsigned int gBuffer;
 	glGenFramebuffers(1, &gBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, gBuffer);
 	unsigned int gPosition, gNormal, gAlbedoSpec;
 	// position color buffer
 	glGenTextures(1, &gPosition);
-	glBindTexture(GL_TEXTURE_2D, gPosition);
+	GLState::bindTexture(GL_TEXTURE_2D, gPosition);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -106,14 +117,14 @@ int main()
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0);
 	// normal color buffer
 	glGenTextures(1, &gNormal);
-	glBindTexture(GL_TEXTURE_2D, gNormal);
+	GLState::bindTexture(GL_TEXTURE_2D, gNormal);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
 	// color + specular color buffer
 	glGenTextures(1, &gAlbedoSpec);
-	glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
+	GLState::bindTexture(GL_TEXTURE_2D, gAlbedoSpec);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -121,25 +132,27 @@ int main()
 	// tell OpenGL which color attachments we'll use (of this framebuffer) for rendering 
 	unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
 	glDrawBuffers(3, attachments);
-	// create and attach depth buffer (renderbuffer)
-	unsigned int rboDepth;
-	glGenRenderbuffers(1, &rboDepth);
-	glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
+	// create and attach depth buffer (texture, the Hi-Z pyramid is built from it)
+	unsigned int gDepth;
+	glGenTextures(1, &gDepth);
+	GLState::bindTexture(GL_TEXTURE_2D, gDepth);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gDepth, 0);
 	// finally check if framebuffer is complete
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "Framebuffer not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	// also create framebuffer to hold SSAO processing stage
 	unsigned int ssaoFBO, ssaoBlurFBO;
 	glGenFramebuffers(1, &ssaoFBO);  glGenFramebuffers(1, &ssaoBlurFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
 	unsigned int ssaoColorBuffer, ssaoColorBufferBlur;
 	// SSAO color buffer
 	glGenTextures(1, &ssaoColorBuffer);
-	glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
+	GLState::bindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, SCR_WIDTH, SCR_HEIGHT, 0, GL_RED, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -147,16 +160,16 @@ int main()
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "SSAO Framebuffer not complete!" << std::endl;
 	// and blur stage
-	glBindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
 	glGenTextures(1, &ssaoColorBufferBlur);
-	glBindTexture(GL_TEXTURE_2D, ssaoColorBufferBlur);
+	GLState::bindTexture(GL_TEXTURE_2D, ssaoColorBufferBlur);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, SCR_WIDTH, SCR_HEIGHT, 0, GL_RED, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ssaoColorBufferBlur, 0);
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "SSAO Blur Framebuffer not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	// generate sample kernel
 	std::uniform_real_distribution<GLfloat> randomFloats(0.0, 1.0); // generates random floats between 0.0 and 1.0
@@ -183,7 +196,7 @@ int main()
 		ssaoNoise.push_back(noise);
 	}
 	unsigned int noiseTexture; glGenTextures(1, &noiseTexture);
-	glBindTexture(GL_TEXTURE_2D, noiseTexture);
+	GLState::bindTexture(GL_TEXTURE_2D, noiseTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 4, 4, 0, GL_RGB, GL_FLOAT, &ssaoNoise[0]);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -208,6 +221,17 @@ int main()
 	shaderSSAOBlur.use();
 	shaderSSAOBlur.setInt("ssaoInput", 0);
 
+	// the kernel never changes and is uploaded once, camera and light are written once per frame
+	SsaoKernelBlock kernel = {};
+	for (unsigned int i = 0; i < SSAO_KERNEL_SIZE && i < ssaoKernel.size(); ++i)
+		kernel.samples[i] = glm::vec4(ssaoKernel[i], 0.0f);
+	UniformBuffer kernelBuffer(UNIFORM_BINDING_SSAO_KERNEL, sizeof(SsaoKernelBlock), &kernel, GL_STATIC_DRAW);
+	UniformBuffer frameBuffer(UNIFORM_BINDING_FRAME, sizeof(FrameBlock));
+	UniformBuffer lightBuffer(UNIFORM_BINDING_LIGHTS, sizeof(LightBlock));
+
+	// occlusion culling of the geometry pass
+	HiZBuffer hiz(SCR_WIDTH, SCR_HEIGHT);
+
 	// Ⱦѭ
 	while (!glfwWindowShouldClose(window))
 	{
@@ -220,77 +244,77 @@ int main()
 		processInput(window);
 
 		// ɫȻ
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		GLState::clearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		// 1. geometry pass: render scene's geometry/color data into gbuffer
-		glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+		GLState::bindFramebuffer(GL_FRAMEBUFFER, gBuffer);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = camera.GetViewMatrix();
 		glm::mat4 model = glm::mat4(1.0f);
+		FrameBlock frame = FrameBlock::fromCamera(projection, view, camera.Position,
+			(float)SCR_WIDTH, (float)SCR_HEIGHT, 0.1f, 100.0f);
+		frameBuffer.update(&frame);
+		// lighting happens in view space
+		LightBlock lights = {};
+		const float linear = 0.09f;
+		const float quadratic = 0.032f;
+		lights.add(glm::vec3(view * glm::vec4(lightPos, 1.0)), lightColor, linear, quadratic);
+		lightBuffer.update(&lights);
 		shaderGeometryPass.use();
-		shaderGeometryPass.setMat4("projection", projection);
-		shaderGeometryPass.setMat4("view", view);
 		// model
 		model = glm::mat4(1.0f);
 		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0));
 		model = glm::scale(model, glm::vec3(1.0f));
 		shaderGeometryPass.setMat4("model", model);
-		sponzaModel.draw(shaderGeometryPass);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		// the gbuffer only feeds lighting and SSAO here, so it takes the SSAO bias. Meshes the
+		// previous frames hide wait for the pyramid of what is drawn now
+		Frustum cameraFrustum = Frustum::fromMatrix(projection * view);
+		sponzaModel.draw(shaderGeometryPass, LodView::perspective(model, camera.Position, projection, (float)SCR_HEIGHT, LodPass::SSAO),
+			&cameraFrustum, RenderPass::Opaque, &hiz);
+		hiz.build(gDepth, projection * view);
+		sponzaModel.drawOccluded(shaderGeometryPass, hiz, projection * view);
+		hiz.endFrame();
+		GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
 		// 2. generate SSAO texture
-		glBindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
+		GLState::bindFramebuffer(GL_FRAMEBUFFER, ssaoFBO);
 		glClear(GL_COLOR_BUFFER_BIT);
 		shaderSSAO.use();
-		// Send kernel + rotation 
-		for (unsigned int i = 0; i < 64; ++i)
-			shaderSSAO.setVec3("samples[" + std::to_string(i) + "]", ssaoKernel[i]);
-		shaderSSAO.setMat4("projection", projection);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gPosition);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, gNormal);
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, noiseTexture);
+		GLState::activeTexture(GL_TEXTURE0);
+		GLState::bindTexture(GL_TEXTURE_2D, gPosition);
+		GLState::activeTexture(GL_TEXTURE1);
+		GLState::bindTexture(GL_TEXTURE_2D, gNormal);
+		GLState::activeTexture(GL_TEXTURE2);
+		GLState::bindTexture(GL_TEXTURE_2D, noiseTexture);
 		renderQuad();
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
 		// 3. blur SSAO texture to remove noise
-		glBindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
+		GLState::bindFramebuffer(GL_FRAMEBUFFER, ssaoBlurFBO);
 		glClear(GL_COLOR_BUFFER_BIT);
 		shaderSSAOBlur.use();
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
+		GLState::activeTexture(GL_TEXTURE0);
+		GLState::bindTexture(GL_TEXTURE_2D, ssaoColorBuffer);
 		renderQuad();
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 
 
 		// 4. lighting pass: traditional deferred Blinn-Phong lighting with added screen-space ambient occlusion
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		shaderLightingPass.use();
-		// send light relevant uniforms
-		glm::vec3 lightPosView = glm::vec3(camera.GetViewMatrix() * glm::vec4(lightPos, 1.0));
-		shaderLightingPass.setVec3("light.Position", lightPosView);
-		shaderLightingPass.setVec3("light.Color", lightColor);
-		// Update attenuation parameters
-		const float linear = 0.09f;
-		const float quadratic = 0.032f;
-		shaderLightingPass.setFloat("light.Linear", linear);
-		shaderLightingPass.setFloat("light.Quadratic", quadratic);
-		shaderLightingPass.setVec3("viewPos", camera.Position);
 		shaderLightingPass.setBool("openSSAO", openSSAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, gPosition);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, gNormal);
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
-		glActiveTexture(GL_TEXTURE3); // add extra SSAO texture to lighting pass
-		glBindTexture(GL_TEXTURE_2D, ssaoColorBufferBlur);
+		GLState::activeTexture(GL_TEXTURE0);
+		GLState::bindTexture(GL_TEXTURE_2D, gPosition);
+		GLState::activeTexture(GL_TEXTURE1);
+		GLState::bindTexture(GL_TEXTURE_2D, gNormal);
+		GLState::activeTexture(GL_TEXTURE2);
+		GLState::bindTexture(GL_TEXTURE_2D, gAlbedoSpec);
+		GLState::activeTexture(GL_TEXTURE3); // add extra SSAO texture to lighting pass
+		GLState::bindTexture(GL_TEXTURE_2D, ssaoColorBufferBlur);
 		renderQuad();
 
 
@@ -298,7 +322,6 @@ int main()
 		glfwPollEvents();		// ûдʲô¼(롢ƶ)
 	}
 
-	glfwTerminate();		// ȷͷ/ɾ֮ǰķԴ
 	return 0;
 }
 
@@ -319,17 +342,17 @@ void renderQuad()
 		// setup plane VAO
 		glGenVertexArrays(1, &quadVAO);
 		glGenBuffers(1, &quadVBO);
-		glBindVertexArray(quadVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+		GLState::bindVertexArray(quadVAO);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, quadVBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(1);
 		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 	}
-	glBindVertexArray(quadVAO);
+	GLState::bindVertexArray(quadVAO);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 }
 
 
@@ -366,7 +389,7 @@ void processInput(GLFWwindow* window)
 */
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
+	GLState::viewport(0, 0, width, height);
 }
 
 
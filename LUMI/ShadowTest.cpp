@@ -10,6 +10,8 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "shadow_cascades.h"
+#include "uniform_blocks.h"
 
 #include <iostream>
 
@@ -17,6 +19,8 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+// scene and render loop, every GL object is destroyed before main() terminates GLFW
+int run(GLFWwindow* window);
 unsigned int loadTexture(const char* path);
 void renderScene(const Shader& shader);
 void renderCube();
@@ -76,9 +80,17 @@ int main()
         return -1;
     }
 
+    int result = run(window);
+    glfwTerminate();
+    return result;
+}
+
+
+int run(GLFWwindow* window)
+{
     // configure global opengl state
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_MULTISAMPLE);
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::enable(GL_MULTISAMPLE);
 
     // build and compile shaders
     Shader shader("glsl/shadow_mapping.vert", "glsl/shadow_mapping.frag");
@@ -101,8 +113,8 @@ int main()
     unsigned int planeVBO;
     glGenVertexArrays(1, &planeVAO);
     glGenBuffers(1, &planeVBO);
-    glBindVertexArray(planeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, planeVBO);
+    GLState::bindVertexArray(planeVAO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, planeVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(planeVertices), planeVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
@@ -110,38 +122,26 @@ int main()
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glBindVertexArray(0);
+    GLState::bindVertexArray(0);
 
     // load textures
     unsigned int woodTexture = loadTexture("images/wood.png");
 
-    // configure depth map FBO
-    const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
-    // create depth texture
-    unsigned int depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    GLfloat borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    // attach depth texture as FBO's depth buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // cascaded depth map, the cascades cover the first SHADOW_DISTANCE units of the view
+    const unsigned int SHADOW_SIZE = 1024;
+    const float SHADOW_DISTANCE = 30.0f;
+    CascadedShadowMap shadowMap(SHADOW_SIZE);
+    UniformBuffer shadowBuffer(UNIFORM_BINDING_SHADOW, sizeof(ShadowBlock));
+    // the floor and the cubes standing on it
+    BvhBox casterBounds = { glm::vec3(-25.0f, -0.5f, -25.0f), glm::vec3(25.0f, 3.5f, 25.0f) };
 
 
     // shader configuration
     shader.use();
     shader.setInt("diffuseTexture", 0);
-    shader.setInt("shadowMap", 1);
+    shader.setInt("shadowCascades", 1);
+    planeShader.use();
+    planeShader.setInt("shadowCascades", 1);
     debugDepthQuad.use();
     debugDepthQuad.setInt("depthMap", 0);
 
@@ -160,54 +160,69 @@ int main()
         processInput(window);
 
         // render
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        GLState::clearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // 1. render depth of scene to texture (from light's perspective)
-        glm::mat4 lightProjection, lightView;
-        glm::mat4 lightSpaceMatrix;
-        float near_plane = 0.01f, far_plane = 17.5f;
-        lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
-        lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-        lightSpaceMatrix = lightProjection * lightView;
-        // render scene from light's point of view
-        simpleDepthShader.use();
-        simpleDepthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
+        // the small cube spins, a dynamic caster over the static floor and cubes
+        glm::mat4 spinningCube = glm::mat4(1.0f);
+        spinningCube = glm::translate(spinningCube, glm::vec3(-1.0f, 0.0f, 2.0));
+        spinningCube = glm::rotate(spinningCube, currentFrame, glm::vec3(0.0, 1.0, 0.0));
+        spinningCube = glm::rotate(spinningCube, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
+        spinningCube = glm::scale(spinningCube, glm::vec3(0.25));
 
-        glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTexture);
-        renderScene(simpleDepthShader);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // 1. render depth of scene to every cascade (from light's perspective)
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 view = camera.GetViewMatrix(); // glm::lookAt(glm::vec3(0.0f, 2.0f, -8.0f), glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
+        shadowMap.update(view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, SHADOW_DISTANCE,
+            glm::vec3(0.0f) - lightPos, casterBounds);
+        ShadowBlock shadows = shadowMap.block();
+        shadowBuffer.update(&shadows);
+
+        simpleDepthShader.use();
+        GLState::activeTexture(GL_TEXTURE0);
+        GLState::bindTexture(GL_TEXTURE_2D, woodTexture);
+        for (unsigned int i = 0; i < shadowMap.cascadeCount; i++)
+        {
+            const ShadowCascade& cascade = shadowMap.cascades[i];
+            // the static casters only into the parts of the cascade's cache that are stale or moved in
+            for (unsigned int k = 0; k < cascade.staticRegionCount; k++)
+            {
+                shadowMap.beginStaticRegion(i, k);
+                simpleDepthShader.setMat4("lightSpaceMatrix", cascade.staticRegions[k].viewProjection);
+                renderScene(simpleDepthShader);
+            }
+            // the dynamic ones over a copy of it, fitted to the camera
+            shadowMap.copyStatic(i);
+            GLState::bindFramebuffer(GL_FRAMEBUFFER, shadowMap.framebuffers[i]);
+            GLState::viewport(0, 0, SHADOW_SIZE, SHADOW_SIZE);
+            simpleDepthShader.setMat4("lightSpaceMatrix", cascade.viewProjection);
+            simpleDepthShader.setMat4("model", spinningCube);
+            renderCube();
+        }
+        GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 
         // reset viewport
-        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+        GLState::viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // render Depth map to quad for visual debugging
         //debugDepthQuad.use();
         //debugDepthQuad.setFloat("near_plane", near_plane);
         //debugDepthQuad.setFloat("far_plane", far_plane);
-        //glActiveTexture(GL_TEXTURE0);
-        //glBindTexture(GL_TEXTURE_2D, depthMap);
+        //GLState::activeTexture(GL_TEXTURE0);
+        //GLState::bindTexture(GL_TEXTURE_2D, depthMap);
         //renderQuad();
 
          // 2. render scene as normal using the generated depth/shadow map
         shader.use();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix(); // glm::lookAt(glm::vec3(0.0f, 2.0f, -8.0f), glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
         shader.setMat4("projection", projection);
         shader.setMat4("view", view);
         // set light uniforms
         shader.setVec3("viewPos", camera.Position);
         shader.setVec3("lightPos", lightPos);
-        shader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, woodTexture);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
+        GLState::activeTexture(GL_TEXTURE0);
+        GLState::bindTexture(GL_TEXTURE_2D, woodTexture);
+        GLState::bindTextureUnit(1, GL_TEXTURE_2D_ARRAY, shadowMap.texture);
         // renderScene(shader);
 
         glm::mat4 model = glm::mat4(1.0f);
@@ -222,11 +237,7 @@ int main()
         model = glm::scale(model, glm::vec3(0.5f));
         shader.setMat4("model", model);
         renderCube();
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(-1.0f, 0.0f, 2.0));
-        model = glm::rotate(model, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
-        model = glm::scale(model, glm::vec3(0.25));
-        shader.setMat4("model", model);
+        shader.setMat4("model", spinningCube);
         renderCube();
 
         // floor
@@ -237,34 +248,31 @@ int main()
         planeShader.setMat4("view", view);
         planeShader.setVec3("viewPos", camera.Position);
         planeShader.setVec3("lightPos", lightPos);
-        planeShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        planeShader.setInt("shadowMap", 1);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-        glBindVertexArray(planeVAO);
+        GLState::bindVertexArray(planeVAO);
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
+        shadowMap.endFrame();
+
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
     // optional: de-allocate all resources once they've outlived their purpose:
-    glDeleteVertexArrays(1, &planeVAO);
-    glDeleteBuffers(1, &planeVBO);
+    GLState::deleteVertexArrays(1, &planeVAO);
+    GLState::deleteBuffers(1, &planeVBO);
 
-    glfwTerminate();
     return 0;
 }
 
 
-// renders the 3D scene
+// renders the static part of the 3D scene, the floor and the resting cubes
 void renderScene(const Shader& shader)
 {
     // floor
     glm::mat4 model = glm::mat4(1.0f);
     shader.setMat4("model", model);
-    glBindVertexArray(planeVAO);
+    GLState::bindVertexArray(planeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
     // cubes
     model = glm::mat4(1.0f);
@@ -277,12 +285,6 @@ void renderScene(const Shader& shader)
     model = glm::scale(model, glm::vec3(0.5f));
     shader.setMat4("model", model);
     renderCube();
-    model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(-1.0f, 0.0f, 2.0));
-    model = glm::rotate(model, glm::radians(60.0f), glm::normalize(glm::vec3(1.0, 0.0, 1.0)));
-    model = glm::scale(model, glm::vec3(0.25));
-    shader.setMat4("model", model);
-    renderCube();
 }
 
 
@@ -341,23 +343,23 @@ void renderCube()
         glGenVertexArrays(1, &cubeVAO);
         glGenBuffers(1, &cubeVBO);
         // fill buffer
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, cubeVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
         // link vertex attributes
-        glBindVertexArray(cubeVAO);
+        GLState::bindVertexArray(cubeVAO);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
         glEnableVertexAttribArray(2);
         glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+        GLState::bindVertexArray(0);
     }
     // render Cube
-    glBindVertexArray(cubeVAO);
+    GLState::bindVertexArray(cubeVAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+    GLState::bindVertexArray(0);
 }
 
 // renderQuad() renders a 1x1 XY quad in NDC
@@ -377,17 +379,17 @@ void renderQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        GLState::bindVertexArray(quadVAO);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    GLState::bindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
+    GLState::bindVertexArray(0);
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
@@ -414,7 +416,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and 
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    GLState::viewport(0, 0, width, height);
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -463,7 +465,7 @@ unsigned int loadTexture(char const* path)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::bindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
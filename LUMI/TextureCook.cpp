@@ -0,0 +1,77 @@
+// Offline texture cooker: writes the BCn .dds files next to every texture a model references,
+// so the first run of the samples uploads compressed textures instead of cooking them on load.
+// Built in place of main.cpp like the other samples, no window or GL context is needed
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <string>
+
+#include "texture_cooker.h"
+
+#define COOK_MODEL "models/sponza/sponza.obj"
+
+using namespace std;
+
+
+static double elapsedMs(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+
+// usage: TextureCook [model path], stale and missing cooked files are rebuilt
+int main(int argc, char* argv[])
+{
+    string modelPath = argc > 1 ? argv[1] : COOK_MODEL;
+    Assimp::Importer importer;
+    // only the materials are needed, skip the geometry post processing
+    const aiScene* scene = importer.ReadFile(modelPath, 0);
+    if (!scene || !scene->mRootNode)
+    {
+        cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        return -1;
+    }
+    string directory = modelPath.substr(0, modelPath.find_last_of('/'));
+
+    // same texture types as Model::processMesh
+    const aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR,
+        aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+    set<string> paths;
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+    {
+        for (aiTextureType type : types)
+        {
+            for (unsigned int i = 0; i < scene->mMaterials[m]->GetTextureCount(type); i++)
+            {
+                aiString str;
+                scene->mMaterials[m]->GetTexture(type, i, &str);
+                paths.insert(directory + '/' + str.C_Str());
+            }
+        }
+    }
+
+    size_t cooked = 0, fresh = 0, failed = 0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (const string& path : paths)
+    {
+        if (TextureCooker::isFresh(path))
+        {
+            fresh++;
+            continue;
+        }
+        if (TextureCooker::cook(path))
+            cooked++;
+        else
+        {
+            cout << "TEXTURE_COOK:: failed to cook " << path << endl;
+            failed++;
+        }
+    }
+    cout << "TEXTURE_COOK:: " << modelPath << ": " << cooked << " cooked, " << fresh << " up to date, "
+        << failed << " failed in " << elapsedMs(start) << " ms" << endl;
+    return failed == 0 ? 0 : 1;
+}
\ No newline at end of file
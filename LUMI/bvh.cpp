@@ -0,0 +1,412 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "bvh.h"
+
+
+namespace
+{
+    struct BuildTask
+    {
+        unsigned int node;
+        unsigned int depth;
+    };
+
+    struct Bin
+    {
+        BvhBox       bounds;
+        unsigned int count;
+    };
+
+    struct FrustumPlane
+    {
+        glm::vec4 plane;
+        glm::vec3 absNormal;
+    };
+
+    struct CullEntry
+    {
+        unsigned int node;
+        unsigned int planeMask;     // planes the parent was not completely inside of
+    };
+
+    const unsigned int ALL_PLANES = 0x3F;
+
+    // clears the bits of planes the box is inside of, false when it is outside one
+    bool classifyBox(const BvhBox& box, const FrustumPlane* planes, unsigned int& planeMask)
+    {
+        glm::vec3 center = box.center();
+        glm::vec3 extent = (box.max - box.min) * 0.5f;
+        for (int p = 0; p < 6; p++)
+        {
+            if (!(planeMask >> p & 1))
+                continue;
+            float distance = glm::dot(glm::vec3(planes[p].plane), center) + planes[p].plane.w;
+            float radius = glm::dot(planes[p].absNormal, extent);
+            if (distance + radius < 0.0f)
+                return false;
+            if (distance - radius >= 0.0f)
+                planeMask &= ~(1u << p);
+        }
+        return true;
+    }
+
+    bool boxTouchesSphere(const BvhBox& box, const glm::vec3& center, float radiusSquared)
+    {
+        glm::vec3 closest = glm::clamp(center, box.min, box.max);
+        glm::vec3 offset = closest - center;
+        return glm::dot(offset, offset) <= radiusSquared;
+    }
+
+    bool boxesOverlap(const BvhBox& a, const BvhBox& b)
+    {
+        return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y && a.max.y >= b.min.y &&
+            a.min.z <= b.max.z && a.max.z >= b.min.z;
+    }
+}
+
+
+void Bvh::build(const vector<BvhBox>& boxes)
+{
+    bounds = boxes;
+    nodes.clear();
+    primitives.resize(boxes.size());
+    iota(primitives.begin(), primitives.end(), 0u);
+    if (boxes.empty())
+        return;
+
+    vector<glm::vec3> centers(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++)
+        centers[i] = boxes[i].center();
+
+    // at most 2n - 1 nodes, references into nodes stay valid while splitting
+    nodes.reserve(boxes.size() * 2 - 1);
+    BvhNode root;
+    root.first = 0;
+    root.count = static_cast<unsigned int>(boxes.size());
+    nodes.push_back(root);
+
+    vector<BuildTask> tasks(1, BuildTask{ 0, 0 });
+    while (!tasks.empty())
+    {
+        BuildTask task = tasks.back();
+        tasks.pop_back();
+        BvhNode& node = nodes[task.node];
+
+        BvhBox centerBounds = BvhBox::empty();
+        node.bounds = BvhBox::empty();
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+        {
+            node.bounds.grow(bounds[primitives[i]]);
+            centerBounds.grow(centers[primitives[i]]);
+        }
+        if (node.count <= BVH_MAX_LEAF_SIZE || task.depth >= BVH_MAX_DEPTH)
+            continue;
+
+        // cheapest bin boundary over all three axes: areas times counts of both sides
+        float bestCost = FLT_MAX;
+        int bestAxis = -1, bestSplit = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float low = centerBounds.min[axis];
+            float extent = centerBounds.max[axis] - low;
+            if (extent <= 0.0f)
+                continue;
+            float scale = BVH_SAH_BINS / extent;
+            Bin bins[BVH_SAH_BINS];
+            for (Bin& bin : bins)
+            {
+                bin.bounds = BvhBox::empty();
+                bin.count = 0;
+            }
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+            {
+                int index = min(BVH_SAH_BINS - 1, int((centers[primitives[i]][axis] - low) * scale));
+                bins[index].bounds.grow(bounds[primitives[i]]);
+                bins[index].count++;
+            }
+
+            float rightCosts[BVH_SAH_BINS];
+            BvhBox right = BvhBox::empty();
+            unsigned int rightCount = 0;
+            for (int split = BVH_SAH_BINS - 1; split > 0; split--)
+            {
+                right.grow(bins[split].bounds);
+                rightCount += bins[split].count;
+                rightCosts[split] = rightCount > 0 ? right.area() * rightCount : 0.0f;
+            }
+            BvhBox left = BvhBox::empty();
+            unsigned int leftCount = 0;
+            for (int split = 1; split < BVH_SAH_BINS; split++)
+            {
+                left.grow(bins[split - 1].bounds);
+                leftCount += bins[split - 1].count;
+                if (leftCount == 0 || leftCount == node.count)
+                    continue;
+                float cost = left.area() * leftCount + rightCosts[split];
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        // splitting has to beat intersecting every primitive of the node
+        float leafCost = node.bounds.area() * (node.count - BVH_TRAVERSAL_COST);
+        if (bestAxis < 0 || bestCost >= leafCost)
+            continue;
+
+        float low = centerBounds.min[bestAxis];
+        float scale = BVH_SAH_BINS / (centerBounds.max[bestAxis] - low);
+        unsigned int* begin = primitives.data() + node.first;
+        unsigned int* middle = partition(begin, begin + node.count, [&](unsigned int primitive) {
+            return min(BVH_SAH_BINS - 1, int((centers[primitive][bestAxis] - low) * scale)) < bestSplit;
+        });
+        unsigned int leftCount = static_cast<unsigned int>(middle - begin);
+
+        BvhNode leftChild, rightChild;
+        leftChild.first = node.first;
+        leftChild.count = leftCount;
+        rightChild.first = node.first + leftCount;
+        rightChild.count = node.count - leftCount;
+        node.first = static_cast<unsigned int>(nodes.size());
+        node.count = 0;
+        nodes.push_back(leftChild);
+        nodes.push_back(rightChild);
+        tasks.push_back(BuildTask{ nodes[task.node].first + 1, task.depth + 1 });
+        tasks.push_back(BuildTask{ nodes[task.node].first, task.depth + 1 });
+    }
+    nodes.shrink_to_fit();
+}
+
+
+void Bvh::refit(const vector<BvhBox>& boxes)
+{
+    if (boxes.size() != bounds.size())
+    {
+        build(boxes);
+        return;
+    }
+    bounds = boxes;
+    // children are always stored after their parent
+    for (size_t i = nodes.size(); i-- > 0;)
+    {
+        BvhNode& node = nodes[i];
+        if (node.count > 0)
+        {
+            node.bounds = BvhBox::empty();
+            for (unsigned int p = node.first; p < node.first + node.count; p++)
+                node.bounds.grow(bounds[primitives[p]]);
+        }
+        else
+        {
+            node.bounds = nodes[node.first].bounds;
+            node.bounds.grow(nodes[node.first + 1].bounds);
+        }
+    }
+}
+
+
+size_t Bvh::cullFrustum(const Frustum& frustum, vector<uint8_t>& visible) const
+{
+    visible.assign(bounds.size(), 0);
+    if (nodes.empty())
+        return 0;
+    FrustumPlane planes[6];
+    for (int p = 0; p < 6; p++)
+    {
+        planes[p].plane = frustum.planes[p];
+        planes[p].absNormal = glm::abs(glm::vec3(frustum.planes[p]));
+    }
+
+    size_t visibleCount = 0;
+    CullEntry stack[BVH_MAX_DEPTH + 2];
+    int size = 0;
+    stack[size++] = { 0, ALL_PLANES };
+    while (size > 0)
+    {
+        CullEntry entry = stack[--size];
+        const BvhNode& node = nodes[entry.node];
+        unsigned int planeMask = entry.planeMask;
+        if (planeMask != 0 && !classifyBox(node.bounds, planes, planeMask))
+            continue;
+        if (node.count == 0)
+        {
+            stack[size++] = { node.first + 1, planeMask };
+            stack[size++] = { node.first, planeMask };
+            continue;
+        }
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+        {
+            unsigned int primitiveMask = planeMask;
+            if (primitiveMask == 0 || classifyBox(bounds[primitives[i]], planes, primitiveMask))
+            {
+                visible[primitives[i]] = 1;
+                visibleCount++;
+            }
+        }
+    }
+    return visibleCount;
+}
+
+
+void Bvh::overlapSphere(const glm::vec3& center, float radius, vector<unsigned int>& out) const
+{
+    if (nodes.empty())
+        return;
+    float radiusSquared = radius * radius;
+    unsigned int stack[BVH_MAX_DEPTH + 2];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0)
+    {
+        const BvhNode& node = nodes[stack[--size]];
+        if (!boxTouchesSphere(node.bounds, center, radiusSquared))
+            continue;
+        if (node.count == 0)
+        {
+            stack[size++] = node.first + 1;
+            stack[size++] = node.first;
+            continue;
+        }
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+            if (boxTouchesSphere(bounds[primitives[i]], center, radiusSquared))
+                out.push_back(primitives[i]);
+    }
+}
+
+
+void Bvh::overlapBox(const BvhBox& box, vector<unsigned int>& out) const
+{
+    if (nodes.empty())
+        return;
+    unsigned int stack[BVH_MAX_DEPTH + 2];
+    int size = 0;
+    stack[size++] = 0;
+    while (size > 0)
+    {
+        const BvhNode& node = nodes[stack[--size]];
+        if (!boxesOverlap(node.bounds, box))
+            continue;
+        if (node.count == 0)
+        {
+            stack[size++] = node.first + 1;
+            stack[size++] = node.first;
+            continue;
+        }
+        for (unsigned int i = node.first; i < node.first + node.count; i++)
+            if (boxesOverlap(bounds[primitives[i]], box))
+                out.push_back(primitives[i]);
+    }
+}
+
+
+float Bvh::intersectBox(const BvhBox& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax)
+{
+    // slab test
+    glm::vec3 t0 = (box.min - origin) * inverseDirection;
+    glm::vec3 t1 = (box.max - origin) * inverseDirection;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+    float enter = max(max(tNear.x, tNear.y), max(tNear.z, 0.0f));
+    float exit = min(min(tFar.x, tFar.y), min(tFar.z, tMax));
+    return enter <= exit && enter < tMax ? enter : FLT_MAX;
+}
+
+
+glm::vec3 Bvh::inverseDirection(const glm::vec3& direction)
+{
+    glm::vec3 inverse;
+    for (int i = 0; i < 3; i++)
+        inverse[i] = 1.0f / (fabs(direction[i]) > 1e-20f ? direction[i] : copysign(1e-20f, direction[i]));
+    return inverse;
+}
+
+
+float Bvh::sahCost() const
+{
+    if (nodes.empty())
+        return 0.0f;
+    float rootArea = nodes[0].bounds.area();
+    if (rootArea <= 0.0f)
+        return 0.0f;
+    float cost = 0.0f;
+    for (const BvhNode& node : nodes)
+        cost += node.bounds.area() / rootArea * (node.count > 0 ? float(node.count) : BVH_TRAVERSAL_COST);
+    return cost;
+}
+
+
+size_t Bvh::cpuBytes() const
+{
+    return nodes.capacity() * sizeof(BvhNode) + primitives.capacity() * sizeof(unsigned int) +
+        bounds.capacity() * sizeof(BvhBox);
+}
+
+
+void TriangleBvh::build(const vector<glm::vec3>& positions, const unsigned int* indices, size_t indexCount)
+{
+    this->positions = positions;
+    size_t triangleCount = indexCount / 3;
+    vector<BvhBox> boxes(triangleCount);
+    for (size_t i = 0; i < triangleCount; i++)
+    {
+        boxes[i] = BvhBox::empty();
+        for (int corner = 0; corner < 3; corner++)
+            boxes[i].grow(positions[indices[i * 3 + corner]]);
+    }
+    bvh.build(boxes);
+
+    // leaves then read their triangles sequentially
+    triangles.resize(triangleCount);
+    for (size_t i = 0; i < triangleCount; i++)
+    {
+        unsigned int original = bvh.primitives[i];
+        triangles[i] = glm::uvec4(indices[original * 3], indices[original * 3 + 1], indices[original * 3 + 2],
+            original);
+        bvh.primitives[i] = static_cast<unsigned int>(i);
+    }
+    vector<BvhBox>().swap(bvh.bounds);
+}
+
+
+bool TriangleBvh::raycast(const BvhRay& ray, BvhHit& hit) const
+{
+    // Moller-Trumbore, both faces
+    auto intersect = [this](unsigned int primitive, const BvhRay& ray, BvhHit& hit) {
+        const glm::uvec4& triangle = triangles[primitive];
+        const glm::vec3& p0 = positions[triangle.x];
+        glm::vec3 edge1 = positions[triangle.y] - p0;
+        glm::vec3 edge2 = positions[triangle.z] - p0;
+        glm::vec3 p = glm::cross(ray.direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (determinant == 0.0f)
+            return false;
+        float inverse = 1.0f / determinant;
+        glm::vec3 s = ray.origin - p0;
+        float u = glm::dot(s, p) * inverse;
+        if (u < 0.0f || u > 1.0f)
+            return false;
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(ray.direction, q) * inverse;
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+        float t = glm::dot(edge2, q) * inverse;
+        if (t < 0.0f || t >= hit.t)
+            return false;
+        hit.t = t;
+        hit.primitive = triangle.w;
+        hit.barycentric = glm::vec2(u, v);
+        return true;
+    };
+    return bvh.raycast(ray, intersect, hit);
+}
+
+
+size_t TriangleBvh::cpuBytes() const
+{
+    return bvh.cpuBytes() + positions.capacity() * sizeof(glm::vec3) + triangles.capacity() * sizeof(glm::uvec4);
+}
\ No newline at end of file
@@ -0,0 +1,208 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "frustum_culling.h"
+using namespace std;
+
+// split candidates per axis of the binned SAH build
+#define BVH_SAH_BINS 16
+// nodes with at most this many primitives are not split further
+#define BVH_MAX_LEAF_SIZE 4
+// cost of visiting a node relative to intersecting one primitive
+#define BVH_TRAVERSAL_COST 1.0f
+// deeper nodes become leaves, bounds the traversal stacks
+#define BVH_MAX_DEPTH 48
+
+
+struct BvhBox
+{
+    glm::vec3 min;
+    glm::vec3 max;
+
+    static BvhBox empty() { return { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) }; }
+
+    void grow(const glm::vec3& point) { min = glm::min(min, point); max = glm::max(max, point); }
+    void grow(const BvhBox& box) { min = glm::min(min, box.min); max = glm::max(max, box.max); }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+
+    // half the surface area, the SAH only compares areas
+    float area() const
+    {
+        glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+};
+
+struct BvhNode
+{
+    BvhBox       bounds;
+    unsigned int first;     // leaf: first entry in Bvh::primitives, inner: left child (right is first + 1)
+    unsigned int count;     // primitives of a leaf, 0 for inner nodes
+};
+
+// origin + t * direction for t in [0, tMax); direction does not have to be normalized
+struct BvhRay
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float     tMax;
+};
+
+struct BvhHit
+{
+    float        t;
+    unsigned int primitive;     // index into what the BVH was built from
+    glm::vec2    barycentric;   // triangle hits only
+};
+
+
+/*
+* Bounding volume hierarchy over axis aligned boxes, built top down with the
+* binned surface area heuristic.
+*
+* The primitives are whatever the caller has boxes for: the meshes of a model
+* (instances) or the triangles of a mesh (TriangleBvh). Siblings are stored
+* next to each other and children always after their parent, so refit() is a
+* single reverse pass when primitives move without changing the topology.
+* Queries report the caller's primitive indices; raycast() leaves the exact
+* test of a primitive to the caller and visits children near to far.
+*/
+class Bvh
+{
+public:
+    // root first, empty until built
+    vector<BvhNode>      nodes;
+    // leaves reference ranges of this array, entries are the caller's indices
+    vector<unsigned int> primitives;
+
+
+    void build(const vector<BvhBox>& boxes);
+
+    // new boxes for the same primitives (same count and order as build), topology is kept
+    void refit(const vector<BvhBox>& boxes);
+
+    bool isBuilt() const { return !nodes.empty(); }
+
+    size_t primitiveCount() const { return primitives.size(); }
+
+    // visible[i] = 1 when box i intersects the frustum, returns how many do. Subtrees
+    // completely inside skip the plane tests, planes a node is inside of are not
+    // tested again below it
+    size_t cullFrustum(const Frustum& frustum, vector<uint8_t>& visible) const;
+
+    // primitives whose boxes touch the sphere or the box, appended to out
+    void overlapSphere(const glm::vec3& center, float radius, vector<unsigned int>& out) const;
+    void overlapBox(const BvhBox& box, vector<unsigned int>& out) const;
+
+    // nearest hit: intersect(primitive, ray, hit) tests one primitive and returns true after
+    // lowering hit.t (it starts at ray.tMax) and filling the rest of the hit
+    template<typename Intersect>
+    bool raycast(const BvhRay& ray, Intersect intersect, BvhHit& hit) const;
+
+    // entry distance of the ray into the box, FLT_MAX when it misses before tMax
+    static float intersectBox(const BvhBox& box, const glm::vec3& origin, const glm::vec3& inverseDirection,
+        float tMax);
+
+    // 1 / direction with zero components kept finite
+    static glm::vec3 inverseDirection(const glm::vec3& direction);
+
+    // box of a primitive in the order it was built with
+    const BvhBox& primitiveBounds(unsigned int primitive) const { return bounds[primitive]; }
+
+    // expected cost of a random ray relative to one primitive test, lower is better
+    float sahCost() const;
+
+    size_t cpuBytes() const;
+
+private:
+    friend class TriangleBvh;
+
+    // box per primitive, indexed like the build input
+    vector<BvhBox> bounds;
+};
+
+
+/*
+* Triangle level BVH of one mesh for exact ray queries (picking, probe
+* placement, baking). Keeps its own copy of the positions and LOD 0 indices,
+* the triangles are reordered to leaf order and the BVH's primitives are
+* their positions in that order (its per primitive boxes are dropped).
+*/
+class TriangleBvh
+{
+public:
+    void build(const vector<glm::vec3>& positions, const unsigned int* indices, size_t indexCount);
+
+    bool isBuilt() const { return bvh.isBuilt(); }
+
+    size_t triangleCount() const { return triangles.size(); }
+
+    // nearest triangle, hit.primitive is its index in the original index buffer / 3
+    bool raycast(const BvhRay& ray, BvhHit& hit) const;
+
+    const Bvh& getBvh() const { return bvh; }
+
+    size_t cpuBytes() const;
+
+private:
+    Bvh                bvh;
+    vector<glm::vec3>  positions;
+    // leaf order, w is the triangle's original index
+    vector<glm::uvec4> triangles;
+};
+
+
+template<typename Intersect>
+bool Bvh::raycast(const BvhRay& ray, Intersect intersect, BvhHit& hit) const
+{
+    hit.t = ray.tMax;
+    if (nodes.empty())
+        return false;
+
+    struct Entry
+    {
+        unsigned int node;
+        float        t;
+    };
+    glm::vec3 inverse = inverseDirection(ray.direction);
+    Entry stack[BVH_MAX_DEPTH + 2];
+    int size = 0;
+    float rootT = intersectBox(nodes[0].bounds, ray.origin, inverse, hit.t);
+    if (rootT != FLT_MAX)
+        stack[size++] = { 0, rootT };
+
+    bool found = false;
+    while (size > 0)
+    {
+        Entry entry = stack[--size];
+        // a closer hit was found since the node was pushed
+        if (entry.t >= hit.t)
+            continue;
+        const BvhNode& node = nodes[entry.node];
+        if (node.count > 0)
+        {
+            for (unsigned int i = node.first; i < node.first + node.count; i++)
+                if (intersect(primitives[i], ray, hit))
+                    found = true;
+            continue;
+        }
+        unsigned int nearChild = node.first, farChild = node.first + 1;
+        float nearT = intersectBox(nodes[nearChild].bounds, ray.origin, inverse, hit.t);
+        float farT = intersectBox(nodes[farChild].bounds, ray.origin, inverse, hit.t);
+        if (farT < nearT)
+        {
+            swap(nearChild, farChild);
+            swap(nearT, farT);
+        }
+        // the near child is popped first
+        if (farT != FLT_MAX)
+            stack[size++] = { farChild, farT };
+        if (nearT != FLT_MAX)
+            stack[size++] = { nearChild, nearT };
+    }
+    return found;
+}
\ No newline at end of file
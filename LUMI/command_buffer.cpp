@@ -0,0 +1,303 @@
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+
+#include "command_buffer.h"
+#include "gl_state.h"
+
+
+namespace
+{
+    CommandBufferStats stats = {};
+    unsigned int       statFrames = 0;
+
+    double elapsedMs(chrono::steady_clock::time_point start)
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+}
+
+
+CommandBuffer::CommandBuffer()
+{
+    queuesUsed = 0;
+    recordedPackets = 0;
+}
+
+
+void CommandBuffer::bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    Command command;
+    command.type = CommandType::BindFramebuffer;
+    command.framebuffer.target = target;
+    command.framebuffer.framebuffer = framebuffer;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    Command command;
+    command.type = CommandType::Viewport;
+    command.viewport.x = x;
+    command.viewport.y = y;
+    command.viewport.width = width;
+    command.viewport.height = height;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::clear(GLbitfield mask)
+{
+    Command command;
+    command.type = CommandType::Clear;
+    command.clearMask = mask;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::useProgram(Shader& shader)
+{
+    Command command;
+    command.type = CommandType::UseProgram;
+    command.shader = &shader;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::setInt(Shader& shader, const string& name, int value)
+{
+    setUniform(CommandType::SetInt, shader, name, &value, sizeof(value));
+}
+
+
+void CommandBuffer::setFloat(Shader& shader, const string& name, float value)
+{
+    setUniform(CommandType::SetFloat, shader, name, &value, sizeof(value));
+}
+
+
+void CommandBuffer::setVec3(Shader& shader, const string& name, const glm::vec3& value)
+{
+    setUniform(CommandType::SetVec3, shader, name, &value[0], sizeof(value));
+}
+
+
+void CommandBuffer::setMat4(Shader& shader, const string& name, const glm::mat4& value)
+{
+    setUniform(CommandType::SetMat4, shader, name, &value[0][0], sizeof(value));
+}
+
+
+void CommandBuffer::bindTextureUnit(GLuint unit, GLenum target, GLuint texture)
+{
+    Command command;
+    command.type = CommandType::BindTexture;
+    command.texture.unit = unit;
+    command.texture.target = target;
+    command.texture.texture = texture;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::updateUniformBuffer(UniformBuffer& buffer, const void* data)
+{
+    Command command;
+    command.type = CommandType::UpdateUniformBuffer;
+    command.uniformBuffer.buffer = &buffer;
+    command.uniformBuffer.bytes = store(data, static_cast<size_t>(buffer.size));
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::call(function<void()> function)
+{
+    Command command;
+    command.type = CommandType::Call;
+    command.index = static_cast<uint32_t>(calls.size());
+    calls.push_back(move(function));
+    commands.push_back(command);
+}
+
+
+RenderQueue& CommandBuffer::newQueue()
+{
+    if (queuesUsed == queues.size())
+        queues.emplace_back(new RenderQueue());
+    return *queues[queuesUsed++];
+}
+
+
+void CommandBuffer::drawQueue(RenderQueue& queue)
+{
+    queue.sortPackets();
+    recordedPackets += static_cast<unsigned int>(queue.size());
+    Command command;
+    command.type = CommandType::DrawQueue;
+    command.index = 0;
+    while (queues[command.index].get() != &queue)
+        command.index++;
+    commands.push_back(command);
+}
+
+
+void CommandBuffer::replay()
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (const Command& command : commands)
+    {
+        switch (command.type)
+        {
+        case CommandType::BindFramebuffer:
+            GLState::bindFramebuffer(command.framebuffer.target, command.framebuffer.framebuffer);
+            break;
+        case CommandType::Viewport:
+            GLState::viewport(command.viewport.x, command.viewport.y, command.viewport.width, command.viewport.height);
+            break;
+        case CommandType::Clear:
+            glClear(command.clearMask);
+            break;
+        case CommandType::UseProgram:
+            command.shader->use();
+            break;
+        case CommandType::SetInt:
+            command.uniform.shader->setInt(command.uniform.handle, *reinterpret_cast<const int*>(&data[command.uniform.value]));
+            break;
+        case CommandType::SetFloat:
+            command.uniform.shader->setFloat(command.uniform.handle, *reinterpret_cast<const float*>(&data[command.uniform.value]));
+            break;
+        case CommandType::SetVec3:
+            command.uniform.shader->setVec3(command.uniform.handle, *reinterpret_cast<const glm::vec3*>(&data[command.uniform.value]));
+            break;
+        case CommandType::SetMat4:
+            command.uniform.shader->setMat4(command.uniform.handle, *reinterpret_cast<const glm::mat4*>(&data[command.uniform.value]));
+            break;
+        case CommandType::BindTexture:
+            GLState::bindTextureUnit(command.texture.unit, command.texture.target, command.texture.texture);
+            break;
+        case CommandType::UpdateUniformBuffer:
+            command.uniformBuffer.buffer->update(&data[command.uniformBuffer.bytes]);
+            break;
+        case CommandType::DrawQueue:
+            queues[command.index]->drawSorted();
+            break;
+        case CommandType::Call:
+            calls[command.index]();
+            break;
+        }
+    }
+    stats.commands += static_cast<unsigned int>(commands.size());
+    stats.packets += recordedPackets;
+    for (size_t i = 0; i < queuesUsed; i++)
+    {
+        stats.queues += queues[i]->getStats();
+        queues[i]->resetStats();
+    }
+    stats.replayMs += elapsedMs(start);
+    reset();
+}
+
+
+void CommandBuffer::reset()
+{
+    commands.clear();
+    data.clear();
+    calls.clear();
+    // queues that were never drawn keep nothing into the next frame
+    for (size_t i = 0; i < queuesUsed; i++)
+    {
+        queues[i]->clear();
+        queues[i]->resetStats();
+    }
+    queuesUsed = 0;
+    recordedPackets = 0;
+}
+
+
+ThreadPool& CommandBuffer::recordingPool()
+{
+    static ThreadPool pool(max(2u, thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+
+void CommandBuffer::recordAndReplay(const vector<CommandBuffer*>& buffers,
+    const vector<function<void(CommandBuffer&)>>& record)
+{
+    vector<future<double>> recordings;
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        CommandBuffer* buffer = buffers[i];
+        const function<void(CommandBuffer&)>* recorder = &record[i];
+        recordings.push_back(recordingPool().submit([buffer, recorder] {
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            (*recorder)(*buffer);
+            return elapsedMs(start);
+        }));
+    }
+    for (size_t i = 0; i < buffers.size(); i++)
+    {
+        stats.recordMs += recordings[i].get();
+        buffers[i]->replay();
+    }
+}
+
+
+void CommandBuffer::setUniform(CommandType type, Shader& shader, const string& name, const void* value, size_t bytes)
+{
+    Command command;
+    command.type = type;
+    command.uniform.shader = &shader;
+    command.uniform.handle = shader.uniform(name);
+    command.uniform.value = store(value, bytes);
+    commands.push_back(command);
+}
+
+
+uint32_t CommandBuffer::store(const void* value, size_t bytes)
+{
+    uint32_t offset = static_cast<uint32_t>(data.size());
+    data.resize(data.size() + (bytes + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+    memcpy(&data[offset], value, bytes);
+    return offset;
+}
+
+
+CommandBufferStats CommandBuffer::getStats()
+{
+    return stats;
+}
+
+
+void CommandBuffer::resetStats()
+{
+    stats = {};
+}
+
+
+void CommandBuffer::printStats()
+{
+    cout << "COMMAND_BUFFER:: " << stats.commands << " commands, " << stats.packets << " draw packets, recorded in "
+        << stats.recordMs << " ms over the workers, replayed in " << stats.replayMs << " ms" << endl;
+    RenderQueue::printStats(stats.queues);
+}
+
+
+void CommandBuffer::endFrame()
+{
+#if COMMAND_BUFFER_REPORT_FRAMES
+    if (++statFrames < COMMAND_BUFFER_REPORT_FRAMES)
+        return;
+    statFrames = 0;
+    // per frame averages
+    stats.commands /= COMMAND_BUFFER_REPORT_FRAMES;
+    stats.packets /= COMMAND_BUFFER_REPORT_FRAMES;
+    stats.recordMs /= COMMAND_BUFFER_REPORT_FRAMES;
+    stats.replayMs /= COMMAND_BUFFER_REPORT_FRAMES;
+    stats.queues.divide(COMMAND_BUFFER_REPORT_FRAMES);
+    cout << "COMMAND_BUFFER:: per frame over the last " << COMMAND_BUFFER_REPORT_FRAMES << " frames" << endl;
+    printStats();
+    resetStats();
+#endif
+}
\ No newline at end of file
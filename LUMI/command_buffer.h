@@ -0,0 +1,142 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "render_queue.h"
+#include "shader.h"
+#include "thread_pool.h"
+#include "uniform_blocks.h"
+using namespace std;
+
+// print and reset the counters every this many frames (0: never)
+#define COMMAND_BUFFER_REPORT_FRAMES 600
+
+
+enum class CommandType : uint8_t
+{
+    BindFramebuffer,
+    Viewport,
+    Clear,
+    UseProgram,
+    SetInt,
+    SetFloat,
+    SetVec3,
+    SetMat4,
+    BindTexture,
+    UpdateUniformBuffer,
+    DrawQueue,
+    Call
+};
+
+// payloads that don't fit live in CommandBuffer::data, referenced by offset
+struct Command
+{
+    CommandType type;
+    union
+    {
+        struct { GLenum target; GLuint framebuffer; }              framebuffer;
+        struct { GLint x, y; GLsizei width, height; }              viewport;
+        GLbitfield                                                 clearMask;
+        Shader*                                                    shader;
+        struct { Shader* shader; UniformHandle handle; uint32_t value; } uniform;
+        struct { GLuint unit; GLenum target; GLuint texture; }      texture;
+        struct { UniformBuffer* buffer; uint32_t bytes; }          uniformBuffer;
+        uint32_t                                                   index;  // queue or call
+    };
+};
+
+struct CommandBufferStats
+{
+    unsigned int commands;
+    unsigned int packets;       // draw packets of the recorded queues
+    double       recordMs;      // summed over the recording threads
+    double       replayMs;
+    // the owned queues' sort and bind counters, folded in at replay
+    RenderQueueStats queues;
+};
+
+
+/*
+* GL work recorded as plain data on any thread and replayed later, in order,
+* on the thread owning the context.
+*
+* Recording never calls GL: uniform names resolve to handles through the
+* shader's read only table, uniform buffer contents are copied, and draw
+* lists are RenderQueues owned by the buffer, sorted while recording so the
+* replay only binds and draws. Each pass (or chunk of a pass) records into a
+* buffer of its own on the recording pool, the GL thread waits for them and
+* replays the buffers in submission order; the replay goes through GLState
+* and the shaders' uniform caches like any direct call would. Call() is the
+* way out for GL work without a command of its own, its function runs at
+* replay.
+*
+* Whatever a recording reads must not change until it finishes: models are
+* updated before recording starts and only read while it runs.
+*/
+class CommandBuffer
+{
+public:
+    CommandBuffer();
+
+    CommandBuffer(const CommandBuffer&) = delete;
+    CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+    // recording, any thread (one at a time per buffer)
+    void bindFramebuffer(GLenum target, GLuint framebuffer);
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void clear(GLbitfield mask);
+    void useProgram(Shader& shader);
+    void setInt(Shader& shader, const string& name, int value);
+    void setFloat(Shader& shader, const string& name, float value);
+    void setVec3(Shader& shader, const string& name, const glm::vec3& value);
+    void setMat4(Shader& shader, const string& name, const glm::mat4& value);
+    void bindTextureUnit(GLuint unit, GLenum target, GLuint texture);
+    // buffer->size bytes of data are copied now and uploaded at replay
+    void updateUniformBuffer(UniformBuffer& buffer, const void* data);
+    void call(function<void()> function);
+
+    // an empty draw list of this buffer to submit into, then drawQueue() where it should be drawn
+    RenderQueue& newQueue();
+    // sorts the queue now, draws it at replay
+    void drawQueue(RenderQueue& queue);
+
+    // GL thread: runs the commands in recording order and clears the buffer
+    void replay();
+
+    // drops the commands without running them
+    void reset();
+
+    size_t size() const { return commands.size(); }
+
+    // worker threads recordings run on, apart from the loading pool so they never wait behind a decode
+    static ThreadPool& recordingPool();
+
+    // record(buffer) for every buffer on the recording pool, waits for all of them and replays
+    // them in order on the calling (GL) thread
+    static void recordAndReplay(const vector<CommandBuffer*>& buffers, const vector<function<void(CommandBuffer&)>>& record);
+
+    static CommandBufferStats getStats();
+    static void resetStats();
+    // with the RENDER_QUEUE:: report of the queues drawn
+    static void printStats();
+
+    // once per frame, prints and resets the counters every COMMAND_BUFFER_REPORT_FRAMES frames
+    static void endFrame();
+
+private:
+    void setUniform(CommandType type, Shader& shader, const string& name, const void* value, size_t bytes);
+    uint32_t store(const void* value, size_t bytes);
+
+    vector<Command>                 commands;
+    // uniform values and uniform buffer contents, 4 byte aligned
+    vector<uint32_t>                data;
+    vector<function<void()>>        calls;
+    // queues are kept between frames for their allocations, queuesUsed of them are this frame's
+    vector<unique_ptr<RenderQueue>> queues;
+    size_t                          queuesUsed;
+    unsigned int                    recordedPackets;
+};
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#include "frustum_culling.h"
+#if FRUSTUM_CULLING_SIMD
+#include <emmintrin.h>
+#endif
+
+
+namespace
+{
+    const size_t PASS_COUNT = size_t(RenderPass::Overlay) + 1;
+    const char* const PASS_NAMES[PASS_COUNT] = { "shadow", "depth", "opaque", "transparent", "overlay" };
+
+    CullingStats passStats[PASS_COUNT];
+    // record() comes from command buffer recordings too
+    mutex        statsMutex;
+    unsigned int frames = 0;
+}
+
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProjection)
+{
+    // Gribb/Hartmann: the planes are sums and differences of the matrix rows
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+    Frustum frustum;
+    frustum.planes[0] = rows[3] + rows[0];  // left
+    frustum.planes[1] = rows[3] - rows[0];  // right
+    frustum.planes[2] = rows[3] + rows[1];  // bottom
+    frustum.planes[3] = rows[3] - rows[1];  // top
+    frustum.planes[4] = rows[3] + rows[2];  // near
+    frustum.planes[5] = rows[3] - rows[2];  // far
+    return frustum;
+}
+
+
+Frustum Frustum::toObjectSpace(const glm::mat4& model) const
+{
+    // dot(plane, model * p) == dot(transpose(model) * plane, p)
+    Frustum frustum;
+    for (int i = 0; i < 6; i++)
+        frustum.planes[i] = planes[i] * model;
+    return frustum;
+}
+
+
+void BoundsSoA::build(const vector<Mesh>& meshes)
+{
+    count = meshes.size();
+    size_t padded = (count + 3) & ~size_t(3);
+    vector<float>* streams[] = { &centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ, &radius };
+    for (vector<float>* stream : streams)
+        stream->assign(padded, 0.0f);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const Mesh& mesh = meshes[i];
+        glm::vec3 center = (mesh.aabbMin + mesh.aabbMax) * 0.5f;
+        glm::vec3 extent = (mesh.aabbMax - mesh.aabbMin) * 0.5f;
+        centerX[i] = center.x;
+        centerY[i] = center.y;
+        centerZ[i] = center.z;
+        extentX[i] = extent.x;
+        extentY[i] = extent.y;
+        extentZ[i] = extent.z;
+        radius[i] = mesh.boundingRadius;
+    }
+}
+
+
+size_t FrustumCuller::cull(const Frustum& objectFrustum, const BoundsSoA& bounds, vector<uint8_t>& visible)
+{
+    visible.assign(bounds.count, 0);
+    float planes[6][8];
+    for (int p = 0; p < 6; p++)
+    {
+        const glm::vec4& plane = objectFrustum.planes[p];
+        float values[8] = { plane.x, plane.y, plane.z, plane.w, fabs(plane.x), fabs(plane.y), fabs(plane.z),
+            glm::length(glm::vec3(plane)) };
+        memcpy(planes[p], values, sizeof(values));
+    }
+
+    size_t visibleCount = 0;
+    size_t i = 0;
+#if FRUSTUM_CULLING_SIMD
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= bounds.centerX.size(); i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+        __m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+        __m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+        __m128 r = _mm_loadu_ps(&bounds.radius[i]);
+        __m128 outside = zero;
+        for (int p = 0; p < 6; p++)
+        {
+            const float* plane = planes[p];
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane[0])),
+                _mm_mul_ps(cy, _mm_set1_ps(plane[1]))), _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane[2])),
+                _mm_set1_ps(plane[3])));
+            __m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(plane[4])),
+                _mm_mul_ps(ey, _mm_set1_ps(plane[5]))), _mm_mul_ps(ez, _mm_set1_ps(plane[6])));
+            __m128 sphereRadius = _mm_mul_ps(r, _mm_set1_ps(plane[7]));
+            __m128 reach = _mm_min_ps(boxRadius, sphereRadius);
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), zero));
+        }
+        int mask = _mm_movemask_ps(outside);
+        for (size_t lane = 0; lane < 4 && i + lane < bounds.count; lane++)
+        {
+            uint8_t inside = (mask >> lane & 1) == 0;
+            visible[i + lane] = inside;
+            visibleCount += inside;
+        }
+    }
+#endif
+    for (; i < bounds.count; i++)
+    {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++)
+        {
+            const float* plane = planes[p];
+            float distance = bounds.centerX[i] * plane[0] + bounds.centerY[i] * plane[1] +
+                bounds.centerZ[i] * plane[2] + plane[3];
+            float boxRadius = bounds.extentX[i] * plane[4] + bounds.extentY[i] * plane[5] +
+                bounds.extentZ[i] * plane[6];
+            inside = distance + min(boxRadius, bounds.radius[i] * plane[7]) >= 0.0f;
+        }
+        visible[i] = inside;
+        visibleCount += inside;
+    }
+    return visibleCount;
+}
+
+
+void FrustumCuller::record(RenderPass pass, unsigned int visible, unsigned int culled)
+{
+    lock_guard<mutex> lock(statsMutex);
+    passStats[size_t(pass)].visible += visible;
+    passStats[size_t(pass)].culled += culled;
+}
+
+
+CullingStats FrustumCuller::getStats(RenderPass pass)
+{
+    return passStats[size_t(pass)];
+}
+
+
+void FrustumCuller::resetStats()
+{
+    memset(passStats, 0, sizeof(passStats));
+}
+
+
+void FrustumCuller::printStats()
+{
+    cout << "FRUSTUM_CULLING::";
+    for (size_t pass = 0; pass < PASS_COUNT; pass++)
+    {
+        const CullingStats& stats = passStats[pass];
+        if (stats.visible + stats.culled != 0)
+            cout << " " << PASS_NAMES[pass] << " " << stats.visible << "/" << stats.visible + stats.culled << " visible";
+    }
+    cout << endl;
+}
+
+
+void FrustumCuller::endFrame()
+{
+#if FRUSTUM_CULLING_REPORT_FRAMES
+    if (++frames < FRUSTUM_CULLING_REPORT_FRAMES)
+        return;
+    frames = 0;
+    // per frame averages
+    for (CullingStats& stats : passStats)
+    {
+        stats.visible /= FRUSTUM_CULLING_REPORT_FRAMES;
+        stats.culled /= FRUSTUM_CULLING_REPORT_FRAMES;
+    }
+    cout << "FRUSTUM_CULLING:: per frame over the last " << FRUSTUM_CULLING_REPORT_FRAMES << " frames" << endl;
+    printStats();
+    resetStats();
+#endif
+}
\ No newline at end of file
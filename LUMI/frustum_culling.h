@@ -0,0 +1,75 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+#include "render_queue.h"
+using namespace std;
+
+// test four bounds at a time with SSE (always available on x64), 0 for the scalar loop
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define FRUSTUM_CULLING_SIMD 1
+#else
+#define FRUSTUM_CULLING_SIMD 0
+#endif
+// print and reset the per pass counters every this many frames (0: never)
+#define FRUSTUM_CULLING_REPORT_FRAMES 600
+
+
+// the six planes of a view projection, inside where dot(plane, (p, 1)) >= 0; not normalized
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    // world space frustum of a view projection (or light space) matrix
+    static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+    // the same frustum in the object space of model
+    Frustum toObjectSpace(const glm::mat4& model) const;
+};
+
+// object space bounds of a list of meshes as structure of arrays, padded to a multiple of 4
+struct BoundsSoA
+{
+    vector<float> centerX, centerY, centerZ;
+    vector<float> extentX, extentY, extentZ;    // half size of the box
+    vector<float> radius;                       // sphere around the box center
+    size_t        count;
+
+    BoundsSoA() : count(0) {}
+
+    void build(const vector<Mesh>& meshes);
+};
+
+struct CullingStats
+{
+    unsigned int visible;
+    unsigned int culled;
+};
+
+
+/*
+* View frustum culling of mesh bounds.
+*
+* The frustum is moved into the model's object space instead of moving every
+* box into world space, so a model costs one matrix product per plane. A
+* bound is outside when its center lies further behind a plane than the
+* smaller of its two radii toward that plane: the box's projected half size
+* and the bounding sphere's radius (the planes are not normalized, both scale
+* with the normal's length). Counters are kept per pass, like GLState's.
+*/
+class FrustumCuller
+{
+public:
+    // visible[i] = 1 when bounds i intersects the frustum, returns how many do
+    static size_t cull(const Frustum& objectFrustum, const BoundsSoA& bounds, vector<uint8_t>& visible);
+
+    static void record(RenderPass pass, unsigned int visible, unsigned int culled);
+    static CullingStats getStats(RenderPass pass);
+    static void resetStats();
+    static void printStats();
+
+    // once per frame, prints and resets the counters every FRUSTUM_CULLING_REPORT_FRAMES frames
+    static void endFrame();
+};
\ No newline at end of file
@@ -0,0 +1,290 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "geometry_batch.h"
+#include "gl_state.h"
+
+
+GeometryBatch::GeometryBatch(VertexFormat format)
+{
+    this->format = format;
+    VAO = depthVAO = VBO = EBO = skinVBO = layerVBO = positionVBO = 0;
+    indexType = GL_UNSIGNED_INT;
+    vertexCount = 0;
+    maxMeshVertexCount = 0;
+    skinned = false;
+    layout = VertexLayout::describe(format, false);
+}
+
+
+MeshRange GeometryBatch::add(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+{
+    MeshRange range;
+    range.firstIndex = static_cast<unsigned int>(indexData.size());
+    range.indexCount = static_cast<unsigned int>(indexCount);
+    range.baseVertex = static_cast<int>(this->vertexCount);
+
+    layout.pack(vertices, vertexCount, vertexData);
+    // the Full layout interleaves bone data, Compact keeps it in a second stream
+    if (format == VertexFormat::Compact)
+    {
+        VertexLayout::packSkin(vertices, vertexCount, skinData);
+        skinned = skinned || VertexLayout::hasSkin(vertices, vertexCount);
+    }
+    indexData.insert(indexData.end(), indices, indices + indexCount);
+#if MESH_DEPTH_STREAM
+    VertexLayout::packPositions(vertices, vertexCount, positionData);
+#endif
+
+    this->vertexCount += vertexCount;
+    maxMeshVertexCount = max(maxMeshVertexCount, vertexCount);
+    return range;
+}
+
+
+MeshRange GeometryBatch::add(const PackedVertices& vertices, const unsigned int* indices, size_t indexCount)
+{
+    MeshRange range;
+    range.firstIndex = static_cast<unsigned int>(indexData.size());
+    range.indexCount = static_cast<unsigned int>(indexCount);
+    range.baseVertex = static_cast<int>(this->vertexCount);
+
+    const unsigned char* data = vertices.data;
+    vertexData.insert(vertexData.end(), data, data + vertices.count * layout.stride);
+    if (format == VertexFormat::Compact)
+    {
+        // meshes without bone data still fill their part of the shared skin stream
+        if (vertices.skin)
+            skinData.insert(skinData.end(), vertices.skin, vertices.skin + vertices.count);
+        else
+            skinData.resize(skinData.size() + vertices.count, SkinVertex());
+        skinned = skinned || vertices.skin != nullptr;
+    }
+    indexData.insert(indexData.end(), indices, indices + indexCount);
+#if MESH_DEPTH_STREAM
+    positionData.insert(positionData.end(), vertices.positions, vertices.positions + vertices.count);
+#endif
+
+    this->vertexCount += vertices.count;
+    maxMeshVertexCount = max(maxMeshVertexCount, vertices.count);
+    return range;
+}
+
+
+void GeometryBatch::upload(vector<Mesh>& meshes, const vector<MaterialLayers>* meshLayers)
+{
+    layout = VertexLayout::describe(format, skinned);
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+    GLState::bindVertexArray(VAO);
+
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
+    VertexLayout::enable(layout.attributes, layout.stride);
+
+    if (!layout.skinAttributes.empty())
+    {
+        glGenBuffers(1, &skinVBO);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, skinVBO);
+        glBufferData(GL_ARRAY_BUFFER, skinData.size() * sizeof(SkinVertex), skinData.data(), GL_STATIC_DRAW);
+        VertexLayout::enable(layout.skinAttributes, layout.skinStride);
+    }
+
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    if (maxMeshVertexCount <= 65536)
+    {
+        indexType = GL_UNSIGNED_SHORT;
+        vector<uint16_t> shortIndices(indexData.begin(), indexData.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+    }
+    else
+    {
+        indexType = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(unsigned int), indexData.data(), GL_STATIC_DRAW);
+    }
+
+    if (meshLayers)
+    {
+        // the mesh's layers repeated for each of its vertices
+        vector<MaterialLayers> layerData(vertexCount, MaterialLayers(0));
+        for (size_t i = 0; i < meshes.size(); i++)
+            fill_n(layerData.begin() + meshes[i].baseVertex, meshes[i].vertexCount, (*meshLayers)[i]);
+        glGenBuffers(1, &layerVBO);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, layerVBO);
+        glBufferData(GL_ARRAY_BUFFER, layerData.size() * sizeof(MaterialLayers), layerData.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(TEXTURE_ARRAY_LAYER_ATTRIBUTE);
+        glVertexAttribIPointer(TEXTURE_ARRAY_LAYER_ATTRIBUTE, 4, GL_UNSIGNED_BYTE, sizeof(MaterialLayers), (void*)0);
+    }
+
+#if MESH_DEPTH_STREAM
+    glGenVertexArrays(1, &depthVAO);
+    glGenBuffers(1, &positionVBO);
+    GLState::bindVertexArray(depthVAO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, positionData.size() * sizeof(glm::vec3), positionData.data(), GL_STATIC_DRAW);
+    VertexLayout::enablePositions();
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+#else
+    depthVAO = VAO;
+#endif
+    GLState::bindVertexArray(0);
+
+    vector<unsigned char>().swap(vertexData);
+    vector<SkinVertex>().swap(skinData);
+    vector<unsigned int>().swap(indexData);
+    vector<glm::vec3>().swap(positionData);
+
+    for (Mesh& mesh : meshes)
+        mesh.attach(VAO, depthVAO, indexType, layout);
+    buildDrawGroups(meshes);
+}
+
+
+void GeometryBatch::buildDrawGroups(const vector<Mesh>& meshes)
+{
+    // material ids are shared by identical materials, one group per id
+    unordered_map<unsigned int, size_t> groupIndex;
+    groups.clear();
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const Mesh& mesh = meshes[i];
+        auto found = groupIndex.find(mesh.material);
+        if (found == groupIndex.end())
+        {
+            found = groupIndex.emplace(mesh.material, groups.size()).first;
+            groups.push_back(DrawGroup());
+            groups.back().material = mesh.material;
+        }
+        DrawGroup& group = groups[found->second];
+        group.counts.push_back(static_cast<GLsizei>(mesh.indexCount));
+        group.offsets.push_back(mesh.indexOffset());
+        group.baseVertices.push_back(mesh.baseVertex);
+        group.meshIndices.push_back(i);
+    }
+}
+
+
+void GeometryBatch::draw()
+{
+    GLState::bindVertexArray(VAO);
+    for (DrawGroup& group : groups)
+    {
+        MaterialLibrary::bind(group.material);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, group.counts.data(), indexType, group.offsets.data(),
+            static_cast<GLsizei>(group.counts.size()), group.baseVertices.data());
+    }
+}
+
+
+void GeometryBatch::draw(const vector<Mesh>& meshes, const vector<unsigned int>& lodLevels)
+{
+    GLState::bindVertexArray(VAO);
+    for (DrawGroup& group : groups)
+    {
+        lodCounts.clear();
+        lodOffsets.clear();
+        lodBaseVertices.clear();
+        collectLevels(group, meshes, lodLevels);
+        if (lodCounts.empty())
+            continue;
+        MaterialLibrary::bind(group.material);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, lodCounts.data(), indexType, lodOffsets.data(),
+            static_cast<GLsizei>(lodCounts.size()), lodBaseVertices.data());
+    }
+}
+
+
+void GeometryBatch::drawAll(unsigned int material, const vector<Mesh>& meshes, const vector<unsigned int>* lodLevels)
+{
+    lodCounts.clear();
+    lodOffsets.clear();
+    lodBaseVertices.clear();
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const Mesh& mesh = meshes[i];
+        unsigned int lod = lodLevels ? (*lodLevels)[i] : 0;
+        if (lod == GEOMETRY_BATCH_SKIP)
+            continue;
+        lodCounts.push_back(static_cast<GLsizei>(mesh.lods[lod].indexCount));
+        lodOffsets.push_back(mesh.indexOffset(lod));
+        lodBaseVertices.push_back(mesh.baseVertex);
+    }
+    if (lodCounts.empty())
+        return;
+    GLState::bindVertexArray(VAO);
+    MaterialLibrary::bind(material);
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, lodCounts.data(), indexType, lodOffsets.data(),
+        static_cast<GLsizei>(lodCounts.size()), lodBaseVertices.data());
+}
+
+
+void GeometryBatch::drawDepth(const vector<Mesh>& meshes, const vector<unsigned int>& lodLevels, Shader* maskedShader)
+{
+    // the position stream needs no material, so the groups only split off the alpha tested ones
+    lodCounts.clear();
+    lodOffsets.clear();
+    lodBaseVertices.clear();
+    for (DrawGroup& group : groups)
+        if (!maskedShader || !MaterialLibrary::isAlphaTested(group.material))
+            collectLevels(group, meshes, lodLevels);
+    if (!lodCounts.empty())
+    {
+        GLState::bindVertexArray(depthVAO);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, lodCounts.data(), indexType, lodOffsets.data(),
+            static_cast<GLsizei>(lodCounts.size()), lodBaseVertices.data());
+    }
+    if (!maskedShader)
+        return;
+
+    bool masking = false;
+    for (DrawGroup& group : groups)
+    {
+        if (!MaterialLibrary::isAlphaTested(group.material))
+            continue;
+        lodCounts.clear();
+        lodOffsets.clear();
+        lodBaseVertices.clear();
+        collectLevels(group, meshes, lodLevels);
+        if (lodCounts.empty())
+            continue;
+        if (!masking)
+        {
+            maskedShader->use();
+            GLState::bindVertexArray(VAO);
+            masking = true;
+        }
+        MaterialLibrary::bind(group.material);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, lodCounts.data(), indexType, lodOffsets.data(),
+            static_cast<GLsizei>(lodCounts.size()), lodBaseVertices.data());
+    }
+}
+
+
+void GeometryBatch::collectLevels(const DrawGroup& group, const vector<Mesh>& meshes, const vector<unsigned int>& lodLevels)
+{
+    for (size_t meshIndex : group.meshIndices)
+    {
+        const Mesh& mesh = meshes[meshIndex];
+        unsigned int lod = lodLevels[meshIndex];
+        if (lod == GEOMETRY_BATCH_SKIP)
+            continue;
+        lodCounts.push_back(static_cast<GLsizei>(mesh.lods[lod].indexCount));
+        lodOffsets.push_back(mesh.indexOffset(lod));
+        lodBaseVertices.push_back(mesh.baseVertex);
+    }
+}
+
+
+size_t GeometryBatch::cpuBytes() const
+{
+    size_t bytes = vertexData.capacity() + skinData.capacity() * sizeof(SkinVertex) +
+        indexData.capacity() * sizeof(unsigned int) + positionData.capacity() * sizeof(glm::vec3) +
+        groups.capacity() * sizeof(DrawGroup);
+    for (const DrawGroup& group : groups)
+        bytes += group.counts.capacity() * sizeof(GLsizei) +
+            group.offsets.capacity() * sizeof(const void*) + group.baseVertices.capacity() * sizeof(GLint) +
+            group.meshIndices.capacity() * sizeof(size_t);
+    return bytes;
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+#include "shader.h"
+#include "texture_array.h"
+using namespace std;
+
+
+// lodLevels entry of a mesh that is not drawn (culled)
+#define GEOMETRY_BATCH_SKIP 0xFFFFFFFFu
+
+// where a mesh lives inside the shared buffers
+struct MeshRange
+{
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    int          baseVertex;
+};
+
+
+/*
+* All meshes of a model in one vertex buffer and one index buffer.
+*
+* Meshes are added while the model loads (add() only stages the packed data on
+* the CPU), upload() then creates the shared VAO and hands it to every mesh.
+* Indices stay relative to their mesh and are rebased with base vertex draws,
+* so 16 bit indices are used as long as each mesh has at most 65536 vertices.
+* Meshes with the same textures form a draw group that is submitted with a
+* single glMultiDrawElementsBaseVertex. The LOD index buffers of a mesh
+* follow its full index buffer and reuse its base vertex. With texture arrays
+* every vertex also carries its mesh's layers and drawAll() submits all
+* meshes in one multi draw.
+*
+* A second vertex array reads the same indices with positions only
+* (MESH_DEPTH_STREAM): drawDepth() puts every opaque caster into one multi
+* draw on it without binding a material, whatever the materials are, and
+* leaves the alpha tested ones to a masked shader on the full stream.
+*/
+class GeometryBatch
+{
+public:
+    unsigned int VAO;
+    // positions only, VAO without MESH_DEPTH_STREAM
+    unsigned int depthVAO;
+    GLenum       indexType;
+    VertexLayout layout;
+
+
+    GeometryBatch(VertexFormat format = MESH_VERTEX_FORMAT);
+
+    MeshRange add(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount);
+    // already packed vertices in the batch's format are appended as they are
+    MeshRange add(const PackedVertices& vertices, const unsigned int* indices, size_t indexCount);
+
+    // create the GL buffers, attach them to the meshes and build the draw groups,
+    // meshLayers (indexed like meshes) adds the TEXTURE_ARRAY_LAYER_ATTRIBUTE stream
+    void upload(vector<Mesh>& meshes, const vector<MaterialLayers>* meshLayers = nullptr);
+
+    bool isUploaded() const { return VAO != 0; }
+
+    // one multi draw per material, LOD 0, with the caller's program in use
+    void draw();
+
+    // same with a level per mesh, lodLevels is indexed like meshes (GEOMETRY_BATCH_SKIP: not drawn)
+    void draw(const vector<Mesh>& meshes, const vector<unsigned int>& lodLevels);
+
+    // every mesh in one multi draw binding a single material (MaterialTextureArrays),
+    // at LOD 0 without lodLevels
+    void drawAll(unsigned int material, const vector<Mesh>& meshes, const vector<unsigned int>* lodLevels = nullptr);
+
+    // depth only, with the caller's program in use: all meshes but the alpha tested ones in one
+    // multi draw of the position stream, those with maskedShader and their material (the program
+    // in use afterwards if any was drawn). Without maskedShader every mesh takes the position stream
+    void drawDepth(const vector<Mesh>& meshes, const vector<unsigned int>& lodLevels, Shader* maskedShader = nullptr);
+
+    size_t getDrawGroupCount() const { return groups.size(); }
+
+    // staging data (until upload) and draw group arrays
+    size_t cpuBytes() const;
+
+private:
+    struct DrawGroup
+    {
+        unsigned int        material;
+        vector<GLsizei>     counts;
+        vector<const void*> offsets;
+        vector<GLint>       baseVertices;
+        vector<size_t>      meshIndices;
+    };
+
+    void buildDrawGroups(const vector<Mesh>& meshes);
+
+    // append the group's meshes that are drawn at their level to the LOD scratch
+    void collectLevels(const DrawGroup& group, const vector<Mesh>& meshes, const vector<unsigned int>& lodLevels);
+
+    VertexFormat          format;
+    unsigned int          VBO, EBO, skinVBO, layerVBO, positionVBO;
+    size_t                vertexCount;
+    size_t                maxMeshVertexCount;
+    bool                  skinned;
+    // packed staging data, released by upload()
+    vector<unsigned char> vertexData;
+    vector<SkinVertex>    skinData;
+    vector<unsigned int>  indexData;
+    vector<glm::vec3>     positionData;
+    vector<DrawGroup>     groups;
+    // per draw scratch for LOD submissions
+    vector<GLsizei>       lodCounts;
+    vector<const void*>   lodOffsets;
+    vector<GLint>         lodBaseVertices;
+};
\ No newline at end of file
@@ -0,0 +1,516 @@
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#include "gl_state.h"
+
+
+namespace
+{
+    // never a valid object name or enum, marks a cache entry as unknown
+    const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    enum TextureTarget
+    {
+        TEXTURE_2D,
+        TEXTURE_CUBE_MAP,
+        TEXTURE_2D_ARRAY,
+        TEXTURE_3D,
+        TEXTURE_2D_MULTISAMPLE,
+        TEXTURE_TARGET_COUNT
+    };
+
+    enum BufferTarget
+    {
+        ARRAY_BUFFER,
+        UNIFORM_BUFFER,
+        COPY_READ_BUFFER,
+        COPY_WRITE_BUFFER,
+        PIXEL_PACK_BUFFER,
+        PIXEL_UNPACK_BUFFER,
+        TRANSFORM_FEEDBACK_BUFFER,
+        TEXTURE_BUFFER,
+        BUFFER_TARGET_COUNT
+    };
+
+    struct IndexedBinding
+    {
+        GLuint     buffer;
+        GLintptr   offset;
+        GLsizeiptr size;    // -1: whole buffer
+    };
+
+    struct State
+    {
+        GLuint program;
+        GLuint vertexArray;
+        GLuint buffers[BUFFER_TARGET_COUNT];
+        // the element buffer binding belongs to the vertex array
+        unordered_map<GLuint, GLuint> elementBuffers;
+        IndexedBinding uniformBindings[GL_STATE_MAX_BUFFER_BINDINGS];
+        GLuint activeUnit;      // what GL has
+        GLuint selectedUnit;    // what activeTexture() asked for
+        GLuint textures[GL_STATE_MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+        GLuint drawFramebuffer;
+        GLuint readFramebuffer;
+        unordered_map<GLenum, int> capabilities;    // 0 / 1, missing: unknown
+        GLenum depthFunc;
+        int    depthMask;
+        GLenum blendSource, blendDestination;
+        GLenum cullFace;
+        GLint  viewport[4];
+        bool   viewportKnown;
+        GLfloat clearColor[4];
+        bool   clearColorKnown;
+
+        GLStateStats stats;
+        unsigned int frames;
+
+        State();
+        void forget();
+    };
+
+    State& state()
+    {
+        static State instance;
+        return instance;
+    }
+
+    // true if the call has to reach GL, counts it either way
+    bool changed(GLStateKind kind, bool different)
+    {
+        GLStateStats& stats = state().stats;
+        if (different)
+            stats.issued[(int)kind]++;
+        else
+            stats.filtered[(int)kind]++;
+        return different;
+    }
+
+    int textureTargetIndex(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D:             return TEXTURE_2D;
+        case GL_TEXTURE_CUBE_MAP:       return TEXTURE_CUBE_MAP;
+        case GL_TEXTURE_2D_ARRAY:       return TEXTURE_2D_ARRAY;
+        case GL_TEXTURE_3D:             return TEXTURE_3D;
+        case GL_TEXTURE_2D_MULTISAMPLE: return TEXTURE_2D_MULTISAMPLE;
+        default:                        return -1;
+        }
+    }
+
+    int bufferTargetIndex(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER:              return ARRAY_BUFFER;
+        case GL_UNIFORM_BUFFER:            return UNIFORM_BUFFER;
+        case GL_COPY_READ_BUFFER:          return COPY_READ_BUFFER;
+        case GL_COPY_WRITE_BUFFER:         return COPY_WRITE_BUFFER;
+        case GL_PIXEL_PACK_BUFFER:         return PIXEL_PACK_BUFFER;
+        case GL_PIXEL_UNPACK_BUFFER:       return PIXEL_UNPACK_BUFFER;
+        case GL_TRANSFORM_FEEDBACK_BUFFER: return TRANSFORM_FEEDBACK_BUFFER;
+        case GL_TEXTURE_BUFFER:            return TEXTURE_BUFFER;
+        default:                           return -1;
+        }
+    }
+
+    void setCapability(GLenum capability, int enabled)
+    {
+        auto found = state().capabilities.find(capability);
+        if (!changed(GLStateKind::Fixed, found == state().capabilities.end() || found->second != enabled))
+            return;
+        state().capabilities[capability] = enabled;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    // activate: leave GL's active unit on unit even when the bind itself is cached, for the
+    // glTex*/glGet* calls that follow a bindTexture()
+    void bindTextureOn(GLuint unit, GLenum target, GLuint texture, bool activate)
+    {
+        State& s = state();
+        int index = textureTargetIndex(target);
+        if (index < 0 || unit >= GL_STATE_MAX_TEXTURE_UNITS)
+        {
+            // untracked target or unit: switch the unit and bind
+            changed(GLStateKind::Texture, true);
+            glActiveTexture(GL_TEXTURE0 + unit);
+            s.activeUnit = unit;
+            glBindTexture(target, texture);
+            return;
+        }
+        if (!changed(GLStateKind::Texture, s.textures[unit][index] != texture))
+        {
+            if (activate && s.activeUnit != unit)
+            {
+                changed(GLStateKind::Texture, true);
+                glActiveTexture(GL_TEXTURE0 + unit);
+                s.activeUnit = unit;
+            }
+            return;
+        }
+        if (s.activeUnit != unit)
+        {
+            changed(GLStateKind::Texture, true);
+            glActiveTexture(GL_TEXTURE0 + unit);
+            s.activeUnit = unit;
+        }
+        glBindTexture(target, texture);
+        s.textures[unit][index] = texture;
+    }
+}
+
+
+State::State()
+{
+    memset(&stats, 0, sizeof(stats));
+    frames = 0;
+    selectedUnit = 0;
+    forget();
+}
+
+
+void State::forget()
+{
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    for (GLuint& bound : buffers)
+        bound = UNKNOWN;
+    elementBuffers.clear();
+    for (IndexedBinding& binding : uniformBindings)
+    {
+        binding.buffer = UNKNOWN;
+        binding.offset = 0;
+        binding.size = 0;
+    }
+    activeUnit = UNKNOWN;
+    for (auto& unit : textures)
+        for (GLuint& bound : unit)
+            bound = UNKNOWN;
+    drawFramebuffer = readFramebuffer = UNKNOWN;
+    capabilities.clear();
+    depthFunc = UNKNOWN;
+    depthMask = -1;
+    blendSource = blendDestination = UNKNOWN;
+    cullFace = UNKNOWN;
+    viewportKnown = false;
+    clearColorKnown = false;
+}
+
+
+void GLState::useProgram(GLuint program)
+{
+    State& s = state();
+    if (!changed(GLStateKind::Program, s.program != program))
+        return;
+    glUseProgram(program);
+    s.program = program;
+}
+
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+    State& s = state();
+    if (!changed(GLStateKind::VertexArray, s.vertexArray != vertexArray))
+        return;
+    glBindVertexArray(vertexArray);
+    s.vertexArray = vertexArray;
+}
+
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+    State& s = state();
+    if (target == GL_ELEMENT_ARRAY_BUFFER)
+    {
+        // unknown vertex array: the binding can't be known either
+        bool known = s.vertexArray != UNKNOWN;
+        auto found = s.elementBuffers.find(s.vertexArray);
+        bool different = !known || found == s.elementBuffers.end() || found->second != buffer;
+        if (!changed(GLStateKind::Buffer, different))
+            return;
+        glBindBuffer(target, buffer);
+        if (known)
+            s.elementBuffers[s.vertexArray] = buffer;
+        return;
+    }
+
+    int index = bufferTargetIndex(target);
+    if (!changed(GLStateKind::Buffer, index < 0 || s.buffers[index] != buffer))
+        return;
+    glBindBuffer(target, buffer);
+    if (index >= 0)
+        s.buffers[index] = buffer;
+}
+
+
+void GLState::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+    State& s = state();
+    // also binds the generic target
+    int generic = bufferTargetIndex(target);
+    if (generic >= 0)
+        s.buffers[generic] = buffer;
+    if (target != GL_UNIFORM_BUFFER || index >= GL_STATE_MAX_BUFFER_BINDINGS)
+    {
+        changed(GLStateKind::Buffer, true);
+        glBindBufferBase(target, index, buffer);
+        return;
+    }
+    IndexedBinding& binding = s.uniformBindings[index];
+    if (!changed(GLStateKind::Buffer, binding.buffer != buffer || binding.size != -1))
+        return;
+    glBindBufferBase(target, index, buffer);
+    binding.buffer = buffer;
+    binding.offset = 0;
+    binding.size = -1;
+}
+
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    State& s = state();
+    int generic = bufferTargetIndex(target);
+    if (generic >= 0)
+        s.buffers[generic] = buffer;
+    if (target != GL_UNIFORM_BUFFER || index >= GL_STATE_MAX_BUFFER_BINDINGS)
+    {
+        changed(GLStateKind::Buffer, true);
+        glBindBufferRange(target, index, buffer, offset, size);
+        return;
+    }
+    IndexedBinding& binding = s.uniformBindings[index];
+    if (!changed(GLStateKind::Buffer, binding.buffer != buffer || binding.offset != offset || binding.size != size))
+        return;
+    glBindBufferRange(target, index, buffer, offset, size);
+    binding.buffer = buffer;
+    binding.offset = offset;
+    binding.size = size;
+}
+
+
+void GLState::activeTexture(GLenum unit)
+{
+    // recorded only, the next bindTexture switches the unit if it has to
+    state().selectedUnit = unit - GL_TEXTURE0;
+}
+
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+    bindTextureOn(state().selectedUnit, target, texture, true);
+}
+
+
+void GLState::bindTextureUnit(GLuint unit, GLenum target, GLuint texture)
+{
+    bindTextureOn(unit, target, texture, false);
+}
+
+
+void GLState::bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    State& s = state();
+    bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    bool different = (draw && s.drawFramebuffer != framebuffer) || (read && s.readFramebuffer != framebuffer);
+    if (!changed(GLStateKind::Framebuffer, different))
+        return;
+    glBindFramebuffer(target, framebuffer);
+    if (draw)
+        s.drawFramebuffer = framebuffer;
+    if (read)
+        s.readFramebuffer = framebuffer;
+}
+
+
+void GLState::enable(GLenum capability)
+{
+    setCapability(capability, 1);
+}
+
+
+void GLState::disable(GLenum capability)
+{
+    setCapability(capability, 0);
+}
+
+
+void GLState::depthFunc(GLenum func)
+{
+    State& s = state();
+    if (!changed(GLStateKind::Fixed, s.depthFunc != func))
+        return;
+    glDepthFunc(func);
+    s.depthFunc = func;
+}
+
+
+void GLState::depthMask(GLboolean flag)
+{
+    State& s = state();
+    if (!changed(GLStateKind::Fixed, s.depthMask != (int)flag))
+        return;
+    glDepthMask(flag);
+    s.depthMask = flag;
+}
+
+
+void GLState::blendFunc(GLenum source, GLenum destination)
+{
+    State& s = state();
+    if (!changed(GLStateKind::Fixed, s.blendSource != source || s.blendDestination != destination))
+        return;
+    glBlendFunc(source, destination);
+    s.blendSource = source;
+    s.blendDestination = destination;
+}
+
+
+void GLState::cullFace(GLenum mode)
+{
+    State& s = state();
+    if (!changed(GLStateKind::Fixed, s.cullFace != mode))
+        return;
+    glCullFace(mode);
+    s.cullFace = mode;
+}
+
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    State& s = state();
+    GLint requested[4] = { x, y, width, height };
+    if (!changed(GLStateKind::Fixed, !s.viewportKnown || memcmp(s.viewport, requested, sizeof(requested)) != 0))
+        return;
+    glViewport(x, y, width, height);
+    memcpy(s.viewport, requested, sizeof(requested));
+    s.viewportKnown = true;
+}
+
+
+void GLState::clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+    State& s = state();
+    GLfloat requested[4] = { red, green, blue, alpha };
+    if (!changed(GLStateKind::Fixed, !s.clearColorKnown || memcmp(s.clearColor, requested, sizeof(requested)) != 0))
+        return;
+    glClearColor(red, green, blue, alpha);
+    memcpy(s.clearColor, requested, sizeof(requested));
+    s.clearColorKnown = true;
+}
+
+
+void GLState::deleteProgram(GLuint program)
+{
+    State& s = state();
+    if (s.program == program)
+        s.program = UNKNOWN;
+    glDeleteProgram(program);
+}
+
+
+void GLState::deleteVertexArrays(GLsizei count, const GLuint* vertexArrays)
+{
+    State& s = state();
+    for (GLsizei i = 0; i < count; i++)
+    {
+        // deleting the bound vertex array binds 0
+        if (s.vertexArray == vertexArrays[i])
+            s.vertexArray = 0;
+        s.elementBuffers.erase(vertexArrays[i]);
+    }
+    glDeleteVertexArrays(count, vertexArrays);
+}
+
+
+void GLState::deleteBuffers(GLsizei count, const GLuint* buffers)
+{
+    State& s = state();
+    for (GLsizei i = 0; i < count; i++)
+    {
+        for (GLuint& bound : s.buffers)
+            if (bound == buffers[i])
+                bound = 0;
+        for (auto& element : s.elementBuffers)
+            if (element.second == buffers[i])
+                element.second = 0;
+        for (IndexedBinding& binding : s.uniformBindings)
+            if (binding.buffer == buffers[i])
+                binding.buffer = 0;
+    }
+    glDeleteBuffers(count, buffers);
+}
+
+
+void GLState::deleteTextures(GLsizei count, const GLuint* textures)
+{
+    State& s = state();
+    for (GLsizei i = 0; i < count; i++)
+        for (auto& unit : s.textures)
+            for (GLuint& bound : unit)
+                if (bound == textures[i])
+                    bound = 0;
+    glDeleteTextures(count, textures);
+}
+
+
+void GLState::deleteFramebuffers(GLsizei count, const GLuint* framebuffers)
+{
+    State& s = state();
+    for (GLsizei i = 0; i < count; i++)
+    {
+        if (s.drawFramebuffer == framebuffers[i])
+            s.drawFramebuffer = 0;
+        if (s.readFramebuffer == framebuffers[i])
+            s.readFramebuffer = 0;
+    }
+    glDeleteFramebuffers(count, framebuffers);
+}
+
+
+void GLState::invalidate()
+{
+    state().forget();
+}
+
+
+GLStateStats GLState::getStats()
+{
+    return state().stats;
+}
+
+
+void GLState::resetStats()
+{
+    memset(&state().stats, 0, sizeof(GLStateStats));
+}
+
+
+void GLState::printStats()
+{
+    static const char* names[] = { "program", "vertex array", "buffer", "texture", "framebuffer", "fixed function" };
+    GLStateStats stats = state().stats;
+    cout << "GL_STATE::";
+    for (int i = 0; i < (int)GLStateKind::Count; i++)
+        cout << " " << names[i] << " " << stats.issued[i] << "/" << stats.issued[i] + stats.filtered[i];
+    cout << " (issued/requested)" << endl;
+}
+
+
+void GLState::endFrame()
+{
+#if GL_STATE_REPORT_FRAMES
+    State& s = state();
+    if (++s.frames < GL_STATE_REPORT_FRAMES)
+        return;
+    s.frames = 0;
+    cout << "GL_STATE:: last " << GL_STATE_REPORT_FRAMES << " frames" << endl;
+    printStats();
+    resetStats();
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+#include <glad/glad.h>
+using namespace std;
+
+// texture units the cache tracks, binds on higher units go straight to GL
+#define GL_STATE_MAX_TEXTURE_UNITS 32
+// uniform buffer binding points the cache tracks
+#define GL_STATE_MAX_BUFFER_BINDINGS 16
+// print and reset the counters every this many frames (0: never)
+#define GL_STATE_REPORT_FRAMES 600
+
+
+enum class GLStateKind
+{
+    Program,
+    VertexArray,
+    Buffer,
+    Texture,        // binds and active unit switches
+    Framebuffer,
+    Fixed,          // enable/disable, depth, blend, cull, viewport, clear color
+    Count
+};
+
+struct GLStateStats
+{
+    unsigned int issued[(int)GLStateKind::Count];     // calls that reached GL
+    unsigned int filtered[(int)GLStateKind::Count];   // redundant calls dropped
+};
+
+
+/*
+* Cache of the GL state the renderer changes, for the thread owning the context.
+*
+* The functions mirror their gl* counterparts and only call GL when the value
+* differs from the cached one. Everything starts out unknown, so the first
+* call always goes through. Bind points the cache covers must only be changed
+* through it; after foreign code touched them call invalidate().
+*
+* The texture unit is tracked lazily: activeTexture() only records the unit
+* bindTexture() will target, glActiveTexture is issued when a bind actually
+* has to happen on a different unit. bindTexture() always leaves the selected
+* unit active, cached or not, so glTex*, glGet* and glGenerateMipmap calls
+* after it act on the texture it bound. bindTextureUnit() binds on a unit
+* without changing the one activeTexture() selected and is only for sampling:
+* on a cache hit GL's active unit stays wherever it was.
+*
+* Deleting a bound object resets its bindings in GL, so objects the cache may
+* have seen bound are deleted through the delete* functions.
+*/
+class GLState
+{
+public:
+    static void useProgram(GLuint program);
+    static void bindVertexArray(GLuint vertexArray);
+    static void bindBuffer(GLenum target, GLuint buffer);
+    static void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    static void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    static void activeTexture(GLenum unit);
+    static void bindTexture(GLenum target, GLuint texture);
+    static void bindTextureUnit(GLuint unit, GLenum target, GLuint texture);
+    static void bindFramebuffer(GLenum target, GLuint framebuffer);
+
+    static void enable(GLenum capability);
+    static void disable(GLenum capability);
+    static void depthFunc(GLenum func);
+    static void depthMask(GLboolean flag);
+    static void blendFunc(GLenum source, GLenum destination);
+    static void cullFace(GLenum mode);
+    static void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    static void clearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+
+    static void deleteProgram(GLuint program);
+    static void deleteVertexArrays(GLsizei count, const GLuint* vertexArrays);
+    static void deleteBuffers(GLsizei count, const GLuint* buffers);
+    static void deleteTextures(GLsizei count, const GLuint* textures);
+    static void deleteFramebuffers(GLsizei count, const GLuint* framebuffers);
+
+    // forget everything, the next call of each kind reaches GL
+    static void invalidate();
+
+    static GLStateStats getStats();
+    static void resetStats();
+    static void printStats();
+
+    // once per frame, prints and resets the counters every GL_STATE_REPORT_FRAMES frames
+    static void endFrame();
+};
\ No newline at end of file
@@ -1,11 +1,19 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 projection;
-uniform mat4 view;
 uniform mat4 model;
 
+// per-frame constants, mirrors FrameBlock in uniform_blocks.h
+layout (std140) uniform FrameBlock
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 viewport;          // width, height, near plane, far plane
+};
+
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = viewProjection * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
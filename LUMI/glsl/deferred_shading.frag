@@ -10,14 +10,28 @@ uniform sampler2D gAlbedoSpec;
 
 struct Light {
     vec3 Position;
-    vec3 Color;
     float Linear;
+    vec3 Color;
     float Quadratic;
 };
 
-const int NR_LIGHTS = 25;
-uniform Light lights[NR_LIGHTS];
-uniform vec3 viewPos;
+// mirrors LightBlock in uniform_blocks.h
+const int MAX_LIGHTS = 32;
+layout (std140) uniform LightBlock
+{
+    int lightCount;
+    Light lights[MAX_LIGHTS];
+};
+
+// per-frame constants, mirrors FrameBlock in uniform_blocks.h
+layout (std140) uniform FrameBlock
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 viewport;          // width, height, near plane, far plane
+};
 
 void main()
 {             
@@ -29,8 +43,8 @@ void main()
     
     // then calculate lighting as usual
     vec3 lighting  = Diffuse * 0.1; // hard-coded ambient component
-    vec3 viewDir  = normalize(viewPos - FragPos);
-    for(int i = 0; i < NR_LIGHTS; ++i)
+    vec3 viewDir  = normalize(cameraPosition.xyz - FragPos);
+    for(int i = 0; i < lightCount; ++i)
     {
         // diffuse
         vec3 lightDir = normalize(lights[i].Position - FragPos);
@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) out vec3 gPosition;
+layout (location = 1) out vec3 gNormal;
+layout (location = 2) out vec4 gAlbedoSpec;
+
+in vec2 TexCoords;
+in vec3 FragPos;
+in vec3 Normal;
+flat in uvec4 MaterialLayers;
+
+// maps of every material (texture_array.h), bound to their slot's unit
+uniform sampler2DArray texture_diffuse_array;
+uniform sampler2DArray texture_specular_array;
+
+void main()
+{    
+    // store the fragment position vector in the first gbuffer texture
+    gPosition = FragPos;
+    // also store the per-fragment normals into the gbuffer
+    gNormal = normalize(Normal);
+    // and the diffuse per-fragment color
+    gAlbedoSpec.rgb = texture(texture_diffuse_array, vec3(TexCoords, float(MaterialLayers.x))).rgb;
+    // store specular intensity in gAlbedoSpec's alpha component
+    gAlbedoSpec.a = texture(texture_specular_array, vec3(TexCoords, float(MaterialLayers.y))).r;
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// material layers of the mesh, TEXTURE_ARRAY_LAYER_ATTRIBUTE in texture_array.h
+layout (location = 7) in uvec4 aMaterialLayers;
+
+out vec3 FragPos;
+out vec2 TexCoords;
+out vec3 Normal;
+flat out uvec4 MaterialLayers;
+
+uniform mat4 model;
+
+// per-frame constants, mirrors FrameBlock in uniform_blocks.h
+layout (std140) uniform FrameBlock
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 viewport;          // width, height, near plane, far plane
+};
+
+void main()
+{
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    FragPos = worldPos.xyz; 
+    TexCoords = aTexCoords;
+    MaterialLayers = aMaterialLayers;
+    
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+    Normal = normalMatrix * aNormal;
+
+    gl_Position = viewProjection * worldPos;
+}
\ No newline at end of file
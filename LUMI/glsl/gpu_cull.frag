@@ -0,0 +1,6 @@
+#version 330 core
+
+// never runs, the cull pass discards its points before rasterization
+void main()
+{
+}
\ No newline at end of file
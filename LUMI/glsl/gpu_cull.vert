@@ -0,0 +1,73 @@
+#version 330 core
+layout (location = 0) in mat4 aInstanceMatrix;
+
+// one point per instance: its box against the frustum and, with useHiz, the pyramid.
+// Same pyramid test as hiz_test.vert
+out mat4 cullMatrix;
+flat out int cullVisible;
+
+uniform mat4 viewProjection;
+uniform vec3 boundsMin;
+uniform vec3 boundsMax;
+uniform bool useHiz;
+uniform sampler2D hiz;
+uniform vec2 hizSize;
+uniform int hizLevels;
+
+bool isVisible()
+{
+    mat4 modelViewProjection = viewProjection * aInstanceMatrix;
+    // corners outside each clip plane, all 8 outside one of them culls the box
+    ivec3 below = ivec3(0);
+    ivec3 above = ivec3(0);
+    bool crossesNear = false;
+    vec2 ndcMin = vec2(1e30);
+    vec2 ndcMax = vec2(-1e30);
+    float nearest = 1e30;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        vec3 point = vec3((corner & 1) != 0 ? boundsMax.x : boundsMin.x, (corner & 2) != 0 ? boundsMax.y : boundsMin.y,
+            (corner & 4) != 0 ? boundsMax.z : boundsMin.z);
+        vec4 clip = modelViewProjection * vec4(point, 1.0);
+        below += ivec3(lessThan(clip.xyz, vec3(-clip.w)));
+        above += ivec3(greaterThan(clip.xyz, vec3(clip.w)));
+        if (clip.w <= 0.0 || clip.z < -clip.w)
+        {
+            crossesNear = true;
+            continue;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc.xy);
+        ndcMax = max(ndcMax, ndc.xy);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+    if (any(equal(below, ivec3(8))) || any(equal(above, ivec3(8))))
+        return false;
+    // reaching in front of the near plane counts as visible
+    if (!useHiz || crossesNear)
+        return true;
+
+    ivec2 size = ivec2(hizSize);
+    ivec2 texelMin = min(ivec2(clamp(ndcMin * 0.5 + 0.5, 0.0, 1.0) * hizSize), size - 1);
+    ivec2 texelMax = min(ivec2(clamp(ndcMax * 0.5 + 0.5, 0.0, 1.0) * hizSize), size - 1);
+
+    // the level where the rectangle covers at most 2x2 texels
+    int level = 0;
+    while (level < hizLevels - 1 && (((texelMax.x >> level) - (texelMin.x >> level)) > 1 ||
+        ((texelMax.y >> level) - (texelMin.y >> level)) > 1))
+        level++;
+    ivec2 levelSize = textureSize(hiz, level);
+    ivec2 first = min(texelMin >> level, levelSize - 1);
+    ivec2 last = min(texelMax >> level, levelSize - 1);
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(hiz, ivec2(x, y), level).r);
+    return nearest <= farthest;
+}
+
+void main()
+{
+    cullMatrix = aInstanceMatrix;
+    cullVisible = isVisible() ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+
+// only counted by the query
+void main()
+{
+    FragColor = vec4(1.0);
+}
\ No newline at end of file
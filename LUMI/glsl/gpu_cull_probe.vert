@@ -0,0 +1,11 @@
+#version 330 core
+layout (location = 0) in int aInstanceStamp;
+
+// one point per chunk of the compacted list, from its first instance: inside the 1x1
+// viewport when the last cull wrote that instance, that is when the chunk is not empty
+uniform int stamp;
+
+void main()
+{
+    gl_Position = aInstanceStamp == stamp ? vec4(0.0, 0.0, 0.0, 1.0) : vec4(2.0, 2.0, 2.0, 1.0);
+}
\ No newline at end of file
@@ -1,15 +1,24 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in mat4 aInstanceMatrix;
+layout (location = 8) in mat4 aInstanceMatrix;
+layout (location = 12) in int aInstanceStamp;
 
 out vec2 TexCoords;
 
 uniform mat4 projection;
 uniform mat4 view;
+// 0: every instance, otherwise only those the GPU cull with this stamp wrote
+uniform int instanceStamp;
 
 void main()
 {
     TexCoords = aTexCoords;
+    if (instanceStamp != 0 && aInstanceStamp != instanceStamp)
+    {
+        // left over from an earlier cull, outside the clip volume
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
     gl_Position = projection * view * aInstanceMatrix * vec4(aPos, 1.0f); 
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+#version 330 core
+out float FragDepth;
+
+// the depth buffer for level 0, otherwise the pyramid with only the previous level visible
+uniform sampler2D source;
+uniform bool copyDepth;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    if (copyDepth)
+    {
+        FragDepth = texelFetch(source, texel, 0).r;
+        return;
+    }
+
+    // farthest depth of the 2x2 block, the last row and column also take an odd remainder
+    ivec2 sourceSize = textureSize(source, 0);
+    ivec2 targetSize = max(sourceSize / 2, ivec2(1));
+    ivec2 first = texel * 2;
+    ivec2 last = min(first + 1, sourceSize - 1);
+    if (texel.x == targetSize.x - 1)
+        last.x = sourceSize.x - 1;
+    if (texel.y == targetSize.y - 1)
+        last.y = sourceSize.y - 1;
+
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(source, ivec2(x, y), 0).r);
+    FragDepth = farthest;
+}
\ No newline at end of file
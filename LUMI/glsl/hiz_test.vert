@@ -0,0 +1,52 @@
+#version 330 core
+layout (location = 0) in vec3 aabbMin;
+layout (location = 1) in vec3 aabbMax;
+
+// one point per box: inside the 1x1 viewport when the box may be visible, clipped when the
+// pyramid hides it. Same test as HiZBuffer::isVisiblePrevious
+uniform mat4 modelViewProjection;
+uniform sampler2D hiz;
+uniform vec2 hizSize;
+uniform int hizLevels;
+
+bool isVisible()
+{
+    vec2 ndcMin = vec2(1e30);
+    vec2 ndcMax = vec2(-1e30);
+    float nearest = 1e30;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        vec3 point = vec3((corner & 1) != 0 ? aabbMax.x : aabbMin.x, (corner & 2) != 0 ? aabbMax.y : aabbMin.y,
+            (corner & 4) != 0 ? aabbMax.z : aabbMin.z);
+        vec4 clip = modelViewProjection * vec4(point, 1.0);
+        // reaches in front of the near plane
+        if (clip.w <= 0.0 || clip.z < -clip.w)
+            return true;
+        vec3 ndc = clip.xyz / clip.w;
+        ndcMin = min(ndcMin, ndc.xy);
+        ndcMax = max(ndcMax, ndc.xy);
+        nearest = min(nearest, ndc.z * 0.5 + 0.5);
+    }
+    ivec2 size = ivec2(hizSize);
+    ivec2 texelMin = min(ivec2(clamp(ndcMin * 0.5 + 0.5, 0.0, 1.0) * hizSize), size - 1);
+    ivec2 texelMax = min(ivec2(clamp(ndcMax * 0.5 + 0.5, 0.0, 1.0) * hizSize), size - 1);
+
+    // the level where the rectangle covers at most 2x2 texels
+    int level = 0;
+    while (level < hizLevels - 1 && (((texelMax.x >> level) - (texelMin.x >> level)) > 1 ||
+        ((texelMax.y >> level) - (texelMin.y >> level)) > 1))
+        level++;
+    ivec2 levelSize = textureSize(hiz, level);
+    ivec2 first = min(texelMin >> level, levelSize - 1);
+    ivec2 last = min(texelMax >> level, levelSize - 1);
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, texelFetch(hiz, ivec2(x, y), level).r);
+    return nearest <= farthest;
+}
+
+void main()
+{
+    gl_Position = isVisible() ? vec4(0.0, 0.0, 0.0, 1.0) : vec4(2.0, 2.0, 2.0, 1.0);
+}
\ No newline at end of file
@@ -6,15 +6,40 @@ in vec3 Normal;
 
 // material parameters
 uniform sampler2D albedoMap;
-uniform float metallic;
-uniform float roughness;
-uniform float ao;
-
-// lights
-uniform vec3 lightPositions[4];
-uniform vec3 lightColors[4];
+// mirrors MaterialBlock in uniform_blocks.h
+layout (std140) uniform MaterialBlock
+{
+    vec4  albedoFactor;
+    float metallic;
+    float roughness;
+    float ao;
+};
+
+// lights, attenuation is inverse square so Linear/Quadratic are unused
+struct Light {
+    vec3 Position;
+    float Linear;
+    vec3 Color;
+    float Quadratic;
+};
+
+// mirrors LightBlock in uniform_blocks.h
+const int MAX_LIGHTS = 32;
+layout (std140) uniform LightBlock
+{
+    int lightCount;
+    Light lights[MAX_LIGHTS];
+};
 
-uniform vec3 camPos;
+// per-frame constants, mirrors FrameBlock in uniform_blocks.h
+layout (std140) uniform FrameBlock
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 viewport;          // width, height, near plane, far plane
+};
 
 const float PI = 3.14159265359;
 // ----------------------------------------------------------------------------
@@ -60,9 +85,9 @@ vec3 fresnelSchlick(float cosTheta, vec3 F0)
 // ----------------------------------------------------------------------------
 void main()
 {		
-    vec3 albedo = pow(texture(albedoMap, TexCoords).rgb, vec3(2.2));
+    vec3 albedo = pow(texture(albedoMap, TexCoords).rgb, vec3(2.2)) * albedoFactor.rgb;
     vec3 N = normalize(Normal);
-    vec3 V = normalize(camPos - WorldPos);
+    vec3 V = normalize(cameraPosition.xyz - WorldPos);
 
     // calculate reflectance at normal incidence; if dia-electric (like plastic) use F0 
     // of 0.04 and if it's a metal, use the albedo color as F0 (metallic workflow)    
@@ -71,14 +96,14 @@ void main()
 
     // reflectance equation
     vec3 Lo = vec3(0.0);
-    for(int i = 0; i < 4; ++i) 
+    for(int i = 0; i < lightCount; ++i) 
     {
         // calculate per-light radiance
-        vec3 L = normalize(lightPositions[i] - WorldPos);
+        vec3 L = normalize(lights[i].Position - WorldPos);
         vec3 H = normalize(V + L);
-        float distance = length(lightPositions[i] - WorldPos);
+        float distance = length(lights[i].Position - WorldPos);
         float attenuation = 1.0 / (distance * distance);
-        vec3 radiance = lightColors[i] * attenuation;
+        vec3 radiance = lights[i].Color * attenuation;
 
         // Cook-Torrance BRDF
         float NDF = DistributionGGX(N, H, roughness);   
@@ -0,0 +1,11 @@
+#version 330 core
+in vec2 TexCoords;
+
+uniform sampler2D texture_diffuse1;
+
+void main()
+{
+    // alpha tested casters: cut-out texels cast no shadow
+    if (texture(texture_diffuse1, TexCoords).a < 0.5)
+        discard;
+}
\ No newline at end of file
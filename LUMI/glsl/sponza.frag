@@ -2,7 +2,6 @@
 
 #define NUM_SAMPLES 50
 #define NUM_RINGS 10
-#define SHADOW_MAP_SIZE 2048.0
 #define FILTER_RADIUS 15.0
 #define FRUSTUM_SIZE 400.0
 #define NEAR_PLANE 0.1
@@ -18,14 +17,34 @@ in VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 TexCoords;
-    vec4 FragPosLightSpace;
 } fs_in;
 
-uniform sampler2D diffuseTexture;
-uniform sampler2D shadowMap;
+// material diffuse map, bound to its fixed unit (material.h)
+uniform sampler2D texture_diffuse1;
+// one layer per cascade
+uniform sampler2DArray shadowCascades;
 
 uniform vec3 lightPos;
-uniform vec3 viewPos;
+
+// cascaded shadow map, mirrors ShadowBlock in uniform_blocks.h
+layout (std140) uniform ShadowBlock
+{
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;         // far end of each cascade, view distance
+    vec4 cascadeTexelSizes;     // world units per shadow texel
+    vec4 shadowParams;          // cascade count, blend fraction, 1 / map size, near end of the first cascade
+    vec4 lightDirection;        // direction the light travels
+};
+
+// per-frame constants, mirrors FrameBlock in uniform_blocks.h
+layout (std140) uniform FrameBlock
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 viewport;          // width, height, near plane, far plane
+};
 
 highp float rand_1to1(highp float x) { 
 	// -1 -1
@@ -77,14 +96,14 @@ void uniformDiskSamples(const in vec2 randomSeed) {
 	}
 }
 
-float findBlocker(vec2 uv, float zReceiver) {
+float findBlocker(int cascade, vec2 uv, float zReceiver) {
 	int blockerNum = 0;
 	float blockerDepth = 0.0;
-	float posZFromLight = fs_in.FragPosLightSpace.z;
+	float posZFromLight = zReceiver;
 	float searchRadius = LIGHT_SIZE_UV * (posZFromLight - NEAR_PLANE) / posZFromLight;
 	poissonDiskSamples(uv);
 	for (int i = 0; i <	NUM_SAMPLES; ++i) {
-		float shadowDepth = texture2D(shadowMap, uv + poissonDisk[i] * searchRadius).r;
+		float shadowDepth = texture(shadowCascades, vec3(uv + poissonDisk[i] * searchRadius, cascade)).r;
 		if (zReceiver > shadowDepth) {
 			++blockerNum;
 			blockerDepth += shadowDepth;
@@ -93,47 +112,52 @@ float findBlocker(vec2 uv, float zReceiver) {
 	return (blockerNum != 0) ? blockerDepth / float(blockerNum) : -1.0;
 }
 
-float getBias(float c, float filterRadiusUV)
+float getBias(int cascade, float c, float filterRadiusUV)
 {
     vec3 normal = normalize(fs_in.Normal);
-    vec3 lightDir = normalize(lightPos - fs_in.FragPos);
-	float fragSize = (1.0 + ceil(filterRadiusUV)) * (FRUSTUM_SIZE / SHADOW_MAP_SIZE / 2.0);
-	return max(fragSize * (1.0 - dot(normal, lightDir)) * c, 0.001);
+    // the cascades are rendered along the directional light, not from lightPos
+    vec3 lightDir = normalize(-lightDirection.xyz);
+	// world units, the cascade's texels grow with its distance
+	float fragSize = (1.0 + ceil(filterRadiusUV)) * (cascadeTexelSizes[cascade] / 2.0);
+	float bias = max(fragSize * (1.0 - dot(normal, lightDir)) * c, fragSize * 0.05);
+	// to the [0, 1] depth of the cascade, its orthographic projection scales depth alike everywhere
+	mat4 cascadeMatrix = cascadeMatrices[cascade];
+	return bias * 0.5 * length(vec3(cascadeMatrix[0][2], cascadeMatrix[1][2], cascadeMatrix[2][2]));
     // return max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
 }
 
-float ShadowCalculation(vec3 shadowCoord, float biasC, float filterRadiusUV)
+float ShadowCalculation(int cascade, vec3 shadowCoord, float biasC, float filterRadiusUV)
 {
     // Ƿ񳬳Զƽ
     if(shadowCoord.z > 1.0) return 1.0;
     // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, shadowCoord.xy).r; 
+    float closestDepth = texture(shadowCascades, vec3(shadowCoord.xy, cascade)).r; 
     // get depth of current fragment from light's perspective
     float currentDepth = shadowCoord.z;
     // ӰAnce
-    float bias = getBias(biasC, filterRadiusUV);
+    float bias = getBias(cascade, biasC, filterRadiusUV);
     // check whether current frag pos is in shadow
-    return (currentDepth  > closestDepth) ? 0.0 : 1.0;
+    return (currentDepth - bias > closestDepth) ? 0.0 : 1.0;
 }
 
 
-float PCF(vec3 shadowCoord, float biasC, float filterRadiusUV)
+float PCF(int cascade, vec3 shadowCoord, float biasC, float filterRadiusUV)
 {
     float shadow = 0.0;
     poissonDiskSamples(shadowCoord.xy);
 	for (int i = 0; i < NUM_SAMPLES; ++i) {
 		vec2 offset = poissonDisk[i] * filterRadiusUV;
 		vec3 coord = shadowCoord + vec3(offset, 0.0);
-		shadow += ShadowCalculation(coord, biasC, filterRadiusUV);
+		shadow += ShadowCalculation(cascade, coord, biasC, filterRadiusUV);
 	}
 	return shadow / float(NUM_SAMPLES);
 }
 
-float PCSS(vec3 shadowCoord, float biasC)
+float PCSS(int cascade, vec3 shadowCoord, float biasC)
 {
 	float zReceiver = shadowCoord.z;
 	// STEP 1: avgblocker depth
-	float avgBlockerDepth = findBlocker(shadowCoord.xy, zReceiver);
+	float avgBlockerDepth = findBlocker(cascade, shadowCoord.xy, zReceiver);
 	
 	if (avgBlockerDepth < -EPS) {
 		return 1.0;
@@ -144,13 +168,49 @@ float PCSS(vec3 shadowCoord, float biasC)
 	float filterRadiusUV = penumbra;
 
 	// STEP 3: filtering
-	return PCF(shadowCoord, biasC, filterRadiusUV);
+	return PCF(cascade, shadowCoord, biasC, filterRadiusUV);
+}
+
+
+float CascadeShadow(int cascade, vec3 fragPos)
+{
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
+    vec3 shadowCoord = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    shadowCoord = shadowCoord * 0.5 + 0.5;
+
+    // ShadowMap
+    return ShadowCalculation(cascade, shadowCoord, 0.2, 0.0);
+
+    // PCF
+	// return PCF(cascade, shadowCoord, 0.2, FILTER_RADIUS * shadowParams.z);
+
+	// PCSS
+	// return PCSS(cascade, shadowCoord, 0.2);
+}
+
+// cascade by view distance, faded into the next one over the far end of its range
+float CascadedShadow(vec3 fragPos)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int count = int(shadowParams.x);
+    // beyond the shadow distance
+    if (depth > cascadeSplits[count - 1])
+        return 1.0;
+    int cascade = 0;
+    while (cascade < count - 1 && depth > cascadeSplits[cascade])
+        cascade++;
+    float shadow = CascadeShadow(cascade, fragPos);
+    float splitNear = cascade == 0 ? shadowParams.w : cascadeSplits[cascade - 1];
+    float fade = (cascadeSplits[cascade] - depth) / ((cascadeSplits[cascade] - splitNear) * shadowParams.y);
+    if (cascade < count - 1 && fade < 1.0)
+        shadow = mix(CascadeShadow(cascade + 1, fragPos), shadow, fade);
+    return shadow;
 }
 
 
 void main()
 {           
-    vec3 color = texture(diffuseTexture, fs_in.TexCoords).rgb;
+    vec3 color = texture(texture_diffuse1, fs_in.TexCoords).rgb;
     vec3 normal = normalize(fs_in.Normal);
     vec3 lightColor = vec3(0.5);
     // ambient
@@ -160,7 +220,7 @@ void main()
     float diff = max(dot(lightDir, normal), 0.0);
     vec3 diffuse = diff * lightColor;
     // specular
-    vec3 viewDir = normalize(viewPos - fs_in.FragPos);
+    vec3 viewDir = normalize(cameraPosition.xyz - fs_in.FragPos);
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = 0.0;
     vec3 halfwayDir = normalize(lightDir + viewDir);  
@@ -168,17 +228,7 @@ void main()
     vec3 specular = spec * lightColor;    
 
     // calculate shadow
-    vec3 shadowCoord = fs_in.FragPosLightSpace.xyz / fs_in.FragPosLightSpace.w;
-    shadowCoord = shadowCoord * 0.5 + 0.5;
-
-    // ShadowMap
-    float shadow = ShadowCalculation(shadowCoord, 0.2, 0.0);              
-    
-    // PCF
-	// float shadow = PCF(shadowCoord, 0.2, FILTER_RADIUS / SHADOW_MAP_SIZE);
-
-	// PCSS
-	// float shadow = PCSS(shadowCoord, 0.2);
+    float shadow = CascadedShadow(fs_in.FragPos);
 
     vec3 lighting = (ambient + shadow * (diffuse + specular)) * color;    
     FragColor = vec4(lighting, 1.0);
@@ -0,0 +1,237 @@
+#version 330 core
+
+#define NUM_SAMPLES 50
+#define NUM_RINGS 10
+#define FILTER_RADIUS 15.0
+#define FRUSTUM_SIZE 400.0
+#define NEAR_PLANE 0.1
+#define LIGHT_WORLD_SIZE 5.0
+#define LIGHT_SIZE_UV (LIGHT_WORLD_SIZE / FRUSTUM_SIZE)
+#define EPS 0.001
+#define PI 3.141592653589793
+#define PI2 6.283185307179586
+
+out vec4 FragColor;
+
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+} fs_in;
+
+flat in uint diffuseLayer;
+
+// diffuse maps of every material (texture_array.h), bound to the diffuse slot's unit
+uniform sampler2DArray texture_diffuse_array;
+// one layer per cascade
+uniform sampler2DArray shadowCascades;
+
+uniform vec3 lightPos;
+
+// cascaded shadow map, mirrors ShadowBlock in uniform_blocks.h
+layout (std140) uniform ShadowBlock
+{
+    mat4 cascadeMatrices[4];
+    vec4 cascadeSplits;         // far end of each cascade, view distance
+    vec4 cascadeTexelSizes;     // world units per shadow texel
+    vec4 shadowParams;          // cascade count, blend fraction, 1 / map size, near end of the first cascade
+    vec4 lightDirection;        // direction the light travels
+};
+
+// per-frame constants, mirrors FrameBlock in uniform_blocks.h
+layout (std140) uniform FrameBlock
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 viewport;          // width, height, near plane, far plane
+};
+
+highp float rand_1to1(highp float x) { 
+	// -1 -1
+	return fract(sin(x)*10000.0);
+}
+
+highp float rand_2to1(vec2 uv) { 
+  	// 0 - 1
+	const highp float a = 12.9898, b = 78.233, c = 43758.5453;
+	highp float dt = dot(uv.xy, vec2(a,b)), sn = mod(dt, PI);
+	return fract(sin(sn) * c);
+}
+
+vec2 poissonDisk[NUM_SAMPLES];
+
+void poissonDiskSamples(const in vec2 randomSeed) {
+
+	float ANGLE_STEP = PI2 * float(NUM_RINGS) / float(NUM_SAMPLES);
+	float INV_NUM_SAMPLES = 1.0 / float( NUM_SAMPLES );
+
+	float angle = rand_2to1(randomSeed) * PI2;
+	float radius = INV_NUM_SAMPLES;
+	float radiusStep = radius;
+
+	for(int i = 0; i < NUM_SAMPLES; i++) {
+		poissonDisk[i] = vec2(cos(angle), sin(angle)) * pow(radius, 0.75);
+		radius += radiusStep;
+		angle += ANGLE_STEP;
+	}
+}
+
+void uniformDiskSamples(const in vec2 randomSeed) {
+
+	float randNum = rand_2to1(randomSeed);
+	float sampleX = rand_1to1(randNum) ;
+	float sampleY = rand_1to1(sampleX) ;
+
+	float angle = sampleX * PI2;
+	float radius = sqrt(sampleY);
+
+	for( int i = 0; i < NUM_SAMPLES; i ++ ) {
+		poissonDisk[i] = vec2(radius * cos(angle) , radius * sin(angle));
+
+		sampleX = rand_1to1(sampleY) ;
+		sampleY = rand_1to1(sampleX) ;
+
+		angle = sampleX * PI2;
+		radius = sqrt(sampleY);
+	}
+}
+
+float findBlocker(int cascade, vec2 uv, float zReceiver) {
+	int blockerNum = 0;
+	float blockerDepth = 0.0;
+	float posZFromLight = zReceiver;
+	float searchRadius = LIGHT_SIZE_UV * (posZFromLight - NEAR_PLANE) / posZFromLight;
+	poissonDiskSamples(uv);
+	for (int i = 0; i <	NUM_SAMPLES; ++i) {
+		float shadowDepth = texture(shadowCascades, vec3(uv + poissonDisk[i] * searchRadius, cascade)).r;
+		if (zReceiver > shadowDepth) {
+			++blockerNum;
+			blockerDepth += shadowDepth;
+		}
+	}
+	return (blockerNum != 0) ? blockerDepth / float(blockerNum) : -1.0;
+}
+
+float getBias(int cascade, float c, float filterRadiusUV)
+{
+    vec3 normal = normalize(fs_in.Normal);
+    // the cascades are rendered along the directional light, not from lightPos
+    vec3 lightDir = normalize(-lightDirection.xyz);
+	// world units, the cascade's texels grow with its distance
+	float fragSize = (1.0 + ceil(filterRadiusUV)) * (cascadeTexelSizes[cascade] / 2.0);
+	float bias = max(fragSize * (1.0 - dot(normal, lightDir)) * c, fragSize * 0.05);
+	// to the [0, 1] depth of the cascade, its orthographic projection scales depth alike everywhere
+	mat4 cascadeMatrix = cascadeMatrices[cascade];
+	return bias * 0.5 * length(vec3(cascadeMatrix[0][2], cascadeMatrix[1][2], cascadeMatrix[2][2]));
+    // return max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
+}
+
+float ShadowCalculation(int cascade, vec3 shadowCoord, float biasC, float filterRadiusUV)
+{
+    // Ƿ񳬳Զƽ
+    if(shadowCoord.z > 1.0) return 1.0;
+    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
+    float closestDepth = texture(shadowCascades, vec3(shadowCoord.xy, cascade)).r; 
+    // get depth of current fragment from light's perspective
+    float currentDepth = shadowCoord.z;
+    // ӰAnce
+    float bias = getBias(cascade, biasC, filterRadiusUV);
+    // check whether current frag pos is in shadow
+    return (currentDepth - bias > closestDepth) ? 0.0 : 1.0;
+}
+
+
+float PCF(int cascade, vec3 shadowCoord, float biasC, float filterRadiusUV)
+{
+    float shadow = 0.0;
+    poissonDiskSamples(shadowCoord.xy);
+	for (int i = 0; i < NUM_SAMPLES; ++i) {
+		vec2 offset = poissonDisk[i] * filterRadiusUV;
+		vec3 coord = shadowCoord + vec3(offset, 0.0);
+		shadow += ShadowCalculation(cascade, coord, biasC, filterRadiusUV);
+	}
+	return shadow / float(NUM_SAMPLES);
+}
+
+float PCSS(int cascade, vec3 shadowCoord, float biasC)
+{
+	float zReceiver = shadowCoord.z;
+	// STEP 1: avgblocker depth
+	float avgBlockerDepth = findBlocker(cascade, shadowCoord.xy, zReceiver);
+	
+	if (avgBlockerDepth < -EPS) {
+		return 1.0;
+	}
+	
+	// STEP 2: penumbra size
+	float penumbra = LIGHT_SIZE_UV * (zReceiver - avgBlockerDepth) / avgBlockerDepth;
+	float filterRadiusUV = penumbra;
+
+	// STEP 3: filtering
+	return PCF(cascade, shadowCoord, biasC, filterRadiusUV);
+}
+
+
+float CascadeShadow(int cascade, vec3 fragPos)
+{
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * vec4(fragPos, 1.0);
+    vec3 shadowCoord = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    shadowCoord = shadowCoord * 0.5 + 0.5;
+
+    // ShadowMap
+    return ShadowCalculation(cascade, shadowCoord, 0.2, 0.0);
+
+    // PCF
+	// return PCF(cascade, shadowCoord, 0.2, FILTER_RADIUS * shadowParams.z);
+
+	// PCSS
+	// return PCSS(cascade, shadowCoord, 0.2);
+}
+
+// cascade by view distance, faded into the next one over the far end of its range
+float CascadedShadow(vec3 fragPos)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    int count = int(shadowParams.x);
+    // beyond the shadow distance
+    if (depth > cascadeSplits[count - 1])
+        return 1.0;
+    int cascade = 0;
+    while (cascade < count - 1 && depth > cascadeSplits[cascade])
+        cascade++;
+    float shadow = CascadeShadow(cascade, fragPos);
+    float splitNear = cascade == 0 ? shadowParams.w : cascadeSplits[cascade - 1];
+    float fade = (cascadeSplits[cascade] - depth) / ((cascadeSplits[cascade] - splitNear) * shadowParams.y);
+    if (cascade < count - 1 && fade < 1.0)
+        shadow = mix(CascadeShadow(cascade + 1, fragPos), shadow, fade);
+    return shadow;
+}
+
+
+void main()
+{           
+    vec3 color = texture(texture_diffuse_array, vec3(fs_in.TexCoords, float(diffuseLayer))).rgb;
+    vec3 normal = normalize(fs_in.Normal);
+    vec3 lightColor = vec3(0.5);
+    // ambient
+    vec3 ambient = 0.3 * lightColor;
+    // diffuse
+    vec3 lightDir = normalize(lightPos - fs_in.FragPos);
+    float diff = max(dot(lightDir, normal), 0.0);
+    vec3 diffuse = diff * lightColor;
+    // specular
+    vec3 viewDir = normalize(cameraPosition.xyz - fs_in.FragPos);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = 0.0;
+    vec3 halfwayDir = normalize(lightDir + viewDir);  
+    spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
+    vec3 specular = spec * lightColor;    
+
+    // calculate shadow
+    float shadow = CascadedShadow(fs_in.FragPos);
+
+    vec3 lighting = (ambient + shadow * (diffuse + specular)) * color;    
+    FragColor = vec4(lighting, 1.0);
+}
\ No newline at end of file
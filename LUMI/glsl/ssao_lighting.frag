@@ -10,12 +10,28 @@ uniform sampler2D ssao;
 
 struct Light {
     vec3 Position;
-    vec3 Color;
     float Linear;
+    vec3 Color;
     float Quadratic;
 };
-uniform Light light;
-uniform vec3 viewPos;
+
+// mirrors LightBlock in uniform_blocks.h
+const int MAX_LIGHTS = 32;
+layout (std140) uniform LightBlock
+{
+    int lightCount;
+    Light lights[MAX_LIGHTS];
+};
+
+// per-frame constants, mirrors FrameBlock in uniform_blocks.h
+layout (std140) uniform FrameBlock
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 cameraPosition;
+    vec4 viewport;          // width, height, near plane, far plane
+};
 uniform bool openSSAO;
 
 void main()
@@ -30,7 +46,9 @@ void main()
     // then calculate lighting as usual
     vec3 ambient = vec3(0.3 * Diffuse * AmbientOcclusion);
     vec3 lighting  = ambient; 
-    vec3 viewDir  = normalize(viewPos - FragPos);
+    vec3 viewDir  = normalize(cameraPosition.xyz - FragPos);
+    // the first light of the list
+    Light light = lights[0];
     // diffuse
     vec3 lightDir = normalize(light.Position - FragPos);
     vec3 diffuse = max(dot(Normal, lightDir), 0.0) * Diffuse * light.Color;
@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// one texture of a material, resized into its array layer
+uniform sampler2D source;
+
+void main()
+{
+    FragColor = texture(source, TexCoords);
+}
\ No newline at end of file
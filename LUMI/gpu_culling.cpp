@@ -0,0 +1,227 @@
+#include <cstddef>
+#include <iostream>
+
+#include "gpu_culling.h"
+#include "gl_state.h"
+
+// transform feedback packs the captured outputs without padding
+static_assert(sizeof(CulledInstance) == 17 * sizeof(float), "CulledInstance must match the captured outputs");
+
+
+GpuInstanceCuller::GpuInstanceCuller(unsigned int capacity) :
+    cullShader("glsl/gpu_cull.vert", "glsl/gpu_cull.frag", "glsl/gpu_cull.geom", { "instanceMatrix", "instanceStamp" }),
+    probeShader("glsl/gpu_cull_probe.vert", "glsl/gpu_cull_probe.frag")
+{
+    this->capacity = 0;
+    culledCount = 0;
+    stamp = 0;
+    nextMeasure = 0;
+    stats = {};
+    statFrames = 0;
+
+    glGenBuffers(1, &output);
+    glGenVertexArrays(1, &cullVertexArray);
+    glGenVertexArrays(1, &probeVertexArray);
+    GLState::bindVertexArray(probeVertexArray);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, output);
+    glEnableVertexAttribArray(0);
+    glVertexAttribIPointer(0, 1, GL_INT, GPU_CULL_CHUNK * sizeof(CulledInstance), (void*)offsetof(CulledInstance, stamp));
+    GLState::bindVertexArray(0);
+
+    glGenFramebuffers(1, &probeFramebuffer);
+    glGenRenderbuffers(1, &probeTarget);
+    glBindRenderbuffer(GL_RENDERBUFFER, probeTarget);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_R8, 1, 1);
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, probeFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, probeTarget);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    for (Measure& measure : measures)
+    {
+        glGenQueries(1, &measure.query);
+        measure.instances = 0;
+    }
+
+    cullShader.use();
+    cullShader.setInt("hiz", 0);
+    reserve(capacity);
+}
+
+
+GpuInstanceCuller::~GpuInstanceCuller()
+{
+    for (Measure& measure : measures)
+        glDeleteQueries(1, &measure.query);
+    if (!chunkQueries.empty())
+        glDeleteQueries(static_cast<GLsizei>(chunkQueries.size()), chunkQueries.data());
+    glDeleteRenderbuffers(1, &probeTarget);
+    GLState::deleteFramebuffers(1, &probeFramebuffer);
+    GLState::deleteVertexArrays(1, &probeVertexArray);
+    GLState::deleteVertexArrays(1, &cullVertexArray);
+    GLState::deleteBuffers(1, &output);
+    GLState::deleteProgram(cullShader.ID);
+    GLState::deleteProgram(probeShader.ID);
+}
+
+
+void GpuInstanceCuller::cull(unsigned int instances, size_t offset, unsigned int count, const BvhBox& bounds,
+    const glm::mat4& viewProjection, const HiZBuffer* occlusion)
+{
+    collectMeasures();
+    reserve(count);
+    culledCount = count;
+    // 0 is what a fresh output holds, never a cull's stamp
+    if (++stamp <= 0)
+        stamp = 1;
+    stats.instances += count;
+    if (count == 0)
+        return;
+
+    cullShader.use();
+    cullShader.setMat4("viewProjection", viewProjection);
+    cullShader.setVec3("boundsMin", bounds.min);
+    cullShader.setVec3("boundsMax", bounds.max);
+    cullShader.setInt("stamp", stamp);
+    cullShader.setBool("useHiz", occlusion != nullptr);
+    if (occlusion)
+    {
+        GLState::bindTextureUnit(0, GL_TEXTURE_2D, occlusion->texture);
+        cullShader.setVec2("hizSize", (float)occlusion->width, (float)occlusion->height);
+        cullShader.setInt("hizLevels", occlusion->levels);
+    }
+    GLState::bindVertexArray(cullVertexArray);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, instances);
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        glEnableVertexAttribArray(column);
+        glVertexAttribPointer(column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+            (void*)(offset + column * sizeof(glm::vec4)));
+    }
+
+    // a measure still in flight from GPU_CULL_STATS_FRAMES culls ago leaves this one unmeasured
+    Measure& measure = measures[nextMeasure];
+    nextMeasure = (nextMeasure + 1) % GPU_CULL_STATS_FRAMES;
+    bool measuring = measure.instances == 0;
+    GLState::enable(GL_RASTERIZER_DISCARD);
+    GLState::bindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, output);
+    if (measuring)
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, measure.query);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+    glEndTransformFeedback();
+    if (measuring)
+    {
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        measure.instances = count;
+    }
+    GLState::bindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    GLState::disable(GL_RASTERIZER_DISCARD);
+
+    // a probe point per chunk: keep the caller's framebuffer, viewport and depth test
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    bool depthTest = glIsEnabled(GL_DEPTH_TEST) == GL_TRUE;
+    GLState::disable(GL_DEPTH_TEST);
+
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, probeFramebuffer);
+    GLState::viewport(0, 0, 1, 1);
+    probeShader.use();
+    probeShader.setInt("stamp", stamp);
+    GLState::bindVertexArray(probeVertexArray);
+    for (unsigned int first = 0, chunk = 0; first < count; first += GPU_CULL_CHUNK, chunk++)
+    {
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, chunkQueries[chunk]);
+        glDrawArrays(GL_POINTS, static_cast<GLint>(chunk), 1);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+    }
+
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    GLState::viewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    if (depthTest)
+        GLState::enable(GL_DEPTH_TEST);
+}
+
+
+void GpuInstanceCuller::bindInstanceAttributes(unsigned int location, unsigned int first) const
+{
+    GLState::bindBuffer(GL_ARRAY_BUFFER, output);
+    size_t base = size_t(first) * sizeof(CulledInstance);
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        glEnableVertexAttribArray(location + column);
+        glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, sizeof(CulledInstance),
+            (void*)(base + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location + column, 1);
+    }
+    glEnableVertexAttribArray(location + 4);
+    glVertexAttribIPointer(location + 4, 1, GL_INT, sizeof(CulledInstance), (void*)(base + offsetof(CulledInstance, stamp)));
+    glVertexAttribDivisor(location + 4, 1);
+}
+
+
+void GpuInstanceCuller::reserve(unsigned int count)
+{
+    size_t chunks = (size_t(count) + GPU_CULL_CHUNK - 1) / GPU_CULL_CHUNK;
+    if (chunkQueries.size() < chunks)
+    {
+        size_t added = chunks - chunkQueries.size();
+        chunkQueries.resize(chunks);
+        glGenQueries(static_cast<GLsizei>(added), chunkQueries.data() + chunks - added);
+    }
+    if (count <= capacity)
+        return;
+
+    // zeroed, so no entry passes for a cull's stamp before that cull writes it
+    capacity = max(count, capacity + capacity / 2);
+    vector<CulledInstance> cleared(capacity, CulledInstance{ glm::mat4(0.0f), 0 });
+    GLState::bindBuffer(GL_ARRAY_BUFFER, output);
+    glBufferData(GL_ARRAY_BUFFER, cleared.size() * sizeof(CulledInstance), cleared.data(), GL_DYNAMIC_COPY);
+}
+
+
+void GpuInstanceCuller::collectMeasures()
+{
+    for (Measure& measure : measures)
+    {
+        if (measure.instances == 0)
+            continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(measure.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint written = 0;
+        glGetQueryObjectuiv(measure.query, GL_QUERY_RESULT, &written);
+        stats.measured += measure.instances;
+        stats.visible += written;
+        measure.instances = 0;
+    }
+}
+
+
+void GpuInstanceCuller::resetStats()
+{
+    stats = {};
+}
+
+
+void GpuInstanceCuller::printStats() const
+{
+    cout << "GPU_CULL:: " << stats.instances << " instances culled, " << stats.visible << "/" << stats.measured
+        << " of those read back were visible" << endl;
+}
+
+
+void GpuInstanceCuller::endFrame()
+{
+#if GPU_CULL_REPORT_FRAMES
+    if (++statFrames < GPU_CULL_REPORT_FRAMES)
+        return;
+    statFrames = 0;
+    printStats();
+    resetStats();
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <vector>
+
+#include "bvh.h"
+#include "hiz.h"
+#include "shader.h"
+using namespace std;
+
+// instances per conditional draw of the compacted list
+#define GPU_CULL_CHUNK 1024
+// culls whose written instance count is read back for the stats without waiting
+#define GPU_CULL_STATS_FRAMES 4
+// print and reset the counters every this many frames (0: never)
+#define GPU_CULL_REPORT_FRAMES 600
+
+
+// one entry of the compacted stream: the instance and the cull that wrote it
+struct CulledInstance
+{
+    glm::mat4 matrix;
+    int       stamp;
+};
+
+struct GpuCullStats
+{
+    unsigned int instances;     // submitted to cull()
+    unsigned int measured;      // of those, in culls whose result has been read back
+    unsigned int visible;       // of the measured, written to the compacted stream
+};
+
+
+/*
+* Frustum and Hi-Z culling of instance matrices on the GPU, with a draw list
+* the CPU never looks at.
+*
+* cull() draws one point per instance with rasterization discarded. The
+* vertex shader tests the instance's box (one object space box shared by all
+* instances) against the frustum and, when given, the pyramid of the last
+* HiZBuffer::build(); a geometry shader passes only the visible ones on and
+* transform feedback packs them to the front of the output stream, stamped
+* with the cull's number. The loader is GL 3.3 core, so there is no compute
+* shader and no indirect draw whose count the GPU could write. Instead the
+* compacted stream is cut into GPU_CULL_CHUNK instance chunks, a probe point
+* per chunk lands in a 1x1 target when the chunk's first entry carries the
+* current stamp, and drawChunks() issues each chunk under conditional
+* rendering on its probe's query. Empty chunks cost the GPU nothing, and the
+* CPU cost is a few calls per chunk whatever the instances do. The tail of
+* the last chunk holds entries of earlier culls, instance shaders drop every
+* entry whose stamp is not getStamp().
+*/
+class GpuInstanceCuller
+{
+public:
+    // compacted CulledInstance stream, capacity entries
+    unsigned int output;
+    unsigned int capacity;
+
+
+    GpuInstanceCuller(unsigned int capacity);
+    ~GpuInstanceCuller();
+
+    GpuInstanceCuller(const GpuInstanceCuller&) = delete;
+    GpuInstanceCuller& operator=(const GpuInstanceCuller&) = delete;
+
+    // count mat4s from byte offset of the instances buffer, bounds in the space they transform from.
+    // Occlusion is tested against the pyramid of its last build(), rendered with viewProjection
+    void cull(unsigned int instances, size_t offset, unsigned int count, const BvhBox& bounds,
+        const glm::mat4& viewProjection, const HiZBuffer* occlusion = nullptr);
+
+    // draw(first, count) per chunk of the last cull, each under conditional rendering on whether
+    // the chunk received an instance
+    template<typename Draw>
+    void drawChunks(Draw draw) const;
+
+    // matrix at location .. location + 3 and stamp at location + 4 of the compacted stream from
+    // entry first, per instance, on the bound vertex array
+    void bindInstanceAttributes(unsigned int location, unsigned int first) const;
+
+    // stamp of the last cull's entries
+    int getStamp() const { return stamp; }
+
+    GpuCullStats getStats() const { return stats; }
+    void resetStats();
+    void printStats() const;
+
+    // once per frame, prints and resets the counters every GPU_CULL_REPORT_FRAMES frames
+    void endFrame();
+
+private:
+    struct Measure
+    {
+        unsigned int query;
+        unsigned int instances;     // 0: nothing in flight
+    };
+
+    // output and chunk queries for count instances
+    void reserve(unsigned int count);
+
+    // adds the written counts that have arrived to the stats
+    void collectMeasures();
+
+    Shader                cullShader;
+    Shader                probeShader;
+    unsigned int          cullVertexArray;
+    // stamp of the first entry of every chunk, one vertex per chunk
+    unsigned int          probeVertexArray;
+    unsigned int          probeFramebuffer, probeTarget;
+    vector<unsigned int>  chunkQueries;
+    unsigned int          culledCount;
+    int                   stamp;
+
+    Measure               measures[GPU_CULL_STATS_FRAMES];
+    unsigned int          nextMeasure;
+    GpuCullStats          stats;
+    unsigned int          statFrames;
+};
+
+
+template<typename Draw>
+void GpuInstanceCuller::drawChunks(Draw draw) const
+{
+    for (unsigned int first = 0, chunk = 0; first < culledCount; first += GPU_CULL_CHUNK, chunk++)
+    {
+        glBeginConditionalRender(chunkQueries[chunk], GL_QUERY_WAIT);
+        draw(first, min(culledCount - first, (unsigned int)GPU_CULL_CHUNK));
+        glEndConditionalRender();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,385 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+#include "hiz.h"
+#include "gl_state.h"
+
+
+namespace
+{
+    // screen rectangle in level 0 texels and nearest window depth of a box, false when the box
+    // reaches in front of the near plane (or behind the eye) and has to count as visible
+    bool projectBox(const glm::mat4& modelViewProjection, const glm::vec3& aabbMin, const glm::vec3& aabbMax,
+        glm::ivec2 size, glm::ivec2& texelMin, glm::ivec2& texelMax, float& nearest)
+    {
+        glm::vec2 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+        nearest = FLT_MAX;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 point(corner & 1 ? aabbMax.x : aabbMin.x, corner & 2 ? aabbMax.y : aabbMin.y,
+                corner & 4 ? aabbMax.z : aabbMin.z);
+            glm::vec4 clip = modelViewProjection * glm::vec4(point, 1.0f);
+            if (clip.w <= 0.0f || clip.z < -clip.w)
+                return false;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+            ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+            nearest = min(nearest, ndc.z * 0.5f + 0.5f);
+        }
+        glm::vec2 uvMin = glm::clamp(ndcMin * 0.5f + 0.5f, 0.0f, 1.0f);
+        glm::vec2 uvMax = glm::clamp(ndcMax * 0.5f + 0.5f, 0.0f, 1.0f);
+        texelMin = glm::min(glm::ivec2(uvMin * glm::vec2(size)), size - 1);
+        texelMax = glm::min(glm::ivec2(uvMax * glm::vec2(size)), size - 1);
+        return true;
+    }
+
+    // farthest of each 2x2 block, odd sizes fold their last row and column into the last texel
+    void reduce(const vector<float>& source, glm::ivec2 sourceSize, vector<float>& target, glm::ivec2 targetSize)
+    {
+        target.assign(size_t(targetSize.x) * targetSize.y, 0.0f);
+        for (int y = 0; y < targetSize.y; y++)
+        {
+            int y0 = y * 2, y1 = y == targetSize.y - 1 ? sourceSize.y - 1 : min(y * 2 + 1, sourceSize.y - 1);
+            for (int x = 0; x < targetSize.x; x++)
+            {
+                int x0 = x * 2, x1 = x == targetSize.x - 1 ? sourceSize.x - 1 : min(x * 2 + 1, sourceSize.x - 1);
+                float farthest = 0.0f;
+                for (int sy = y0; sy <= y1; sy++)
+                    for (int sx = x0; sx <= x1; sx++)
+                        farthest = max(farthest, source[size_t(sy) * sourceSize.x + sx]);
+                target[size_t(y) * targetSize.x + x] = farthest;
+            }
+        }
+    }
+
+    glm::ivec2 levelSize(int width, int height, int level)
+    {
+        return glm::ivec2(max(width >> level, 1), max(height >> level, 1));
+    }
+
+    bool isSignaled(GLsync fence)
+    {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+    }
+}
+
+
+HiZBuffer::HiZBuffer(int width, int height) :
+    reduceShader("glsl/hiz_reduce.vert", "glsl/hiz_reduce.frag"),
+    testShader("glsl/hiz_test.vert", "glsl/hiz_test.frag")
+{
+    this->width = width;
+    this->height = height;
+    levels = 1;
+    while ((width >> levels) > 0 || (height >> levels) > 0)
+        levels++;
+    readbackLevel = 0;
+    while (readbackLevel < levels - 1 && (width >> readbackLevel) > HIZ_READBACK_MAX_WIDTH)
+        readbackLevel++;
+
+    glGenTextures(1, &texture);
+    GLState::activeTexture(GL_TEXTURE0);
+    GLState::bindTexture(GL_TEXTURE_2D, texture);
+    for (int level = 0; level < levels; level++)
+    {
+        glm::ivec2 size = levelSize(width, height, level);
+        glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, size.x, size.y, 0, GL_RED, GL_FLOAT, NULL);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    glGenFramebuffers(1, &framebuffer);
+    glGenVertexArrays(1, &emptyVertexArray);
+
+    glGenFramebuffers(1, &testFramebuffer);
+    glGenRenderbuffers(1, &testTarget);
+    glBindRenderbuffer(GL_RENDERBUFFER, testTarget);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_R8, 1, 1);
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, testFramebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, testTarget);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    glGenVertexArrays(1, &testVertexArray);
+    glGenBuffers(1, &testBuffer);
+    GLState::bindVertexArray(testVertexArray);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, testBuffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BvhBox), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(BvhBox), (void*)offsetof(BvhBox, max));
+    GLState::bindVertexArray(0);
+
+    glm::ivec2 readbackSize = levelSize(width, height, readbackLevel);
+    for (Readback& readback : readbacks)
+    {
+        glGenBuffers(1, &readback.buffer);
+        GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size_t(readbackSize.x) * readbackSize.y * sizeof(float), NULL, GL_STREAM_READ);
+        readback.fence = 0;
+        readback.frame = 0;
+    }
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    reduceShader.use();
+    reduceShader.setInt("source", 0);
+    testShader.use();
+    testShader.setInt("hiz", 0);
+    testShader.setVec2("hizSize", glm::vec2(width, height));
+    testShader.setInt("hizLevels", levels);
+
+    queriesUsed = 0;
+    frame = 0;
+    stats = {};
+    statFrames = 0;
+}
+
+
+HiZBuffer::~HiZBuffer()
+{
+    for (Readback& readback : readbacks)
+    {
+        if (readback.fence)
+            glDeleteSync(readback.fence);
+        GLState::deleteBuffers(1, &readback.buffer);
+    }
+    if (!queryPool.empty())
+        glDeleteQueries(static_cast<GLsizei>(queryPool.size()), queryPool.data());
+    GLState::deleteBuffers(1, &testBuffer);
+    GLState::deleteVertexArrays(1, &testVertexArray);
+    glDeleteRenderbuffers(1, &testTarget);
+    GLState::deleteFramebuffers(1, &testFramebuffer);
+    GLState::deleteVertexArrays(1, &emptyVertexArray);
+    GLState::deleteFramebuffers(1, &framebuffer);
+    GLState::deleteTextures(1, &texture);
+    GLState::deleteProgram(reduceShader.ID);
+    GLState::deleteProgram(testShader.ID);
+}
+
+
+void HiZBuffer::build(unsigned int depthTexture, const glm::mat4& viewProjection)
+{
+    collectReadback();
+    queriesUsed = 0;
+    frame++;
+
+    // fullscreen triangles into each level: keep the caller's framebuffer, viewport and tests
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    bool depthTest = glIsEnabled(GL_DEPTH_TEST) == GL_TRUE;
+    bool blend = glIsEnabled(GL_BLEND) == GL_TRUE;
+    GLState::disable(GL_DEPTH_TEST);
+    GLState::disable(GL_BLEND);
+
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    GLState::bindVertexArray(emptyVertexArray);
+    reduceShader.use();
+    for (int level = 0; level < levels; level++)
+    {
+        glm::ivec2 size = levelSize(width, height, level);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+        GLState::viewport(0, 0, size.x, size.y);
+        reduceShader.setBool("copyDepth", level == 0);
+        if (level == 0)
+            GLState::bindTextureUnit(0, GL_TEXTURE_2D, depthTexture);
+        else
+        {
+            // only the level read from is visible to the sampler, no feedback loop with the one written
+            GLState::activeTexture(GL_TEXTURE0);
+            GLState::bindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+        }
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    GLState::activeTexture(GL_TEXTURE0);
+    GLState::bindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    GLState::viewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    if (depthTest)
+        GLState::enable(GL_DEPTH_TEST);
+    if (blend)
+        GLState::enable(GL_BLEND);
+
+    startReadback(viewProjection);
+}
+
+
+bool HiZBuffer::isVisiblePrevious(const glm::mat4& model, const glm::vec3& aabbMin, const glm::vec3& aabbMax) const
+{
+    if (cpuLevels.empty())
+        return true;
+    glm::ivec2 texelMin, texelMax;
+    float nearest;
+    if (!projectBox(cpuViewProjection * model, aabbMin, aabbMax, glm::ivec2(width, height), texelMin, texelMax, nearest))
+        return true;
+
+    // the level where the rectangle covers at most 2x2 texels
+    int level = readbackLevel;
+    while (level < levels - 1 && ((texelMax.x >> level) - (texelMin.x >> level) > 1 ||
+        (texelMax.y >> level) - (texelMin.y >> level) > 1))
+        level++;
+    const vector<float>& depths = cpuLevels[level - readbackLevel];
+    glm::ivec2 size = cpuSizes[level - readbackLevel];
+    glm::ivec2 first = glm::min(texelMin >> level, size - 1);
+    glm::ivec2 last = glm::min(texelMax >> level, size - 1);
+    float farthest = 0.0f;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            farthest = max(farthest, depths[size_t(y) * size.x + x]);
+    return nearest <= farthest;
+}
+
+
+void HiZBuffer::testCurrent(const glm::mat4& modelViewProjection, const vector<BvhBox>& boxes, vector<unsigned int>& queries)
+{
+    queries.clear();
+    if (boxes.empty())
+        return;
+    if (queryPool.size() < queriesUsed + boxes.size())
+    {
+        size_t added = queriesUsed + boxes.size() - queryPool.size();
+        queryPool.resize(queryPool.size() + added);
+        glGenQueries(static_cast<GLsizei>(added), queryPool.data() + queryPool.size() - added);
+    }
+
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    bool depthTest = glIsEnabled(GL_DEPTH_TEST) == GL_TRUE;
+    GLState::disable(GL_DEPTH_TEST);
+
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, testFramebuffer);
+    GLState::viewport(0, 0, 1, 1);
+    GLState::bindVertexArray(testVertexArray);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, testBuffer);
+    glBufferData(GL_ARRAY_BUFFER, boxes.size() * sizeof(BvhBox), boxes.data(), GL_STREAM_DRAW);
+    GLState::bindTextureUnit(0, GL_TEXTURE_2D, texture);
+    testShader.use();
+    testShader.setMat4("modelViewProjection", modelViewProjection);
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        unsigned int query = queryPool[queriesUsed++];
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, query);
+        glDrawArrays(GL_POINTS, static_cast<GLint>(i), 1);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        queries.push_back(query);
+    }
+
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    GLState::viewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    if (depthTest)
+        GLState::enable(GL_DEPTH_TEST);
+}
+
+
+void HiZBuffer::collectReadback()
+{
+    Readback* newest = nullptr;
+    for (Readback& readback : readbacks)
+        if (readback.fence && isSignaled(readback.fence) && (!newest || readback.frame > newest->frame))
+            newest = &readback;
+    if (!newest)
+        return;
+
+    // the GPU finishes in order: everything older than the newest arrival is obsolete
+    for (Readback& readback : readbacks)
+    {
+        if (readback.fence && readback.frame <= newest->frame)
+        {
+            glDeleteSync(readback.fence);
+            readback.fence = 0;
+        }
+    }
+
+    glm::ivec2 size = levelSize(width, height, readbackLevel);
+    cpuLevels.resize(levels - readbackLevel);
+    cpuSizes.resize(levels - readbackLevel);
+    cpuSizes[0] = size;
+    cpuLevels[0].resize(size_t(size.x) * size.y);
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, newest->buffer);
+    void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, cpuLevels[0].size() * sizeof(float), GL_MAP_READ_BIT);
+    if (data)
+    {
+        memcpy(cpuLevels[0].data(), data, cpuLevels[0].size() * sizeof(float));
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!data)
+    {
+        cpuLevels.clear();
+        return;
+    }
+    for (size_t i = 1; i < cpuLevels.size(); i++)
+    {
+        cpuSizes[i] = levelSize(width, height, readbackLevel + int(i));
+        reduce(cpuLevels[i - 1], cpuSizes[i - 1], cpuLevels[i], cpuSizes[i]);
+    }
+    cpuViewProjection = newest->viewProjection;
+}
+
+
+void HiZBuffer::startReadback(const glm::mat4& viewProjection)
+{
+    // the oldest slot, a readback still in flight there is given up
+    Readback* slot = &readbacks[0];
+    for (Readback& readback : readbacks)
+        if (readback.frame < slot->frame)
+            slot = &readback;
+    if (slot->fence)
+        glDeleteSync(slot->fence);
+
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    GLState::activeTexture(GL_TEXTURE0);
+    GLState::bindTexture(GL_TEXTURE_2D, texture);
+    glGetTexImage(GL_TEXTURE_2D, readbackLevel, GL_RED, GL_FLOAT, (void*)0);
+    GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->frame = frame;
+    slot->viewProjection = viewProjection;
+}
+
+
+void HiZBuffer::record(unsigned int tested, unsigned int deferred)
+{
+    stats.tested += tested;
+    stats.deferred += deferred;
+}
+
+
+void HiZBuffer::resetStats()
+{
+    stats = {};
+}
+
+
+void HiZBuffer::printStats() const
+{
+    cout << "HIZ:: " << stats.tested - stats.deferred << "/" << stats.tested
+        << " meshes drawn in the first phase, the rest tested against the current pyramid" << endl;
+}
+
+
+void HiZBuffer::endFrame()
+{
+#if HIZ_REPORT_FRAMES
+    if (++statFrames < HIZ_REPORT_FRAMES)
+        return;
+    statFrames = 0;
+    printStats();
+    resetStats();
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "bvh.h"
+#include "shader.h"
+using namespace std;
+
+// the CPU copy of the pyramid starts at the first level at most this wide
+#define HIZ_READBACK_MAX_WIDTH 128
+// readbacks in flight, the CPU test uses the newest one that has arrived
+#define HIZ_READBACK_FRAMES 3
+// print and reset the counters every this many frames (0: never)
+#define HIZ_REPORT_FRAMES 600
+
+
+struct OcclusionStats
+{
+    unsigned int tested;        // meshes in the frustum tested against the previous pyramid
+    unsigned int deferred;      // of those, left for the second phase's GPU test
+};
+
+
+/*
+* Hierarchical Z buffer for two phase occlusion culling of mesh bounds.
+*
+* build() copies a depth texture into level 0 of an R32F mip chain and
+* reduces it level by level to the farthest depth of each 2x2 block (odd
+* sizes fold their last row and column into the last texel). A box is hidden
+* when its nearest depth lies behind the farthest depth of the texels its
+* screen rectangle covers, read from the level where the rectangle spans at
+* most 2x2 texels.
+*
+* First phase, on the CPU: a coarse level of each pyramid is read back
+* through a ring of pixel pack buffers and fences, so the newest copy is a
+* frame or more old. Boxes are projected with the view projection that copy
+* was rendered with (reprojected into the frame it shows) and what it hides
+* is not drawn yet. Second phase, on the GPU: once the first phase's depth
+* is in a new pyramid, testCurrent() draws a point per deferred box whose
+* vertex shader runs the same test and lands inside the viewport only when
+* the box is visible. Every point has its own GL_ANY_SAMPLES_PASSED query
+* and the deferred meshes are drawn under conditional rendering, so whatever
+* the stale pyramid got wrong still appears in the same frame without a CPU
+* wait.
+*/
+class HiZBuffer
+{
+public:
+    // R32F mip chain, level 0 at the depth buffer's size
+    unsigned int texture;
+    int          width, height;
+    int          levels;
+
+
+    HiZBuffer(int width, int height);
+    ~HiZBuffer();
+
+    HiZBuffer(const HiZBuffer&) = delete;
+    HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+    // pyramid of depthTexture (this size, rendered with viewProjection), picks up a readback that
+    // arrived and starts the next one. Keeps the caller's framebuffer, viewport and state
+    void build(unsigned int depthTexture, const glm::mat4& viewProjection);
+
+    // first phase: the box (object space of model) against the newest pyramid on the CPU,
+    // true when it may be visible or no pyramid has arrived yet
+    bool isVisiblePrevious(const glm::mat4& model, const glm::vec3& aabbMin, const glm::vec3& aabbMax) const;
+
+    // second phase: one query per box against the pyramid of the last build(), for
+    // glBeginConditionalRender; the ids stay valid until the next build()
+    void testCurrent(const glm::mat4& modelViewProjection, const vector<BvhBox>& boxes, vector<unsigned int>& queries);
+
+    void record(unsigned int tested, unsigned int deferred);
+    OcclusionStats getStats() const { return stats; }
+    void resetStats();
+    void printStats() const;
+
+    // once per frame, prints and resets the counters every HIZ_REPORT_FRAMES frames
+    void endFrame();
+
+private:
+    struct Readback
+    {
+        unsigned int  buffer;
+        GLsync        fence;
+        unsigned long frame;
+        glm::mat4     viewProjection;
+    };
+
+    // newest readback whose fence has signaled into the CPU pyramid, older ones are dropped
+    void collectReadback();
+
+    void startReadback(const glm::mat4& viewProjection);
+
+    Shader                reduceShader;
+    Shader                testShader;
+    unsigned int          framebuffer;
+    unsigned int          emptyVertexArray;
+    // second phase points: a 1x1 target of their own, boxes as two vec3 attributes
+    unsigned int          testFramebuffer, testTarget;
+    unsigned int          testVertexArray, testBuffer;
+    vector<unsigned int>  queryPool;
+    size_t                queriesUsed;
+
+    Readback              readbacks[HIZ_READBACK_FRAMES];
+    unsigned long         frame;
+    int                   readbackLevel;
+    // CPU pyramid from readbackLevel down to 1x1 and the view projection it was rendered with
+    vector<vector<float>> cpuLevels;
+    vector<glm::ivec2>    cpuSizes;
+    glm::mat4             cpuViewProjection;
+
+    OcclusionStats        stats;
+    unsigned int          statFrames;
+};
\ No newline at end of file
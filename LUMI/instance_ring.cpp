@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <iostream>
+
+#include "instance_ring.h"
+#include "gl_state.h"
+
+
+InstanceRing::InstanceRing(size_t regionBytes)
+{
+    this->regionBytes = 0;
+    region = 0;
+    stats = {};
+    statFrames = 0;
+    for (GLsync& fence : fences)
+        fence = 0;
+    glGenBuffers(1, &buffer);
+    if (regionBytes > 0)
+    {
+        this->regionBytes = regionBytes;
+        GLState::bindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, regionBytes * INSTANCE_RING_REGIONS, NULL, GL_STREAM_DRAW);
+    }
+}
+
+
+InstanceRing::~InstanceRing()
+{
+    for (GLsync fence : fences)
+        if (fence)
+            glDeleteSync(fence);
+    GLState::deleteBuffers(1, &buffer);
+}
+
+
+void* InstanceRing::map(size_t bytes)
+{
+    region = (region + 1) % INSTANCE_RING_REGIONS;
+    GLState::bindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (bytes > regionBytes)
+    {
+        // new storage, the old one lives on until the GPU is done with it
+        regionBytes = max(bytes, regionBytes + regionBytes / 2);
+        glBufferData(GL_ARRAY_BUFFER, regionBytes * INSTANCE_RING_REGIONS, NULL, GL_STREAM_DRAW);
+        for (GLsync& fence : fences)
+        {
+            if (fence)
+                glDeleteSync(fence);
+            fence = 0;
+        }
+        stats.grows++;
+    }
+    else if (fences[region])
+    {
+        GLenum status = glClientWaitSync(fences[region], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            stats.waits++;
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+    }
+    stats.uploads++;
+    stats.bytes += bytes;
+    return glMapBufferRange(GL_ARRAY_BUFFER, region * regionBytes, bytes,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+
+size_t InstanceRing::unmap()
+{
+    GLState::bindBuffer(GL_ARRAY_BUFFER, buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    return region * regionBytes;
+}
+
+
+void InstanceRing::fence()
+{
+    if (fences[region])
+        glDeleteSync(fences[region]);
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+
+void InstanceRing::resetStats()
+{
+    stats = {};
+}
+
+
+void InstanceRing::printStats() const
+{
+    cout << "INSTANCE_RING:: " << stats.uploads << " uploads, " << stats.bytes / 1024 << " KB, "
+        << stats.waits << " waited on the GPU, " << stats.grows << " reallocations" << endl;
+}
+
+
+void InstanceRing::endFrame()
+{
+#if INSTANCE_RING_REPORT_FRAMES
+    if (++statFrames < INSTANCE_RING_REPORT_FRAMES)
+        return;
+    statFrames = 0;
+    printStats();
+    resetStats();
+#endif
+}
\ No newline at end of file
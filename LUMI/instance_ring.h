@@ -0,0 +1,69 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+
+using namespace std;
+
+// regions of the ring, frames of instance data the GPU may still be reading
+#define INSTANCE_RING_REGIONS 3
+// print and reset the counters every this many frames (0: never)
+#define INSTANCE_RING_REPORT_FRAMES 600
+
+
+struct InstanceRingStats
+{
+    unsigned int uploads;
+    size_t       bytes;
+    unsigned int waits;         // uploads that found their region still in use by the GPU
+    unsigned int grows;
+};
+
+
+/*
+* Streaming buffer for per frame instance data: INSTANCE_RING_REGIONS
+* regions of one buffer written in turn, each guarded by a fence placed
+* after the last draw that reads it.
+*
+* GL 3.3 has no persistent mapping, so every write maps its region with
+* GL_MAP_UNSYNCHRONIZED_BIT: the driver does not wait or copy, the fence
+* says when the region is free. With three regions the wait only happens
+* when the GPU falls more than two frames behind. A write larger than the
+* regions reallocates the buffer, which orphans the old storage together
+* with whatever the GPU still reads from it.
+*/
+class InstanceRing
+{
+public:
+    unsigned int buffer;
+    size_t       regionBytes;
+
+
+    InstanceRing(size_t regionBytes = 0);
+    ~InstanceRing();
+
+    InstanceRing(const InstanceRing&) = delete;
+    InstanceRing& operator=(const InstanceRing&) = delete;
+
+    // the next region to write (bytes > 0), unmap() before drawing. nullptr when mapping failed
+    void* map(size_t bytes);
+
+    // byte offset of the region just written
+    size_t unmap();
+
+    // after the last draw reading the current region
+    void fence();
+
+    InstanceRingStats getStats() const { return stats; }
+    void resetStats();
+    void printStats() const;
+
+    // once per frame, prints and resets the counters every INSTANCE_RING_REPORT_FRAMES frames
+    void endFrame();
+
+private:
+    GLsync            fences[INSTANCE_RING_REGIONS];
+    unsigned int      region;
+
+    InstanceRingStats stats;
+    unsigned int      statFrames;
+};
\ No newline at end of file
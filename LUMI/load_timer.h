@@ -0,0 +1,27 @@
+#pragma once
+#include <chrono>
+#include <iostream>
+#include <string>
+using namespace std;
+
+
+// wall clock timer for loading phases, prints the elapsed time when it goes out of scope
+class LoadTimer
+{
+public:
+    LoadTimer(const string& phase) : phase(phase), start(chrono::steady_clock::now()) {}
+
+    ~LoadTimer()
+    {
+        cout << "LOAD::" << phase << ": " << elapsedMs() << " ms" << endl;
+    }
+
+    double elapsedMs() const
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    string phase;
+    chrono::steady_clock::time_point start;
+};
\ No newline at end of file
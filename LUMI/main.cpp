@@ -11,13 +11,20 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "uniform_blocks.h"
 #include "skybox.h"
 #include "prefab.h"
+#include "frustum_culling.h"
+#include "render_queue.h"
+#include "command_buffer.h"
+#include "shadow_cascades.h"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+// scene and render loop, every GL object is destroyed before main() terminates GLFW
+int run(GLFWwindow* window);
 void renderQuad();
 
 // settings
@@ -71,9 +78,17 @@ int main()
 		return -1;
 	}
 
+	int result = run(window);
+	glfwTerminate();
+	return result;
+}
+
+
+int run(GLFWwindow* window)
+{
 	// OpenGLѡ
-	glEnable(GL_MULTISAMPLE);
-	glEnable(GL_DEPTH_TEST);
+	GLState::enable(GL_MULTISAMPLE);
+	GLState::enable(GL_DEPTH_TEST);
 
 	// ߿ģʽ
 	// glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
@@ -90,48 +105,50 @@ int main()
 
 	// ģ
 	// stbi_set_flip_vertically_on_load(true);
-	Model sponzaModel("models/sponza/sponza.obj");
+	// streams in while the loop already renders, see sponzaModel.update(); once loaded
+	// its textures sit in texture arrays and the whole model is a single draw
+	Model sponzaModel("models/sponza/sponza.obj", ModelLoadMode::Async, false, true);
 	Model cubeModel("models/cube.obj");
 
 	//  Shader 
 	Shader sponzaShader("glsl/sponza.vert", "glsl/sponza.frag");
+	Shader sponzaArrayShader("glsl/sponza_array.vert", "glsl/sponza_array.frag");
 	Shader cubeShader("glsl/cube.vert", "glsl/cube.frag");
 	Shader skyboxShader("glsl/skybox.vert", "glsl/skybox.frag");
 	Shader depthShader("glsl/shadow_mapping_depth.vert", "glsl/shadow_mapping_depth.frag");
+	// alpha tested casters (leaves, chains) cut their shadow out of the diffuse alpha
+	Shader maskedDepthShader("glsl/shadow_mapping_depth_masked.vert", "glsl/shadow_mapping_depth_masked.frag");
 	Shader debugShader("glsl/debug_quad_depth.vert", "glsl/debug_quad_depth.frag");
 
 
 	// ͼ FBO
-	const unsigned int SHADOW_WIDTH = 2048, SHADOW_HEIGHT = 2048;
-	unsigned int depthMapFBO;
-	glGenFramebuffers(1, &depthMapFBO);
-	// create depth texture
-	unsigned int depthMap;
-	glGenTextures(1, &depthMap);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	GLfloat borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	// attach depth texture as FBO's depth buffer
-	glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// one layer per cascade, fitted to the camera every frame
+	const unsigned int SHADOW_SIZE = 2048;
+	// view distance up to which the cascades cover the camera frustum
+	const float SHADOW_DISTANCE = 30.0f;
+	CascadedShadowMap shadowMap(SHADOW_SIZE);
 
 	// shader
 	sponzaShader.use();
-	sponzaShader.setInt("shadowMap", 1);
+	// units below MATERIAL_FIRST_FREE_UNIT are taken by the material textures
+	sponzaShader.setInt("shadowCascades", MATERIAL_FIRST_FREE_UNIT);
+	sponzaArrayShader.use();
+	sponzaArrayShader.setInt("shadowCascades", MATERIAL_FIRST_FREE_UNIT);
 	debugShader.use();
 	debugShader.setInt("depthMap", 0);
 
 	// Դλ
 	glm::vec3 lightPos(10.7f, 10.3f, 1.6f);
+	// shadows are cast along the axis the light used to look down, as from a directional light
+	glm::vec3 lightDirection = glm::vec3(-10.6f, 0.0f, 0.0f) - lightPos;
+
 
+	// camera constants shared by every program, written once per frame
+	UniformBuffer frameBuffer(UNIFORM_BINDING_FRAME, sizeof(FrameBlock));
+	// the cascades, written with the frame
+	UniformBuffer shadowBuffer(UNIFORM_BINDING_SHADOW, sizeof(ShadowBlock));
+	// commands of every cascade's depth pass and of the scene pass, recorded in parallel every frame
+	CommandBuffer shadowCommands[SHADOW_MAX_CASCADES], sceneCommands;
 
 	// Ⱦѭ
 	while (!glfwWindowShouldClose(window))
@@ -143,60 +160,94 @@ int main()
 
 		// 
 		processInput(window);
+		bool sponzaLoading = !sponzaModel.isLoaded();
+		sponzaModel.update();
 
 		// ɫȻ
-		glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+		GLState::clearColor(0.1f, 0.1f, 0.1f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Ⱦͼ
-		glm::mat4 lightProjection, lightView;
-		glm::mat4 lightSpaceMatrix;
-		float near_plane = 0.01f, far_plane = 9.0f;
-		lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);//glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, near_plane, far_plane);
-		lightView = glm::lookAt(lightPos, glm::vec3(-10.6f, 0.0f, 0.0f), glm::vec3(0.0, 1.0, 0.0));
 		//std::cout << "camera.Position = (" << camera.Position.x << ", "
 		//								   << camera.Position.y << ", "
 		//								   << camera.Position.z << ")\n";
 		//std::cout << "camera.Front = (" << camera.Front.x << ", "
 		//								   << camera.Front.y << ", "
 		//								   << camera.Front.z << ")\n";
-		lightSpaceMatrix = lightProjection * lightView;
-		depthShader.use();
 		glm::mat4 model = glm::mat4(1.0f);
-		depthShader.setMat4("model", model);
-		depthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-		
-		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-		glClear(GL_DEPTH_BUFFER_BIT);
-		sponzaModel.draw(depthShader);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
 
 		// Ⱦ
-		sponzaShader.use();
+		// per material textures while loading, texture arrays afterwards
+		Shader& sceneShader = sponzaModel.hasTextureArrays() ? sponzaArrayShader : sponzaShader;
 		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
 		glm::mat4 view = camera.GetViewMatrix();
-		model = glm::mat4(1.0f);
-		model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-		model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
-		sponzaShader.setMat4("projection", projection);
-		sponzaShader.setMat4("view", view);
-		sponzaShader.setMat4("model", model);
-		sponzaShader.setVec3("viewPos", camera.Position);
-		sponzaShader.setVec3("lightPos", lightPos);
-		sponzaShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-		sponzaModel.draw(sponzaShader);
+		FrameBlock frame = FrameBlock::fromCamera(projection, view, camera.Position,
+			(float)SCR_WIDTH, (float)SCR_HEIGHT, 0.1f, 100.0f);
+
+		// Ⱦͼ
+		// cascades around the part of the view frustum that receives shadows; sponza is a static
+		// caster, its cached depth only goes stale while meshes and textures stream in
+		if (sponzaLoading)
+			shadowMap.invalidateStatic();
+		shadowMap.update(view, glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, SHADOW_DISTANCE,
+			lightDirection, sponzaModel.bounds(model));
+		ShadowBlock shadows = shadowMap.block();
+
+		// every cascade and the scene are recorded on worker threads at once and replayed here in order,
+		// the model's LOD counters sum this frame's submits per pass
+		sponzaModel.resetLodStats();
+		vector<CommandBuffer*> buffers;
+		vector<function<void(CommandBuffer&)>> passes;
+		for (unsigned int i = 0; i < shadowMap.cascadeCount; i++)
+		{
+			buffers.push_back(&shadowCommands[i]);
+			passes.push_back([&, i](CommandBuffer& commands) {
+				const ShadowCascade& cascade = shadowMap.cascades[i];
+				commands.useProgram(depthShader);
+				commands.setMat4(depthShader, "model", model);
+				// static casters only into the parts of the cascade's cache that went stale or moved in,
+				// and only those from the light down to each part
+				for (unsigned int k = 0; k < cascade.staticRegionCount; k++)
+				{
+					const ShadowRegion& region = cascade.staticRegions[k];
+					commands.call([&shadowMap, i, k] { shadowMap.beginStaticRegion(i, k); });
+					commands.useProgram(maskedDepthShader);
+					commands.setMat4(maskedDepthShader, "lightSpaceMatrix", region.viewProjection);
+					commands.useProgram(depthShader);
+					commands.setMat4(depthShader, "lightSpaceMatrix", region.viewProjection);
+					RenderQueue& queue = commands.newQueue();
+					sponzaModel.submit(queue, depthShader, LodView::orthographic(model, region.projection, (float)region.height, LodPass::Shadow),
+						RenderPass::Shadow, 1.0f, &region.casterFrustum, &maskedDepthShader);
+					commands.drawQueue(queue);
+				}
+				// the static depth into the sampled layer, dynamic casters would draw over it into
+				// framebuffers[i] with cascade.viewProjection; this scene has none
+				commands.call([&shadowMap, i] { shadowMap.copyStatic(i); });
+			});
+		}
+		buffers.push_back(&sceneCommands);
+		passes.push_back([&](CommandBuffer& commands) {
+			commands.bindFramebuffer(GL_FRAMEBUFFER, 0);
+			commands.viewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+			commands.clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			commands.updateUniformBuffer(frameBuffer, &frame);
+			commands.updateUniformBuffer(shadowBuffer, &shadows);
+			commands.useProgram(sceneShader);
+			commands.setMat4(sceneShader, "model", model);
+			commands.setVec3(sceneShader, "lightPos", lightPos);
+			commands.bindTextureUnit(MATERIAL_FIRST_FREE_UNIT, GL_TEXTURE_2D_ARRAY, shadowMap.texture);
+			// opaque meshes sorted by state, then front to back for early-Z
+			Frustum cameraFrustum = Frustum::fromMatrix(projection * view);
+			RenderQueue& queue = commands.newQueue();
+			sponzaModel.submit(queue, sceneShader, LodView::perspective(model, camera.Position, projection, (float)SCR_HEIGHT),
+				RenderPass::Opaque, 100.0f, &cameraFrustum);
+			commands.drawQueue(queue);
+		});
+		CommandBuffer::recordAndReplay(buffers, passes);
 
 		//cubeShader.use();
 		//model = glm::mat4(1.0f);
 		//model = glm::translate(model, lightPos + glm::vec3(0.0, 2.0, 0.0));
 		//model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-		//cubeShader.setMat4("projection", projection);
-		//cubeShader.setMat4("view", view);
 		//cubeShader.setMat4("model", model);
 		//
 		//cubeModel.draw(cubeShader);
@@ -206,8 +257,8 @@ int main()
 		//debugShader.use();
 		//debugShader.setFloat("near_plane", near_plane);
 		//debugShader.setFloat("far_plane", far_plane);
-		//glActiveTexture(GL_TEXTURE0);
-		//glBindTexture(GL_TEXTURE_2D, depthMap);
+		//GLState::activeTexture(GL_TEXTURE0);
+		//GLState::bindTexture(GL_TEXTURE_2D, depthMap);
 		//renderQuad();
 
 		// Ⱦպ
@@ -217,12 +268,15 @@ int main()
 		//skyboxShader.setMat4("projection", projection);
 		//skybox.draw(skyboxShader);
 
+		CommandBuffer::endFrame();
+		FrustumCuller::endFrame();
+		shadowMap.endFrame();
+		GLState::endFrame();
 
 		glfwSwapBuffers(window);		// ɫ
 		glfwPollEvents();		// ûдʲô¼(롢ƶ)
 	}
 
-	glfwTerminate();		// ȷͷ/ɾ֮ǰķԴ
 	return 0;
 }
 
@@ -244,17 +298,17 @@ void renderQuad()
 		// setup plane VAO
 		glGenVertexArrays(1, &quadVAO);
 		glGenBuffers(1, &quadVBO);
-		glBindVertexArray(quadVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+		GLState::bindVertexArray(quadVAO);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, quadVBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(1);
 		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 	}
-	glBindVertexArray(quadVAO);
+	GLState::bindVertexArray(quadVAO);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
+	GLState::bindVertexArray(0);
 }
 
 
@@ -285,7 +339,7 @@ void processInput(GLFWwindow* window)
 */
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
+	GLState::viewport(0, 0, width, height);
 }
 
 
@@ -352,6 +406,14 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 
 	// Ԥ		
 	Prefab grassPrefab("models/grass/grass.obj", modelMatrices, amount);
+	delete[] modelMatrices;		// the prefab keeps its own copy
 
 	Shader grassShader("glsl/grass.vert", "glsl/grass.frag");
+
+	// in the render loop: instances are culled and compacted on the GPU, then drawn
+	grassShader.use();
+	grassShader.setMat4("projection", projection);
+	grassShader.setMat4("view", view);
+	grassPrefab.draw(grassShader, projection * view);
+	grassPrefab.endFrame();
 */
\ No newline at end of file
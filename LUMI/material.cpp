@@ -0,0 +1,105 @@
+#include <glad/glad.h>
+#include <cstring>
+
+#include "material.h"
+#include "gl_state.h"
+#include "texture_cooker.h"
+
+
+namespace
+{
+    // sampler type names by slot, the uniform of a slot is the name followed by 1
+    const char* const SLOT_NAMES[MATERIAL_SLOT_COUNT] = {
+        "texture_diffuse", "texture_specular", "texture_normal", "texture_height"
+    };
+
+    vector<Material>& records()
+    {
+        static vector<Material> materials;
+        return materials;
+    }
+}
+
+
+unsigned int MaterialLibrary::add(const Material& material)
+{
+    // a model has a few dozen materials, a linear search at load time is enough
+    vector<Material>& materials = records();
+    for (size_t i = 0; i < materials.size(); i++)
+        if (memcmp(&materials[i], &material, sizeof(Material)) == 0)
+            return static_cast<unsigned int>(i);
+    materials.push_back(material);
+    return static_cast<unsigned int>(materials.size() - 1);
+}
+
+
+const Material& MaterialLibrary::get(unsigned int id)
+{
+    return records()[id];
+}
+
+
+void MaterialLibrary::bind(unsigned int id)
+{
+    const Material& material = records()[id];
+    for (unsigned int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+        GLState::bindTextureUnit(slot, material.target, material.textures[slot]);
+}
+
+
+bool MaterialLibrary::isAlphaTested(unsigned int id)
+{
+    return records()[id].alphaTested != 0;
+}
+
+
+bool MaterialLibrary::hasAlpha(unsigned int texture)
+{
+    if (texture == 0)
+        return false;
+    GLState::activeTexture(GL_TEXTURE0);
+    GLState::bindTexture(GL_TEXTURE_2D, texture);
+    GLint format = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+    return format == GL_RGBA || format == GL_RGBA8 || format == GL_SRGB_ALPHA || format == GL_SRGB8_ALPHA8 ||
+        format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT || format == GL_COMPRESSED_RGBA_BPTC_UNORM;
+}
+
+
+size_t MaterialLibrary::size()
+{
+    return records().size();
+}
+
+
+int MaterialLibrary::samplerUnit(const string& uniformName)
+{
+    for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+    {
+        size_t length = strlen(SLOT_NAMES[slot]);
+        if (uniformName.compare(0, length, SLOT_NAMES[slot]) != 0)
+            continue;
+        if (uniformName.compare(length, string::npos, "1") == 0 ||
+            uniformName.compare(length, string::npos, "_array") == 0)
+            return slot;
+    }
+    return -1;
+}
+
+
+MaterialSlot MaterialLibrary::slotOf(const string& typeName)
+{
+    for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+        if (typeName == SLOT_NAMES[slot])
+            return static_cast<MaterialSlot>(slot);
+    return MATERIAL_SLOT_COUNT;
+}
+
+
+MaterialParams MaterialLibrary::defaultParams()
+{
+    MaterialParams params;
+    params.diffuseColor = glm::vec4(1.0f);
+    params.specularColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    return params;
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+// fixed texture unit of every material texture, whatever the material binds
+enum MaterialSlot
+{
+    MATERIAL_SLOT_DIFFUSE,
+    MATERIAL_SLOT_SPECULAR,
+    MATERIAL_SLOT_NORMAL,
+    MATERIAL_SLOT_HEIGHT,
+    MATERIAL_SLOT_COUNT
+};
+
+// units below this one belong to materials, other textures of a pass go from here on
+#define MATERIAL_FIRST_FREE_UNIT MATERIAL_SLOT_COUNT
+
+
+// constant factors of a material, stored as is in the mesh cache
+struct MaterialParams
+{
+    glm::vec4 diffuseColor;     // rgb, opacity in a
+    glm::vec4 specularColor;    // rgb, shininess in a
+};
+
+struct Material
+{
+    unsigned int   textures[MATERIAL_SLOT_COUNT];   // GL ids by slot, 0 where the material has no map
+    GLenum         target;                          // GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY for texture_array.h
+    // 1 when the diffuse map's alpha cuts the surface out (foliage, chains), depth passes
+    // then need its texture; an int so records compare without padding
+    unsigned int   alphaTested;
+    MaterialParams params;
+};
+
+
+/*
+* Process wide table of immutable material records.
+*
+* Models build one record per material while they load and meshes keep only
+* its id. Records are compared by content, so identical materials (within a
+* model or across models) share an id and the id alone tells whether two
+* draws bind the same textures. Binding is one texture bind per slot on a
+* fixed unit: shaders get their texture_<type>1 (or texture_<type>_array)
+* samplers pointed at those units once after linking
+* (Shader::bindMaterialSamplers), nothing is looked up by name while drawing. Like GLState it is only used from the GL thread.
+*/
+class MaterialLibrary
+{
+public:
+    // id of an identical record, added if there is none
+    static unsigned int add(const Material& material);
+
+    static const Material& get(unsigned int id);
+
+    // every slot on its unit, unused slots unbound
+    static void bind(unsigned int id);
+
+    // records never change once added, so this may be read from any thread while nothing loads
+    static bool isAlphaTested(unsigned int id);
+
+    // the 2D texture has an alpha channel (uncompressed RGBA, BC3 or BC7)
+    static bool hasAlpha(unsigned int texture);
+
+    static size_t size();
+
+    // unit of a material sampler uniform ("texture_diffuse1", "texture_diffuse_array"),
+    // -1 for any other name
+    static int samplerUnit(const string& uniformName);
+
+    // slot of an Assimp texture type name ("texture_diffuse"), MATERIAL_SLOT_COUNT if unknown
+    static MaterialSlot slotOf(const string& typeName);
+
+    // white, opaque, no specular
+    static MaterialParams defaultParams();
+};
\ No newline at end of file
@@ -1,82 +1,421 @@
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "geometry_batch.h"
+#include "gl_state.h"
 #include "mesh.h"
 
 
-void Mesh::draw(Shader& shader)
+VertexLayout VertexLayout::describe(VertexFormat format, bool skinned)
+{
+    VertexLayout layout;
+    layout.format = format;
+    layout.skinStride = 0;
+    if (format == VertexFormat::Full)
+    {
+        layout.stride = sizeof(Vertex);
+        layout.attributes = {
+            { 0, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, Position) },
+            { 1, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, Normal) },
+            { 2, 2, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, TexCoords) },
+            { 3, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, Tangent) },
+            { 4, 3, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, Bitangent) },
+            { 5, 4, GL_INT, GL_FALSE, true, offsetof(Vertex, m_BoneIDs) },
+            { 6, 4, GL_FLOAT, GL_FALSE, false, offsetof(Vertex, m_Weights) }
+        };
+        return layout;
+    }
+
+    layout.stride = sizeof(CompactVertex);
+    layout.attributes = {
+        { 0, 3, GL_FLOAT, GL_FALSE, false, offsetof(CompactVertex, Position) },
+        { 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, false, offsetof(CompactVertex, Normal) },
+        { 2, 2, GL_HALF_FLOAT, GL_FALSE, false, offsetof(CompactVertex, TexCoords) },
+        { 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, false, offsetof(CompactVertex, Tangent) }
+    };
+    if (skinned)
+    {
+        layout.skinStride = sizeof(SkinVertex);
+        layout.skinAttributes = {
+            { 5, 4, GL_UNSIGNED_BYTE, GL_FALSE, true, offsetof(SkinVertex, BoneIDs) },
+            { 6, 4, GL_UNSIGNED_BYTE, GL_TRUE, false, offsetof(SkinVertex, Weights) }
+        };
+    }
+    return layout;
+}
+
+
+static CompactVertex packVertex(const Vertex& vertex)
+{
+    CompactVertex packed;
+    packed.Position = vertex.Position;
+    packed.Normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.Normal, 0.0f));
+    // handedness of the tangent frame goes into w
+    float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent) < 0.0f ? -1.0f : 1.0f;
+    packed.Tangent = glm::packSnorm3x10_1x2(glm::vec4(vertex.Tangent, handedness));
+    packed.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+    packed.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    return packed;
+}
+
+
+void VertexLayout::pack(const Vertex* vertices, size_t count, vector<unsigned char>& out) const
+{
+    size_t offset = out.size();
+    out.resize(offset + count * stride);
+    if (format == VertexFormat::Full)
+    {
+        memcpy(&out[offset], vertices, count * sizeof(Vertex));
+        return;
+    }
+    CompactVertex* packed = reinterpret_cast<CompactVertex*>(&out[offset]);
+    for (size_t i = 0; i < count; i++)
+        packed[i] = packVertex(vertices[i]);
+}
+
+
+void VertexLayout::packSkin(const Vertex* vertices, size_t count, vector<SkinVertex>& out)
+{
+    size_t offset = out.size();
+    out.resize(offset + count);
+    for (size_t i = 0; i < count; i++)
+    {
+        for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+        {
+            out[offset + i].BoneIDs[j] = static_cast<uint8_t>(glm::clamp(vertices[i].m_BoneIDs[j], 0, 255));
+            out[offset + i].Weights[j] = static_cast<uint8_t>(glm::clamp(vertices[i].m_Weights[j], 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+    }
+}
+
+
+bool VertexLayout::hasSkin(const Vertex* vertices, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            if (vertices[i].m_Weights[j] != 0.0f)
+                return true;
+    return false;
+}
+
+
+void VertexLayout::packPositions(const Vertex* vertices, size_t count, vector<glm::vec3>& out)
+{
+    size_t offset = out.size();
+    out.resize(offset + count);
+    for (size_t i = 0; i < count; i++)
+        out[offset + i] = vertices[i].Position;
+}
+
+
+void VertexLayout::enable(const vector<VertexAttribute>& attributes, GLsizei stride)
 {
-    // bind appropriate textures
-    unsigned int diffuseNr = 1;
-    unsigned int specularNr = 1;
-    unsigned int normalNr = 1;
-    unsigned int heightNr = 1;
-    for (unsigned int i = 0; i < textures.size(); i++)
+    for (const VertexAttribute& attribute : attributes)
     {
-        // ǰԪ
-        glActiveTexture(GL_TEXTURE0 + i);
-        //  number (the N in diffuse_textureN)
-        string number;
-        string name = textures[i].type;
-        if (name == "texture_diffuse")
-            number = std::to_string(diffuseNr++);
-        else if (name == "texture_specular")
-            number = std::to_string(specularNr++);
-        else if (name == "texture_normal")
-            number = std::to_string(normalNr++);
-        else if (name == "texture_height")
-            number = std::to_string(heightNr++);
-
-        //  sampler ȷԪ
-        glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
-        // 
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        glEnableVertexAttribArray(attribute.location);
+        if (attribute.integer)
+            glVertexAttribIPointer(attribute.location, attribute.components, attribute.type,
+                stride, (void*)attribute.offset);
+        else
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type,
+                attribute.normalized, stride, (void*)attribute.offset);
     }
+}
+
+
+void VertexLayout::enablePositions()
+{
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+}
+
+
+Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, unsigned int material,
+    vector<MeshLod> lods, GeometryBatch& batch)
+{
+    this->vertices = move(vertices);
+    this->indices = move(indices);
+    this->material = material;
+    this->vertexCount = static_cast<unsigned int>(this->vertices.size());
+    setLods(lods, static_cast<unsigned int>(this->indices.size()));
+    computeBounds();
+    VAO = depthVAO = VBO = EBO = skinVBO = positionVBO = 0;
+    indexType = GL_UNSIGNED_INT;
+
+    MeshRange range = batch.add(this->vertices.data(), this->vertices.size(),
+        this->indices.data(), this->indices.size());
+    firstIndex = range.firstIndex;
+    baseVertex = range.baseVertex;
+}
+
+
+Mesh::Mesh(const PackedVertices& vertices, const unsigned int* indices, unsigned int indexCount,
+    unsigned int material, const glm::vec3& aabbMin, const glm::vec3& aabbMax, float boundingRadius,
+    vector<MeshLod> lods, GeometryBatch& batch)
+{
+    this->material = material;
+    this->vertexCount = static_cast<unsigned int>(vertices.count);
+    setLods(lods, indexCount);
+    this->aabbMin = aabbMin;
+    this->aabbMax = aabbMax;
+    this->boundingRadius = boundingRadius;
+    VAO = depthVAO = VBO = EBO = skinVBO = positionVBO = 0;
+    indexType = GL_UNSIGNED_INT;
+
+    MeshRange range = batch.add(vertices, indices, indexCount);
+    firstIndex = range.firstIndex;
+    baseVertex = range.baseVertex;
+}
+
+
+LodView LodView::perspective(const glm::mat4& model, const glm::vec3& viewPosition,
+    const glm::mat4& projection, float viewportHeight, LodPass pass)
+{
+    LodView view;
+    view.model = model;
+    view.viewPosition = viewPosition;
+    view.pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+    view.isOrthographic = false;
+    view.bias = pass == LodPass::Shadow ? MESH_LOD_BIAS_SHADOW : (pass == LodPass::SSAO ? MESH_LOD_BIAS_SSAO : 1.0f);
+    return view;
+}
+
+
+LodView LodView::orthographic(const glm::mat4& model, const glm::mat4& projection,
+    float viewportHeight, LodPass pass)
+{
+    LodView view = perspective(model, glm::vec3(0.0f), projection, viewportHeight, pass);
+    view.isOrthographic = true;
+    return view;
+}
+
+
+unsigned int Mesh::selectLod(const LodView& view) const
+{
+    if (lods.size() < 2)
+        return 0;
+
+    // world space bounding sphere, non uniform scales are covered by the largest axis
+    glm::vec3 center = glm::vec3(view.model * glm::vec4((aabbMin + aabbMax) * 0.5f, 1.0f));
+    float scale = max(glm::length(glm::vec3(view.model[0])),
+        max(glm::length(glm::vec3(view.model[1])), glm::length(glm::vec3(view.model[2]))));
+    glm::vec3 size = aabbMax - aabbMin;
+    float radius = glm::length(size) * 0.5f * scale;
+    float extent = max(size.x, max(size.y, size.z)) * scale;
+
+    // distance to the closest point of the sphere, inside it everything is full detail
+    float distance = 1.0f;
+    if (!view.isOrthographic)
+    {
+        distance = glm::length(center - view.viewPosition) - radius;
+        if (distance <= 0.0f)
+            return 0;
+    }
+
+    // projected size of the mesh extent, lod errors are fractions of it
+    float projectedExtent = extent * view.pixelsPerUnit / distance;
+    if (projectedExtent <= 0.0f)
+        return static_cast<unsigned int>(lods.size() - 1);
+    float allowedError = MESH_LOD_PIXEL_ERROR * view.bias / projectedExtent;
+
+    unsigned int lod = 0;
+    while (lod + 1 < lods.size() && lods[lod + 1].error <= allowedError)
+        lod++;
+    return lod;
+}
+
+
+void Mesh::draw(unsigned int lod)
+{
+    MaterialLibrary::bind(material);
 
     // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    GLState::bindVertexArray(VAO);
+    glDrawElementsBaseVertex(GL_TRIANGLES, lods[lod].indexCount, indexType, indexOffset(lod), baseVertex);
+}
 
-    // һɺõĬϵһֺϰ
-    glActiveTexture(GL_TEXTURE0);
+
+void Mesh::drawDepth(unsigned int lod)
+{
+    GLState::bindVertexArray(depthVAO);
+    glDrawElementsBaseVertex(GL_TRIANGLES, lods[lod].indexCount, indexType, indexOffset(lod), baseVertex);
 }
 
 
-void Mesh::setupMesh()
+void Mesh::setupMesh(const Vertex* vertexData, size_t vertexCount,
+    const unsigned int* indexData, size_t indexCount, VertexFormat format)
 {
+    // װؽ㻺
+    vector<unsigned char> packed;
+    vector<SkinVertex> skin;
+    vector<glm::vec3> positions;
+    bool skinned = format == VertexFormat::Compact && VertexLayout::hasSkin(vertexData, vertexCount);
+    VertexLayout::describe(format, skinned).pack(vertexData, vertexCount, packed);
+    if (skinned)
+        VertexLayout::packSkin(vertexData, vertexCount, skin);
+#if MESH_DEPTH_STREAM
+    VertexLayout::packPositions(vertexData, vertexCount, positions);
+#endif
+
+    PackedVertices vertices = { format, packed.data(), skinned ? skin.data() : nullptr, positions.data(), vertexCount };
+    uploadMesh(vertices, indexData, indexCount);
+}
+
+
+void Mesh::uploadMesh(const PackedVertices& vertices, const unsigned int* indexData, size_t indexCount)
+{
+    layout = VertexLayout::describe(vertices.format, vertices.skin != nullptr);
+    firstIndex = 0;
+    baseVertex = 0;
+    skinVBO = 0;
+    positionVBO = 0;
+    depthVAO = 0;
+
     // /
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
 
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(VAO);
 
-    // װؽ㻺
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.count * layout.stride, vertices.data, GL_STATIC_DRAW);
+    // vertex Positions
+    VertexLayout::enable(layout.attributes, layout.stride);
+
+    if (!layout.skinAttributes.empty())
+    {
+        glGenBuffers(1, &skinVBO);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, skinVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.count * sizeof(SkinVertex), vertices.skin, GL_STATIC_DRAW);
+        VertexLayout::enable(layout.skinAttributes, layout.skinStride);
+    }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    // 16 bit indices whenever every vertex can be addressed
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    if (vertices.count <= 65536)
+    {
+        indexType = GL_UNSIGNED_SHORT;
+        vector<uint16_t> shortIndices(indexData, indexData + indexCount);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint16_t), shortIndices.data(), GL_STATIC_DRAW);
+    }
+    else
+    {
+        indexType = GL_UNSIGNED_INT;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+    }
 
-    // öָ
-    // vertex Positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    // vertex normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-    // vertex texture coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-    // vertex tangent
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-    // vertex bitangent
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-    // ids
-    glEnableVertexAttribArray(5);
-    glVertexAttribIPointer(5, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-    // weights
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-    glBindVertexArray(0);
-}
\ No newline at end of file
+#if MESH_DEPTH_STREAM
+    // same indices, only the positions: depth passes fetch 12 bytes a vertex
+    glGenVertexArrays(1, &depthVAO);
+    glGenBuffers(1, &positionVBO);
+    GLState::bindVertexArray(depthVAO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.count * sizeof(glm::vec3), vertices.positions, GL_STATIC_DRAW);
+    VertexLayout::enablePositions();
+    GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+#else
+    depthVAO = VAO;
+#endif
+    GLState::bindVertexArray(0);
+}
+
+
+void Mesh::addTo(GeometryBatch& batch)
+{
+    MeshRange range = batch.add(vertices.data(), vertices.size(), indices.data(), indices.size());
+    firstIndex = range.firstIndex;
+    baseVertex = range.baseVertex;
+}
+
+
+void Mesh::addTo(GeometryBatch& batch, const PackedVertices& vertices, const unsigned int* indices,
+    unsigned int indexCount)
+{
+    MeshRange range = batch.add(vertices, indices, indexCount);
+    firstIndex = range.firstIndex;
+    baseVertex = range.baseVertex;
+}
+
+
+void Mesh::attach(unsigned int VAO, unsigned int depthVAO, GLenum indexType, const VertexLayout& layout)
+{
+    if (VBO != 0)
+    {
+        GLState::deleteVertexArrays(1, &this->VAO);
+        GLState::deleteBuffers(1, &VBO);
+        GLState::deleteBuffers(1, &EBO);
+        if (skinVBO != 0)
+            GLState::deleteBuffers(1, &skinVBO);
+        if (positionVBO != 0)
+        {
+            GLState::deleteVertexArrays(1, &this->depthVAO);
+            GLState::deleteBuffers(1, &positionVBO);
+        }
+        VBO = EBO = skinVBO = positionVBO = 0;
+    }
+    this->VAO = VAO;
+    this->depthVAO = depthVAO;
+    this->indexType = indexType;
+    this->layout = layout;
+}
+
+
+void Mesh::releaseGeometry()
+{
+    vector<Vertex>().swap(vertices);
+    vector<unsigned int>().swap(indices);
+}
+
+
+size_t Mesh::cpuBytes() const
+{
+    size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) +
+        lods.capacity() * sizeof(MeshLod);
+    return bytes;
+}
+
+
+void Mesh::setLods(const vector<MeshLod>& lods, unsigned int totalIndexCount)
+{
+    this->lods = lods;
+    if (this->lods.empty())
+    {
+        MeshLod full = { 0, totalIndexCount, 0.0f };
+        this->lods.push_back(full);
+    }
+    indexCount = this->lods[0].indexCount;
+}
+
+
+void Mesh::computeBounds()
+{
+    aabbMin = glm::vec3(0.0f);
+    aabbMax = glm::vec3(0.0f);
+    boundingRadius = 0.0f;
+    if (vertices.empty())
+        return;
+
+    aabbMin = aabbMax = vertices[0].Position;
+    for (size_t i = 1; i < vertices.size(); i++)
+    {
+        aabbMin = glm::min(aabbMin, vertices[i].Position);
+        aabbMax = glm::max(aabbMax, vertices[i].Position);
+    }
+    computeRadius(vertices.data(), vertices.size());
+}
+
+
+void Mesh::computeRadius(const Vertex* vertexData, size_t vertexCount)
+{
+    glm::vec3 center = (aabbMin + aabbMax) * 0.5f;
+    float radius2 = 0.0f;
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        glm::vec3 offset = vertexData[i].Position - center;
+        radius2 = max(radius2, glm::dot(offset, offset));
+    }
+    boundingRadius = sqrt(radius2);
+}
@@ -2,13 +2,19 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include "material.h"
 #include "shader.h"
 using namespace std;
 
 #define MAX_BONE_INFLUENCE 4
+// vertex format used for meshes that do not ask for a specific one
+#define MESH_VERTEX_FORMAT VertexFormat::Compact
+// give every mesh a tightly packed position stream (12 bytes a vertex) for depth only passes
+#define MESH_DEPTH_STREAM 1
 
 struct Vertex
 {
@@ -23,6 +29,81 @@ struct Vertex
     float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// GPU side vertex layouts, the CPU side always works with Vertex
+enum class VertexFormat
+{
+    Full,       // Vertex as is, 88 bytes, skin attributes always present
+    Compact     // 24 bytes, see CompactVertex, skin data in a separate stream when used
+};
+
+// float position, 10:10:10:2 snorm normal and tangent, half float uv.
+// The bitangent is not stored: bitangent = cross(normal, tangent.xyz) * sign(tangent.w)
+struct CompactVertex
+{
+    glm::vec3 Position;
+    uint32_t  Normal;
+    uint32_t  Tangent;
+    uint16_t  TexCoords[2];
+};
+
+// optional second stream for skinned meshes, up to 256 bones, unorm weights
+struct SkinVertex
+{
+    uint8_t BoneIDs[MAX_BONE_INFLUENCE];
+    uint8_t Weights[MAX_BONE_INFLUENCE];
+};
+
+// vertices already converted to a GPU layout, e.g. cooked into a mesh cache: the main stream,
+// the Compact skin stream (null without bone data, and with Full which interleaves it) and the
+// depth stream
+struct PackedVertices
+{
+    VertexFormat         format;
+    const unsigned char* data;
+    const SkinVertex*    skin;
+    const glm::vec3*     positions;
+    size_t               count;
+};
+
+struct VertexAttribute
+{
+    GLuint    location;
+    GLint     components;
+    GLenum    type;
+    GLboolean normalized;
+    bool      integer;      // glVertexAttribIPointer
+    size_t    offset;
+};
+
+// attribute locations are shared by all formats: 0 position, 1 normal, 2 uv,
+// 3 tangent, 4 bitangent (Full only), 5 bone ids, 6 weights; batches with texture
+// arrays add 7 material layers
+struct VertexLayout
+{
+    VertexFormat            format;
+    GLsizei                 stride;
+    vector<VertexAttribute> attributes;
+    // second stream, empty when the mesh has no skin data or the format interleaves it
+    GLsizei                 skinStride;
+    vector<VertexAttribute> skinAttributes;
+
+    static VertexLayout describe(VertexFormat format, bool skinned);
+
+    // append vertices converted to this layout's main stream
+    void pack(const Vertex* vertices, size_t count, vector<unsigned char>& out) const;
+    static void packSkin(const Vertex* vertices, size_t count, vector<SkinVertex>& out);
+    static bool hasSkin(const Vertex* vertices, size_t count);
+    // append the positions alone, the depth stream
+    static void packPositions(const Vertex* vertices, size_t count, vector<glm::vec3>& out);
+
+    // attribute pointers into the buffer bound to GL_ARRAY_BUFFER
+    static void enable(const vector<VertexAttribute>& attributes, GLsizei stride);
+    // location 0 of a packPositions stream bound to GL_ARRAY_BUFFER
+    static void enablePositions();
+};
+
+class GeometryBatch;
+
 struct Texture
 {
     unsigned int id;
@@ -30,32 +111,163 @@ struct Texture
     string path;
 };
 
+// levels of detail stored per mesh, LOD 0 is the full mesh
+#define MESH_MAX_LODS 4
+// LOD selection: largest simplification error allowed on screen, in pixels
+#define MESH_LOD_PIXEL_ERROR 1.0f
+// passes that do not need the silhouette exact accept proportionally larger errors
+#define MESH_LOD_BIAS_SHADOW 4.0f
+#define MESH_LOD_BIAS_SSAO 2.0f
+
+// one index buffer of a mesh, all levels share the mesh's vertices
+struct MeshLod
+{
+    unsigned int firstIndex;    // relative to the mesh's own first index
+    unsigned int indexCount;
+    float        error;         // simplification error relative to the mesh's largest extent
+};
+
+enum class LodPass
+{
+    Main,
+    Shadow,
+    SSAO
+};
+
+// what the geometry is projected with, drives LOD selection
+struct LodView
+{
+    glm::mat4 model;            // model to world
+    glm::vec3 viewPosition;     // world space, unused for orthographic views
+    float     pixelsPerUnit;    // screen size of one world unit at distance 1 (at any distance if orthographic)
+    bool      isOrthographic;
+    float     bias;             // multiplies MESH_LOD_PIXEL_ERROR
+
+    static LodView perspective(const glm::mat4& model, const glm::vec3& viewPosition,
+        const glm::mat4& projection, float viewportHeight, LodPass pass = LodPass::Main);
+    static LodView orthographic(const glm::mat4& model, const glm::mat4& projection,
+        float viewportHeight, LodPass pass = LodPass::Shadow);
+};
+
 class Mesh
 {
 public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
-    vector<Texture>      textures;
+    // MaterialLibrary id
+    unsigned int         material;
     unsigned int         VAO;
+    // positions only over the same index buffer (MESH_DEPTH_STREAM), VAO without the stream
+    unsigned int         depthVAO;
+    // kept when the CPU side geometry is released
+    unsigned int         vertexCount;
+    unsigned int         indexCount;
+    // GL_UNSIGNED_SHORT for meshes with at most 65536 vertices
+    GLenum               indexType;
+    VertexLayout         layout;
+    // range inside the index/vertex buffers, non zero when the buffers are shared
+    unsigned int         firstIndex;
+    int                  baseVertex;
+    // object-space bounding box, and the radius of a bounding sphere around its center
+    glm::vec3            aabbMin;
+    glm::vec3            aabbMax;
+    float                boundingRadius;
+    // at least one level; indices (and the index buffer) hold every level back to back,
+    // indexCount is the size of LOD 0
+    vector<MeshLod>      lods;
 
 
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices,
-        vector<Texture> textures)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, unsigned int material,
+        vector<MeshLod> lods = vector<MeshLod>(), VertexFormat format = MESH_VERTEX_FORMAT)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = move(vertices);
+        this->indices = move(indices);
+        this->material = material;
+        this->vertexCount = static_cast<unsigned int>(this->vertices.size());
+        setLods(lods, static_cast<unsigned int>(this->indices.size()));
+        computeBounds();
 
         //  vertex buffers  attribute pointer
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(),
+            this->indices.data(), this->indices.size(), format);
+    }
+
+    // upload packed geometry straight from caller-owned memory (e.g. a mapped mesh cache),
+    // the CPU side vertices/indices stay empty
+    Mesh(const PackedVertices& vertices, const unsigned int* indices, unsigned int indexCount,
+        unsigned int material, const glm::vec3& aabbMin, const glm::vec3& aabbMax, float boundingRadius,
+        vector<MeshLod> lods = vector<MeshLod>())
+    {
+        this->material = material;
+        this->vertexCount = static_cast<unsigned int>(vertices.count);
+        setLods(lods, indexCount);
+        this->aabbMin = aabbMin;
+        this->aabbMax = aabbMax;
+        this->boundingRadius = boundingRadius;
+
+        uploadMesh(vertices, indices, indexCount);
+    }
+
+    // owns GL handles and possibly large vectors: moved, never copied
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
+
+    // geometry goes into a batch shared with other meshes, the GL objects are
+    // attached once the batch is uploaded
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, unsigned int material,
+        vector<MeshLod> lods, GeometryBatch& batch);
+
+    Mesh(const PackedVertices& vertices, const unsigned int* indices, unsigned int indexCount,
+        unsigned int material, const glm::vec3& aabbMin, const glm::vec3& aabbMax, float boundingRadius,
+        vector<MeshLod> lods, GeometryBatch& batch);
+
+    // stage the CPU side geometry of a mesh that was uploaded on its own into a batch,
+    // the range only matches the batch's buffers, so upload the batch before the next draw
+    void addTo(GeometryBatch& batch);
+    // the same for a mesh uploaded from packed geometry, which has no CPU side copy
+    void addTo(GeometryBatch& batch, const PackedVertices& vertices, const unsigned int* indices,
+        unsigned int indexCount);
+
+    // use buffers owned by a GeometryBatch, buffers of the mesh's own are deleted
+    void attach(unsigned int VAO, unsigned int depthVAO, GLenum indexType, const VertexLayout& layout);
+
+    // free the CPU side vertices/indices once nothing needs them any more (uploaded,
+    // cached, batched), counts, levels and bounds stay
+    void releaseGeometry();
+
+    // heap memory held by this mesh on the CPU
+    size_t cpuBytes() const;
+
+    // byte offset of a level's first index for glDrawElements*
+    void* indexOffset(unsigned int lod = 0) const
+    {
+        size_t first = size_t(firstIndex) + lods[lod].firstIndex;
+        return (void*)(first * (indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int)));
     }
 
+    // coarsest level whose error stays below the pixel threshold given the projected bounds
+    unsigned int selectLod(const LodView& view) const;
+
     // Ⱦ
-    void draw(Shader& shader);
+    void draw(unsigned int lod = 0);
+
+    // positions only, no material: depth of an opaque caster with the caller's shader
+    void drawDepth(unsigned int lod = 0);
 
 private:
+    void setLods(const vector<MeshLod>& lods, unsigned int totalIndexCount);
+
     // ʼеĻ/
-    void setupMesh();
+    void setupMesh(const Vertex* vertexData, size_t vertexCount,
+        const unsigned int* indexData, size_t indexCount, VertexFormat format);
+    void uploadMesh(const PackedVertices& vertices, const unsigned int* indexData, size_t indexCount);
+
+    void computeBounds();
+
+    // tight radius around the box center, the box has to be set
+    void computeRadius(const Vertex* vertexData, size_t vertexCount);
 
-    unsigned int VBO, EBO;
+    unsigned int VBO, EBO, skinVBO, positionVBO;
 };
\ No newline at end of file
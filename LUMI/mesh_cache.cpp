@@ -0,0 +1,479 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "mesh_cache.h"
+
+// 'LMSH'
+const uint32_t MESH_CACHE_MAGIC = 0x48534D4C;
+// every stream in the file starts on this boundary
+const uint64_t MESH_CACHE_ALIGNMENT = 16;
+
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t importFlags;
+    uint64_t sourceSize;
+    int64_t  sourceMtime;
+    uint64_t sourceHash;
+    uint32_t meshCount;
+    uint32_t vertexFormat;
+};
+
+struct CacheMeshRecord
+{
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    uint32_t lodCount;
+    float    aabbMin[3];
+    float    aabbMax[3];
+    float    boundingRadius;
+    // levels of detail inside the index stream, which holds every level back to back
+    uint32_t lodFirstIndex[MESH_MAX_LODS];
+    uint32_t lodIndexCount[MESH_MAX_LODS];
+    float    lodError[MESH_MAX_LODS];
+    MaterialParams materialParams;
+    // byte offsets from the start of the file; the main vertex stream in the header's format,
+    // SkinVertex (0: no skin stream), glm::vec3 positions and the indices
+    uint64_t vertexOffset;
+    uint64_t skinOffset;
+    uint64_t positionOffset;
+    uint64_t indexOffset;
+    // texture refs: textureCount x { uint32 typeLength, uint32 pathLength, type, path }
+    uint64_t textureOffset;
+};
+
+
+static bool statSource(const string& path, uint64_t& size, int64_t& mtime)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+#endif
+    size = static_cast<uint64_t>(st.st_size);
+    mtime = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+
+// FNV-1a over the whole source file
+static bool hashSource(const string& path, uint64_t& hash)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+        return false;
+
+    hash = 14695981039346656037ull;
+    vector<char> chunk(1 << 20);
+    while (file)
+    {
+        file.read(chunk.data(), chunk.size());
+        streamsize count = file.gcount();
+        for (streamsize i = 0; i < count; i++)
+        {
+            hash ^= static_cast<unsigned char>(chunk[i]);
+            hash *= 1099511628211ull;
+        }
+    }
+    return true;
+}
+
+
+// rewrites the source time in a cache's header, the file must not be mapped
+static bool writeSourceMtime(const string& cachePath, int64_t mtime)
+{
+    fstream file(cachePath, ios::in | ios::out | ios::binary);
+    if (!file)
+        return false;
+    file.seekp(offsetof(CacheHeader, sourceMtime));
+    file.write(reinterpret_cast<const char*>(&mtime), sizeof(mtime));
+    return static_cast<bool>(file);
+}
+
+
+// main stream size of a cooked vertex
+static uint32_t cookedVertexSize()
+{
+    return static_cast<uint32_t>(VertexLayout::describe(MESH_VERTEX_FORMAT, false).stride);
+}
+
+
+static uint64_t alignUp(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+}
+
+
+MeshCache::MeshCache() : data(nullptr), size(0)
+#ifdef _WIN32
+    , fileHandle(nullptr), mappingHandle(nullptr)
+#endif
+{
+}
+
+
+MeshCache::~MeshCache()
+{
+    close();
+}
+
+
+bool MeshCache::open(const string& sourcePath, unsigned int importFlags)
+{
+    close();
+
+    uint64_t sourceSize;
+    int64_t sourceMtime;
+    if (!statSource(sourcePath, sourceSize, sourceMtime))
+        return false;
+    if (!map(sourcePath + MESH_CACHE_EXTENSION))
+        return false;
+
+    // validate header
+    if (size < sizeof(CacheHeader))
+    {
+        close();
+        return false;
+    }
+    CacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION ||
+        header.vertexFormat != static_cast<uint32_t>(MESH_VERTEX_FORMAT) || header.vertexSize != cookedVertexSize() ||
+        header.importFlags != importFlags)
+    {
+        close();
+        return false;
+    }
+
+    // stale source check
+    if (header.sourceSize != sourceSize)
+    {
+        close();
+        return false;
+    }
+    if (header.sourceMtime != sourceMtime)
+    {
+        uint64_t sourceHash;
+        if (!hashSource(sourcePath, sourceHash) || sourceHash != header.sourceHash)
+        {
+            close();
+            return false;
+        }
+        // only touched (copy, checkout): record the new time so later launches skip the hash
+        close();
+        if (!writeSourceMtime(sourcePath + MESH_CACHE_EXTENSION, sourceMtime))
+            cout << "MESH_CACHE:: could not refresh the source time of " << sourcePath << MESH_CACHE_EXTENSION << endl;
+        if (!map(sourcePath + MESH_CACHE_EXTENSION))
+            return false;
+    }
+
+    // mesh table
+    uint64_t recordsEnd = sizeof(CacheHeader) + uint64_t(header.meshCount) * sizeof(CacheMeshRecord);
+    if (recordsEnd > size)
+    {
+        close();
+        return false;
+    }
+    const CacheMeshRecord* records = reinterpret_cast<const CacheMeshRecord*>(data + sizeof(CacheHeader));
+    meshes.resize(header.meshCount);
+    for (unsigned int i = 0; i < header.meshCount; i++)
+    {
+        const CacheMeshRecord& record = records[i];
+        if (record.vertexOffset + uint64_t(record.vertexCount) * header.vertexSize > size ||
+            record.skinOffset + uint64_t(record.skinOffset ? record.vertexCount : 0) * sizeof(SkinVertex) > size ||
+            record.positionOffset + uint64_t(record.vertexCount) * sizeof(glm::vec3) > size ||
+            record.indexOffset + uint64_t(record.indexCount) * sizeof(unsigned int) > size)
+        {
+            close();
+            return false;
+        }
+
+        CookedMesh& mesh = meshes[i];
+        mesh.vertices.format = MESH_VERTEX_FORMAT;
+        mesh.vertices.data = data + record.vertexOffset;
+        mesh.vertices.skin = record.skinOffset ? reinterpret_cast<const SkinVertex*>(data + record.skinOffset) : nullptr;
+        mesh.vertices.positions = reinterpret_cast<const glm::vec3*>(data + record.positionOffset);
+        mesh.vertices.count = record.vertexCount;
+        mesh.indices = reinterpret_cast<const unsigned int*>(data + record.indexOffset);
+        mesh.indexCount = record.indexCount;
+        mesh.aabbMin = glm::vec3(record.aabbMin[0], record.aabbMin[1], record.aabbMin[2]);
+        mesh.aabbMax = glm::vec3(record.aabbMax[0], record.aabbMax[1], record.aabbMax[2]);
+        mesh.boundingRadius = record.boundingRadius;
+        mesh.material.params = record.materialParams;
+        if (record.lodCount == 0 || record.lodCount > MESH_MAX_LODS)
+        {
+            close();
+            return false;
+        }
+        for (unsigned int l = 0; l < record.lodCount; l++)
+        {
+            MeshLod lod = { record.lodFirstIndex[l], record.lodIndexCount[l], record.lodError[l] };
+            if (uint64_t(lod.firstIndex) + lod.indexCount > record.indexCount)
+            {
+                close();
+                return false;
+            }
+            mesh.lods.push_back(lod);
+        }
+
+        uint64_t offset = record.textureOffset;
+        for (unsigned int t = 0; t < record.textureCount; t++)
+        {
+            uint32_t lengths[2];
+            if (offset + sizeof(lengths) > size)
+            {
+                close();
+                return false;
+            }
+            memcpy(lengths, data + offset, sizeof(lengths));
+            offset += sizeof(lengths);
+            if (offset + uint64_t(lengths[0]) + lengths[1] > size)
+            {
+                close();
+                return false;
+            }
+
+            CookedTexture texture;
+            texture.type.assign(reinterpret_cast<const char*>(data + offset), lengths[0]);
+            offset += lengths[0];
+            texture.path.assign(reinterpret_cast<const char*>(data + offset), lengths[1]);
+            offset += lengths[1];
+            mesh.material.textures.push_back(texture);
+        }
+    }
+    return true;
+}
+
+
+bool MeshCache::write(const string& sourcePath, unsigned int importFlags,
+    const vector<Mesh>& meshes, const vector<CookedMaterial>& materials)
+{
+    if (materials.size() != meshes.size())
+        return false;
+
+    CacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertexSize = cookedVertexSize();
+    header.importFlags = importFlags;
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    header.vertexFormat = static_cast<uint32_t>(MESH_VERTEX_FORMAT);
+    if (!statSource(sourcePath, header.sourceSize, header.sourceMtime) ||
+        !hashSource(sourcePath, header.sourceHash))
+        return false;
+
+    // the streams as they are uploaded
+    struct CookedStreams
+    {
+        vector<unsigned char> vertices;
+        vector<SkinVertex>    skin;
+        vector<glm::vec3>     positions;
+    };
+    vector<CookedStreams> streams(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const vector<Vertex>& vertices = meshes[i].vertices;
+        bool skinned = MESH_VERTEX_FORMAT == VertexFormat::Compact &&
+            VertexLayout::hasSkin(vertices.data(), vertices.size());
+        VertexLayout::describe(MESH_VERTEX_FORMAT, skinned).pack(vertices.data(), vertices.size(), streams[i].vertices);
+        if (skinned)
+            VertexLayout::packSkin(vertices.data(), vertices.size(), streams[i].skin);
+        VertexLayout::packPositions(vertices.data(), vertices.size(), streams[i].positions);
+    }
+
+    // lay out the file: header | mesh table | texture refs | aligned streams
+    vector<CacheMeshRecord> records(meshes.size());
+    uint64_t offset = sizeof(CacheHeader) + meshes.size() * sizeof(CacheMeshRecord);
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const Mesh& mesh = meshes[i];
+        CacheMeshRecord& record = records[i];
+        record = {};
+        record.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+        record.indexCount = static_cast<uint32_t>(mesh.indices.size());
+        record.textureCount = static_cast<uint32_t>(materials[i].textures.size());
+        record.materialParams = materials[i].params;
+        record.lodCount = static_cast<uint32_t>(min(mesh.lods.size(), size_t(MESH_MAX_LODS)));
+        for (unsigned int l = 0; l < record.lodCount; l++)
+        {
+            record.lodFirstIndex[l] = mesh.lods[l].firstIndex;
+            record.lodIndexCount[l] = mesh.lods[l].indexCount;
+            record.lodError[l] = mesh.lods[l].error;
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            record.aabbMin[c] = mesh.aabbMin[c];
+            record.aabbMax[c] = mesh.aabbMax[c];
+        }
+        record.boundingRadius = mesh.boundingRadius;
+        record.textureOffset = offset;
+        for (const CookedTexture& texture : materials[i].textures)
+            offset += 2 * sizeof(uint32_t) + texture.type.size() + texture.path.size();
+    }
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        records[i].vertexOffset = offset = alignUp(offset);
+        offset += streams[i].vertices.size();
+        if (!streams[i].skin.empty())
+        {
+            records[i].skinOffset = offset = alignUp(offset);
+            offset += streams[i].skin.size() * sizeof(SkinVertex);
+        }
+        records[i].positionOffset = offset = alignUp(offset);
+        offset += streams[i].positions.size() * sizeof(glm::vec3);
+        records[i].indexOffset = offset = alignUp(offset);
+        offset += meshes[i].indices.size() * sizeof(unsigned int);
+    }
+
+    // write to a temporary file first so a half written cache is never picked up
+    string cachePath = sourcePath + MESH_CACHE_EXTENSION;
+    string tempPath = cachePath + ".tmp";
+    ofstream file(tempPath, ios::binary | ios::trunc);
+    if (!file)
+    {
+        cout << "MESH_CACHE:: could not write " << tempPath << endl;
+        return false;
+    }
+
+    const char zeros[MESH_CACHE_ALIGNMENT] = {};
+    auto pad = [&]() {
+        uint64_t position = static_cast<uint64_t>(file.tellp());
+        file.write(zeros, alignUp(position) - position);
+    };
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(CacheMeshRecord));
+    for (const CookedMaterial& material : materials)
+    {
+        for (const CookedTexture& texture : material.textures)
+        {
+            uint32_t lengths[2] = { static_cast<uint32_t>(texture.type.size()),
+                static_cast<uint32_t>(texture.path.size()) };
+            file.write(reinterpret_cast<const char*>(lengths), sizeof(lengths));
+            file.write(texture.type.data(), texture.type.size());
+            file.write(texture.path.data(), texture.path.size());
+        }
+    }
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const CookedStreams& cooked = streams[i];
+        pad();
+        file.write(reinterpret_cast<const char*>(cooked.vertices.data()), cooked.vertices.size());
+        if (!cooked.skin.empty())
+        {
+            pad();
+            file.write(reinterpret_cast<const char*>(cooked.skin.data()), cooked.skin.size() * sizeof(SkinVertex));
+        }
+        pad();
+        file.write(reinterpret_cast<const char*>(cooked.positions.data()), cooked.positions.size() * sizeof(glm::vec3));
+        pad();
+        file.write(reinterpret_cast<const char*>(meshes[i].indices.data()), meshes[i].indices.size() * sizeof(unsigned int));
+    }
+    file.close();
+    if (!file)
+    {
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    remove(cachePath.c_str());
+    if (rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+bool MeshCache::map(const string& cachePath)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+    data = static_cast<const unsigned char*>(view);
+    size = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = ::open(cachePath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+        return false;
+    data = static_cast<const unsigned char*>(view);
+    size = static_cast<size_t>(st.st_size);
+#endif
+    return true;
+}
+
+
+void MeshCache::close()
+{
+    meshes.clear();
+    if (!data)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    fileHandle = mappingHandle = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(data), size);
+#endif
+    data = nullptr;
+    size = 0;
+}
\ No newline at end of file
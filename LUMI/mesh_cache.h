@@ -0,0 +1,83 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+using namespace std;
+
+// cooked meshes are stored next to their source, e.g. sponza.obj -> sponza.obj.lumimesh
+#define MESH_CACHE_EXTENSION ".lumimesh"
+// bump whenever the file layout or the imported vertex data changes
+#define MESH_CACHE_VERSION 6
+
+
+struct CookedTexture
+{
+    string type;
+    string path;
+};
+
+// material of one mesh as imported, turned into a MaterialLibrary record when the mesh is created
+struct CookedMaterial
+{
+    vector<CookedTexture> textures;
+    MaterialParams        params;
+};
+
+// one mesh as stored in the cache, the vertex streams and indices point into the file mapping
+struct CookedMesh
+{
+    PackedVertices        vertices;
+    const unsigned int*   indices;
+    unsigned int          indexCount;
+    glm::vec3             aabbMin;
+    glm::vec3             aabbMax;
+    float                 boundingRadius;
+    vector<MeshLod>       lods;
+    CookedMaterial        material;
+};
+
+
+/*
+* Binary cache of the post-processed Assimp output of a model file.
+*
+* Vertices are cooked in the MESH_VERTEX_FORMAT layout, with the skin and
+* depth position streams next to them, and the bounding radius is stored with
+* the bounds: the file is memory mapped and the streams are uploaded straight
+* from the mapping with no per vertex work. The cache is considered stale (and
+* ignored) when the version, the vertex format, the import flags or the source
+* file changed; the source is compared by size + mtime first and by content hash
+* when only the mtime differs (e.g. after a fresh checkout).
+*/
+class MeshCache
+{
+public:
+    MeshCache();
+    ~MeshCache();
+
+    // map and validate the cache of sourcePath, false if missing or stale
+    bool open(const string& sourcePath, unsigned int importFlags);
+
+    const vector<CookedMesh>& getMeshes() const { return meshes; }
+
+    // (re)cook the cache of sourcePath from already imported meshes and their materials
+    // (materials[i] belongs to meshes[i])
+    static bool write(const string& sourcePath, unsigned int importFlags,
+        const vector<Mesh>& meshes, const vector<CookedMaterial>& materials);
+
+private:
+    MeshCache(const MeshCache&) = delete;
+    MeshCache& operator=(const MeshCache&) = delete;
+
+    bool map(const string& cachePath);
+    void close();
+
+    const unsigned char* data;
+    size_t               size;
+#ifdef _WIN32
+    void*                fileHandle;
+    void*                mappingHandle;
+#endif
+    vector<CookedMesh>   meshes;
+};
\ No newline at end of file
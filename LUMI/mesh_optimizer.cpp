@@ -0,0 +1,642 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#include "mesh_optimizer.h"
+
+// LRU cache size the triangle order is optimized for, larger than the reported FIFO on purpose
+const int VERTEX_CACHE_SIZE = 32;
+
+
+MeshOptimizerStats MeshOptimizer::optimize(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+    MeshOptimizerStats stats;
+    stats.verticesBefore = vertices.size();
+    stats.acmrBefore = computeACMR(indices, vertices.size());
+
+    weldVertices(vertices, indices);
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices, MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+    optimizeVertexFetch(vertices, indices);
+
+    stats.verticesAfter = vertices.size();
+    stats.acmrAfter = computeACMR(indices, vertices.size());
+    return stats;
+}
+
+
+// FNV-1a over the raw vertex, Vertex has no padding and is zero initialized on import
+static uint64_t hashVertex(const Vertex& vertex)
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < sizeof(Vertex); i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+
+size_t MeshOptimizer::weldVertices(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+    // open addressing table of indices into the welded vertices
+    size_t tableSize = 1;
+    while (tableSize < vertices.size() * 2)
+        tableSize *= 2;
+    const unsigned int EMPTY = ~0u;
+    vector<unsigned int> table(tableSize, EMPTY);
+
+    vector<Vertex> welded;
+    welded.reserve(vertices.size());
+    vector<unsigned int> remap(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        size_t slot = hashVertex(vertices[i]) & (tableSize - 1);
+        while (table[slot] != EMPTY && memcmp(&welded[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+
+        if (table[slot] == EMPTY)
+        {
+            table[slot] = static_cast<unsigned int>(welded.size());
+            welded.push_back(vertices[i]);
+        }
+        remap[i] = table[slot];
+    }
+
+    for (unsigned int& index : indices)
+        index = remap[index];
+    vertices.swap(welded);
+    return vertices.size();
+}
+
+
+static float vertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    if (remainingTriangles == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    if (cachePosition >= 0)
+    {
+        // the last triangle's vertices get a fixed score so the next one does not simply reuse its edge
+        if (cachePosition < 3)
+            score = 0.75f;
+        else
+            score = pow(1.0f - float(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+    }
+    // favour vertices with few triangles left so they leave the working set early
+    return score + 2.0f / sqrt(float(remainingTriangles));
+}
+
+
+void MeshOptimizer::optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // per vertex list of triangles not emitted yet: adjacency[offsets[v], offsets[v] + remaining[v])
+    vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+    vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    vector<unsigned int> adjacency(indices.size());
+    {
+        vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++)
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+
+    vector<float> triangleScores(triangleCount);
+    vector<bool> emitted(triangleCount, false);
+    int best = 0;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] +
+            vertexScores[indices[t * 3 + 2]];
+        if (triangleScores[t] > triangleScores[best])
+            best = static_cast<int>(t);
+    }
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    vector<unsigned int> cache, newCache;
+    size_t scanCursor = 0;
+    while (result.size() < indices.size())
+    {
+        if (best < 0)
+        {
+            // nothing in the cache has triangles left, continue with the next unemitted one
+            while (emitted[scanCursor])
+                scanCursor++;
+            best = static_cast<int>(scanCursor);
+        }
+
+        const unsigned int* triangle = &indices[best * 3];
+        result.insert(result.end(), triangle, triangle + 3);
+        emitted[best] = true;
+
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = triangle[k];
+            unsigned int* list = &adjacency[offsets[v]];
+            for (unsigned int i = 0; i < remaining[v]; i++)
+            {
+                if (list[i] == unsigned(best))
+                {
+                    list[i] = list[remaining[v] - 1];
+                    remaining[v]--;
+                    break;
+                }
+            }
+        }
+
+        // the emitted triangle moves to the front, the rest keeps its order
+        newCache.assign(triangle, triangle + 3);
+        for (unsigned int v : cache)
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                newCache.push_back(v);
+
+        for (size_t i = 0; i < newCache.size(); i++)
+        {
+            unsigned int v = newCache[i];
+            cachePosition[v] = i < size_t(VERTEX_CACHE_SIZE) ? static_cast<int>(i) : -1;
+            vertexScores[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+
+        // rescore triangles touching the cache (including evicted vertices) and pick the next one
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : newCache)
+        {
+            for (unsigned int i = 0; i < remaining[v]; i++)
+            {
+                unsigned int t = adjacency[offsets[v] + i];
+                triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] +
+                    vertexScores[indices[t * 3 + 2]];
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    best = static_cast<int>(t);
+                }
+            }
+        }
+
+        if (newCache.size() > size_t(VERTEX_CACHE_SIZE))
+            newCache.resize(VERTEX_CACHE_SIZE);
+        cache.swap(newCache);
+    }
+    indices.swap(result);
+}
+
+
+void MeshOptimizer::optimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices, float threshold)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+        return;
+
+    // clusters start wherever the cache order has a hard break (all three vertices miss),
+    // reordering them keeps the cache behaviour inside each cluster
+    vector<size_t> clusterStarts;
+    vector<unsigned int> cacheTime(vertices.size(), 0);
+    unsigned int time = MESH_OPTIMIZER_CACHE_SIZE + 1;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned int v = indices[t * 3 + k];
+            if (time - cacheTime[v] > MESH_OPTIMIZER_CACHE_SIZE)
+            {
+                cacheTime[v] = time++;
+                misses++;
+            }
+        }
+        if (misses == 3)
+            clusterStarts.push_back(t);
+    }
+    if (clusterStarts.size() < 2)
+        return;
+    clusterStarts.push_back(triangleCount);
+
+    // area weighted centroid and normal of every cluster
+    size_t clusterCount = clusterStarts.size() - 1;
+    vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f)), normals(clusterCount, glm::vec3(0.0f));
+    vector<float> areas(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+        {
+            const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        meshCentroid += centroids[c];
+        meshArea += areas[c];
+        if (areas[c] > 0.0f)
+            centroids[c] /= areas[c];
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // clusters facing away from the centre are likely to occlude the others, draw them first
+    vector<float> sortKeys(clusterCount);
+    vector<size_t> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        float length = glm::length(normals[c]);
+        glm::vec3 normal = length > 0.0f ? normals[c] / length : glm::vec3(0.0f);
+        sortKeys[c] = glm::dot(centroids[c] - meshCentroid, normal);
+        order[c] = c;
+    }
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+        result.insert(result.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+
+    if (computeACMR(result, vertices.size()) <= computeACMR(indices, vertices.size()) * threshold)
+        indices.swap(result);
+}
+
+
+void MeshOptimizer::optimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+    // vertices in the order the index buffer first touches them, unreferenced ones are dropped
+    const unsigned int UNUSED = ~0u;
+    vector<unsigned int> remap(vertices.size(), UNUSED);
+    vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+    for (unsigned int& index : indices)
+    {
+        if (remap[index] == UNUSED)
+        {
+            remap[index] = static_cast<unsigned int>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(reordered);
+}
+
+
+float MeshOptimizer::computeACMR(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return 0.0f;
+
+    // FIFO: a vertex is a hit while fewer than cacheSize misses happened since it was loaded
+    vector<unsigned int> cacheTime(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    size_t misses = 0;
+    for (unsigned int index : indices)
+    {
+        if (time - cacheTime[index] > cacheSize)
+        {
+            cacheTime[index] = time++;
+            misses++;
+        }
+    }
+    return float(misses) / float(triangleCount);
+}
+
+
+// symmetric 4x4 error quadric of a set of planes, area weighted; w is the summed weight
+struct Quadric
+{
+    double a00, a11, a22, a01, a02, a12;
+    double b0, b1, b2;
+    double c;
+    double w;
+};
+
+
+static void addPlane(Quadric& q, const glm::vec3& normal, float distance, float weight)
+{
+    double nx = normal.x, ny = normal.y, nz = normal.z, d = distance;
+    q.a00 += weight * nx * nx; q.a11 += weight * ny * ny; q.a22 += weight * nz * nz;
+    q.a01 += weight * nx * ny; q.a02 += weight * nx * nz; q.a12 += weight * ny * nz;
+    q.b0 += weight * nx * d; q.b1 += weight * ny * d; q.b2 += weight * nz * d;
+    q.c += weight * d * d;
+    q.w += weight;
+}
+
+
+static void addQuadric(Quadric& q, const Quadric& r)
+{
+    q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+    q.a01 += r.a01; q.a02 += r.a02; q.a12 += r.a12;
+    q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+    q.c += r.c;
+    q.w += r.w;
+}
+
+
+// weighted mean of the squared distances of p to the planes, a squared distance whatever the areas
+static float quadricError(const Quadric& q, const glm::vec3& p)
+{
+    double x = p.x, y = p.y, z = p.z;
+    double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+        2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+        2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+    if (q.w > 0.0)
+        error /= q.w;
+    return static_cast<float>(max(error, 0.0));
+}
+
+
+struct Collapse
+{
+    unsigned int from;
+    unsigned int to;
+    float        cost;
+};
+
+
+vector<unsigned int> MeshOptimizer::simplify(const vector<Vertex>& vertices, const vector<unsigned int>& indices,
+    size_t targetIndexCount, float targetError, float& resultError)
+{
+    resultError = 0.0f;
+    size_t vertexCount = vertices.size();
+    vector<unsigned int> result = indices;
+    if (vertexCount == 0 || indices.size() <= targetIndexCount)
+        return result;
+
+    // positions normalized by the largest extent so errors are scale independent
+    glm::vec3 boundsMin = vertices[0].Position, boundsMax = vertices[0].Position;
+    for (const Vertex& vertex : vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.Position);
+        boundsMax = glm::max(boundsMax, vertex.Position);
+    }
+    glm::vec3 size = boundsMax - boundsMin;
+    float extent = max(size.x, max(size.y, size.z));
+    if (extent <= 0.0f)
+        return result;
+    vector<glm::vec3> positions(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+        positions[i] = (vertices[i].Position - boundsMin) / extent;
+
+    // vertices sharing a position with another one sit on an attribute seam
+    vector<bool> locked(vertexCount, false);
+    {
+        size_t tableSize = 1;
+        while (tableSize < vertexCount * 2)
+            tableSize *= 2;
+        const unsigned int EMPTY = ~0u;
+        vector<unsigned int> table(tableSize, EMPTY);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            uint64_t hash = 0xcbf29ce484222325ull;
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertices[i].Position);
+            for (size_t b = 0; b < sizeof(glm::vec3); b++)
+                hash = (hash ^ bytes[b]) * 0x100000001b3ull;
+            size_t slot = hash & (tableSize - 1);
+            while (table[slot] != EMPTY && vertices[table[slot]].Position != vertices[i].Position)
+                slot = (slot + 1) & (tableSize - 1);
+            if (table[slot] == EMPTY)
+                table[slot] = static_cast<unsigned int>(i);
+            else
+                locked[i] = locked[table[slot]] = true;
+        }
+    }
+
+    // open borders: edges used by a single triangle
+    {
+        unordered_map<uint64_t, unsigned int> edgeUse;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                uint64_t a = indices[t + k], b = indices[t + (k + 1) % 3];
+                edgeUse[(min(a, b) << 32) | max(a, b)]++;
+            }
+        }
+        for (const auto& edge : edgeUse)
+        {
+            if (edge.second == 1)
+            {
+                locked[edge.first >> 32] = true;
+                locked[edge.first & 0xFFFFFFFF] = true;
+            }
+        }
+    }
+
+    vector<Quadric> quadrics(vertexCount, Quadric());
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        const glm::vec3& p0 = positions[indices[t]];
+        glm::vec3 normal = glm::cross(positions[indices[t + 1]] - p0, positions[indices[t + 2]] - p0);
+        float area = glm::length(normal);
+        if (area <= 0.0f)
+            continue;
+        normal /= area;
+        for (int k = 0; k < 3; k++)
+            addPlane(quadrics[indices[t + k]], normal, -glm::dot(normal, p0), area * 0.5f);
+    }
+
+    float maxCost = targetError * targetError;
+    float worstCost = 0.0f;
+    vector<unsigned int> offsets(vertexCount + 1), adjacency, remap(vertexCount);
+    vector<bool> touched(vertexCount);
+    vector<unsigned int> neighbourStamp(vertexCount, 0);
+    unsigned int stamp = 1;
+    vector<Collapse> collapses;
+    while (result.size() > targetIndexCount)
+    {
+        // vertex -> triangles of the current result
+        fill(offsets.begin(), offsets.end(), 0);
+        for (unsigned int index : result)
+            offsets[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] += offsets[v];
+        adjacency.resize(result.size());
+        {
+            vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < result.size(); i++)
+                adjacency[cursor[result[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+
+        collapses.clear();
+        for (size_t t = 0; t + 2 < result.size(); t += 3)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                unsigned int a = result[t + k], b = result[t + (k + 1) % 3];
+                for (int direction = 0; direction < 2; direction++)
+                {
+                    unsigned int from = direction == 0 ? a : b, to = direction == 0 ? b : a;
+                    if (locked[from])
+                        continue;
+                    Quadric q = quadrics[from];
+                    addQuadric(q, quadrics[to]);
+                    Collapse collapse = { from, to, quadricError(q, positions[to]) };
+                    collapses.push_back(collapse);
+                }
+            }
+        }
+        sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+        for (size_t v = 0; v < vertexCount; v++)
+            remap[v] = static_cast<unsigned int>(v);
+        fill(touched.begin(), touched.end(), false);
+        size_t triangles = result.size() / 3, targetTriangles = targetIndexCount / 3;
+        size_t removed = 0, applied = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (collapse.cost > maxCost || triangles - removed <= targetTriangles)
+                break;
+            if (touched[collapse.from] || touched[collapse.to])
+                continue;
+
+            // reject collapses that flip (or nearly flip) a remaining triangle around the removed vertex
+            bool flips = false;
+            for (unsigned int i = offsets[collapse.from]; i < offsets[collapse.from + 1] && !flips; i++)
+            {
+                const unsigned int* triangle = &result[adjacency[i] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    continue;
+                glm::vec3 p[3], q[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = positions[triangle[k]];
+                    q[k] = triangle[k] == collapse.from ? positions[collapse.to] : p[k];
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+                // folding past ~75 degrees counts as a flip, slivers turning edge-on included
+                flips = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+            }
+            if (flips)
+                continue;
+
+            // link condition: the endpoints may only share the vertices of their common
+            // triangles, otherwise the collapse folds the surface onto itself
+            stamp++;
+            for (unsigned int i = offsets[collapse.to]; i < offsets[collapse.to + 1]; i++)
+                for (int k = 0; k < 3; k++)
+                    neighbourStamp[result[adjacency[i] * 3 + k]] = stamp;
+            unsigned int sharedTriangles = 0, sharedNeighbours = 0;
+            for (unsigned int i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++)
+            {
+                const unsigned int* triangle = &result[adjacency[i] * 3];
+                bool shared = triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to;
+                sharedTriangles += shared ? 1 : 0;
+                for (int k = 0; k < 3; k++)
+                {
+                    unsigned int v = triangle[k];
+                    if (v != collapse.from && v != collapse.to && neighbourStamp[v] == stamp)
+                    {
+                        // count each common neighbour once
+                        neighbourStamp[v] = stamp - 1;
+                        sharedNeighbours++;
+                    }
+                }
+            }
+            if (sharedNeighbours != sharedTriangles)
+                continue;
+
+            // the triangles around the removed vertex change shape, keep their vertices
+            // out of other collapses this pass so the flip test above stays valid
+            remap[collapse.from] = collapse.to;
+            for (unsigned int i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++)
+                for (int k = 0; k < 3; k++)
+                    touched[result[adjacency[i] * 3 + k]] = true;
+            addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+            worstCost = max(worstCost, collapse.cost);
+            // an interior edge collapse removes two triangles
+            removed += 2;
+            applied++;
+        }
+        if (applied == 0)
+            break;
+
+        size_t write = 0;
+        for (size_t t = 0; t + 2 < result.size(); t += 3)
+        {
+            unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+            if (a == b || b == c || a == c)
+                continue;
+            result[write++] = a;
+            result[write++] = b;
+            result[write++] = c;
+        }
+        result.resize(write);
+    }
+
+    resultError = sqrt(worstCost);
+    return result;
+}
+
+
+vector<MeshLod> MeshOptimizer::generateLods(const vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+    vector<MeshLod> lods;
+    MeshLod full = { 0, static_cast<unsigned int>(indices.size()), 0.0f };
+    lods.push_back(full);
+    if (indices.size() / 3 < MESH_LOD_MIN_TRIANGLES)
+        return lods;
+
+    // every level is simplified from the previous one, errors add up
+    vector<unsigned int> source(indices);
+    float error = 0.0f;
+    for (int level = 1; level < MESH_MAX_LODS; level++)
+    {
+        float budget = MESH_LOD_MAX_ERROR - error;
+        if (budget <= 0.0f)
+            break;
+
+        float levelError;
+        size_t target = source.size() / 6 * 3;
+        vector<unsigned int> lod = simplify(vertices, source, target, budget, levelError);
+        // not worth a level of its own
+        if (lod.empty() || lod.size() > source.size() * 4 / 5)
+            break;
+
+        optimizeVertexCache(lod, vertices.size());
+        error += levelError;
+        MeshLod next = { static_cast<unsigned int>(indices.size()), static_cast<unsigned int>(lod.size()), error };
+        lods.push_back(next);
+        indices.insert(indices.end(), lod.begin(), lod.end());
+        source.swap(lod);
+    }
+    return lods;
+}
+
+
+void MeshOptimizer::printStats(const string& name, const MeshOptimizerStats& stats)
+{
+    cout << "MESH_OPTIMIZER:: " << name << ": vertices " << stats.verticesBefore << " -> "
+        << stats.verticesAfter << ", ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter << endl;
+}
+
+
+void MeshOptimizer::printLods(const string& name, const vector<MeshLod>& lods)
+{
+    cout << "MESH_LOD:: " << name << ": " << lods.size() << " levels, triangles";
+    for (const MeshLod& lod : lods)
+        cout << " " << lod.indexCount / 3;
+    cout << ", error " << lods.back().error << endl;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+using namespace std;
+
+// run the optimizer on every imported mesh (the result is what the mesh cache stores)
+#define MESH_OPTIMIZE_ON_IMPORT 1
+// FIFO size used to report ACMR, a typical post-transform cache
+#define MESH_OPTIMIZER_CACHE_SIZE 16
+// the overdraw pass may cost at most this much ACMR relative to the cache optimized order
+#define MESH_OPTIMIZER_OVERDRAW_THRESHOLD 1.05f
+// build simplified index buffers (LOD 1..MESH_MAX_LODS-1) for every imported mesh
+#define MESH_GENERATE_LODS 1
+// meshes with fewer triangles keep a single level
+#define MESH_LOD_MIN_TRIANGLES 64
+// largest simplification error accepted for any level, relative to the mesh's largest extent
+#define MESH_LOD_MAX_ERROR 0.1f
+
+
+struct MeshOptimizerStats
+{
+    size_t verticesBefore;
+    size_t verticesAfter;
+    float  acmrBefore;      // average cache miss ratio: transformed vertices per triangle
+    float  acmrAfter;
+};
+
+
+/*
+* Import time geometry optimization, CPU only.
+*
+* optimize() runs the passes in the order they have to happen:
+*   1. weld bit identical vertices (OBJ imports arrive mostly unindexed)
+*   2. reorder triangles for the post-transform vertex cache (Forsyth)
+*   3. reorder clusters of triangles front to back from the outside to cut
+*      overdraw, as long as the cache efficiency stays within the threshold
+*   4. reorder vertices by first use for vertex fetch locality
+* generateLods() is run on the result and only appends index buffers.
+*/
+class MeshOptimizer
+{
+public:
+    static MeshOptimizerStats optimize(vector<Vertex>& vertices, vector<unsigned int>& indices);
+
+    // returns the new vertex count
+    static size_t weldVertices(vector<Vertex>& vertices, vector<unsigned int>& indices);
+
+    static void optimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount);
+
+    static void optimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices, float threshold);
+
+    static void optimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices);
+
+    // FIFO cache simulation
+    static float computeACMR(const vector<unsigned int>& indices, size_t vertexCount,
+        unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE);
+
+    // quadric error edge collapse down to targetIndexCount or targetError (relative to the
+    // mesh extent), whichever comes first. Only indices change, the vertices are shared with
+    // the input. Border and seam vertices (several vertices at one position) never move
+    static vector<unsigned int> simplify(const vector<Vertex>& vertices, const vector<unsigned int>& indices,
+        size_t targetIndexCount, float targetError, float& resultError);
+
+    // append LOD 1..n index buffers to indices, each about half the previous one,
+    // returns every level including the full detail one
+    static vector<MeshLod> generateLods(const vector<Vertex>& vertices, vector<unsigned int>& indices);
+
+    static void printStats(const string& name, const MeshOptimizerStats& stats);
+    static void printLods(const string& name, const vector<MeshLod>& lods);
+};
\ No newline at end of file
@@ -3,34 +3,139 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <stb_image/stb_image.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <iostream>
+#include <mutex>
+#include <queue>
 
 #include "model.h"
+#include "gl_state.h"
+#include "load_timer.h"
+#include "mesh_optimizer.h"
+#include "texture_cooker.h"
+#include "texture_registry.h"
+#include "thread_pool.h"
 
 
-// ļȡͼƬid
-unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false)
+// decoded image waiting to be uploaded on the GL thread, either raw pixels or a BCn mip chain
+struct DecodedImage
+{
+    string          path;
+    unsigned char*  data;
+    CompressedImage compressed;
+    int             width, height, nrComponents;
+    uint64_t        contentHash;
+    double          decodeMs;
+};
+
+
+// S3TC is needed for color, RGTC is core. The first call has to happen on the GL thread,
+// after that the cached answer may be read from the workers
+static bool useCompressedTextures()
+{
+    return TextureCooker::isSupported(GL_COMPRESSED_RGB_S3TC_DXT1_EXT) &&
+        TextureCooker::isSupported(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+}
+
+
+// file read + decode only, no GL calls so it can run on any thread.
+// With useCompressed a fresh cooked file is read instead of the source, missing ones are cooked.
+// Never throws, a failure comes back as an image without pixels so the GL thread still hears of it
+static DecodedImage decodeImage(const string& path, const string& directory, bool useCompressed)
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    string filename = directory + '/' + path;
+
+    DecodedImage image;
+    image.path = path;
+    image.data = nullptr;
+    image.width = image.height = image.nrComponents = 0;
+    image.contentHash = 0;
+
+    try
+    {
+        if (useCompressed && TextureCooker::isFresh(filename) &&
+            TextureCooker::read(filename + COOKED_TEXTURE_EXTENSION, image.compressed) &&
+            TextureCooker::isSupported(image.compressed.format))
+        {
+            image.width = image.compressed.width;
+            image.height = image.compressed.height;
+        }
+        else
+        {
+            image.compressed.data.clear();
+            image.data = stbi_load(filename.c_str(), &image.width, &image.height, &image.nrComponents, 0);
+#if TEXTURE_COOK_ON_LOAD
+            if (image.data && useCompressed)
+            {
+                TextureCodec codec = TextureCooker::chooseCodec(filename, image.data, image.width,
+                    image.height, image.nrComponents);
+                image.compressed = TextureCooker::compress(image.data, image.width, image.height,
+                    image.nrComponents, codec);
+                if (!image.compressed.data.empty())
+                {
+                    TextureCooker::write(filename + COOKED_TEXTURE_EXTENSION, image.compressed);
+                    stbi_image_free(image.data);
+                    image.data = nullptr;
+                }
+            }
+#endif
+        }
+
+        if (!image.compressed.data.empty())
+            image.contentHash = TextureRegistry::hashContent(image.compressed.data.data(),
+                static_cast<int>(image.compressed.data.size()), 1, 1);
+        else if (image.data)
+            image.contentHash = TextureRegistry::hashContent(image.data, image.width,
+                image.height, image.nrComponents);
+    }
+    catch (const exception& e)
+    {
+        // out of memory on a large image, typically
+        cout << "Texture failed to decode at path: " << path << " (" << e.what() << ")" << endl;
+        stbi_image_free(image.data);
+        image.data = nullptr;
+        vector<unsigned char>().swap(image.compressed.data);
+        image.contentHash = 0;
+    }
+    image.decodeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return image;
+}
+
+
+// GL format of stb_image pixels
+static GLenum pixelFormat(int components)
+{
+    GLenum format = GL_RGB;
+    if (components == 1)
+        format = GL_RED;
+    else if (components == 3)
+        format = GL_RGB;
+    else if (components == 4)
+        format = GL_RGBA;
+    return format;
+}
+
+
+// create the GL texture for a decoded image and release the pixels
+static unsigned int uploadTexture(const DecodedImage& image)
+{
+    if (!image.compressed.data.empty())
+        return TextureCooker::upload(image.compressed);
 
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (image.data)
     {
-        GLenum format = GL_RGB;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
+        GLenum format = pixelFormat(image.nrComponents);
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        GLState::bindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -38,24 +143,181 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-        stbi_image_free(data);
+        stbi_image_free(image.data);
     }
     else
     {
-        cout << "Texture failed to load at path: " << path << endl;
-        stbi_image_free(data);
+        cout << "Texture failed to load at path: " << image.path << endl;
+    }
+
+    return textureID;
+}
+
+
+// registry key of an image referenced by a model
+static string textureKey(const string& path, const string& directory)
+{
+    return TextureRegistry::canonicalPath(directory + '/' + path);
+}
+
+
+// what the registry compares before sharing the image's texture
+static TextureContent imageContent(const DecodedImage& image)
+{
+    TextureContent content = {};
+    content.hash = image.contentHash;
+    content.width = image.width;
+    content.height = image.height;
+    if (!image.compressed.data.empty())
+    {
+        content.format = image.compressed.format;
+        content.compressed = true;
+        content.level = &image.compressed.data[image.compressed.levelOffsets[0]];
+        content.levelSize = image.compressed.levelSizes[0];
+    }
+    else if (image.data)
+    {
+        content.format = pixelFormat(image.nrComponents);
+        content.level = image.data;
+        content.levelSize = size_t(image.width) * image.height * image.nrComponents;
+    }
+    return content;
+}
+
+
+// share a texture with identical content if there is one, otherwise upload and register the image
+static unsigned int registerImage(const string& key, const DecodedImage& image)
+{
+    TextureRegistry& registry = TextureRegistry::instance();
+    TextureContent content = imageContent(image);
+    unsigned int textureID = registry.acquireByContent(key, content);
+    if (textureID != 0)
+    {
+        stbi_image_free(image.data);
+        return textureID;
     }
 
+    // base level + mip chain
+    size_t bytes = size_t(image.width) * image.height * image.nrComponents * 4 / 3;
+    if (!image.compressed.data.empty())
+        bytes = image.compressed.data.size();
+    textureID = uploadTexture(image);
+    registry.add(key, content, textureID, image.contentHash != 0 ? bytes : 0);
     return textureID;
 }
 
 
+// ļȡͼƬid
+unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false)
+{
+    string key = textureKey(path, directory);
+    unsigned int textureID = TextureRegistry::instance().acquire(key);
+    if (textureID == 0)
+        textureID = registerImage(key, decodeImage(path, directory, useCompressedTextures()));
+    return textureID;
+}
+
+
+// state of an asynchronous load, shared by the GL thread, the loader thread and the decode jobs.
+// Decode jobs keep it alive, so a model destroyed mid-load never leaves them a dangling queue
+struct AsyncLoad
+{
+    mutex               loadMutex;
+    queue<string>       texturePaths;   // found by the importer, not requested yet
+    queue<ImportedMesh> meshes;         // imported, waiting for their textures and the upload
+    queue<DecodedImage> images;         // decoded, waiting for the upload
+    size_t              imagesPending;  // submitted decode jobs not uploaded yet, GL thread only
+    bool                importDone;
+    bool                failed;
+    bool                fromCache;
+    atomic<bool>        cancelled;
+    // mapped by the import thread, meshes upload from it until finishAsyncLoad
+    MeshCache           cache;
+
+    AsyncLoad() : imagesPending(0), importDone(false), failed(false), fromCache(false), cancelled(false) {}
+
+    ~AsyncLoad()
+    {
+        // decoded after the model went away
+        while (!images.empty())
+        {
+            stbi_image_free(images.front().data);
+            images.pop();
+        }
+    }
+};
+
+
+Model::Model(string const& path, ModelLoadMode mode, bool gamma, bool textureArrays) : gammaCorrection(gamma),
+    lodStats(), loaded(false), useTextureArrays(textureArrays)
+{
+    resetLodStats();
+    if (mode == ModelLoadMode::Blocking)
+    {
+        loadModel(path);
+        loaded = true;
+        return;
+    }
+
+    sourcePath = path;
+    directory = path.substr(0, path.find_last_of('/'));
+    // answer the extension query on the GL thread before any decode job asks
+    useCompressedTextures();
+    asyncLoad = make_shared<AsyncLoad>();
+    loader = thread(importAsync, asyncLoad, path);
+}
+
+
+Model::~Model()
+{
+    if (loader.joinable())
+    {
+        asyncLoad->cancelled = true;
+        loader.join();
+    }
+    releasePreloadedTextures();
+    for (const Texture& texture : textures_loaded)
+        TextureRegistry::instance().release(texture.id);
+}
+
+
+// post-processing applied to every import, part of the mesh cache key
+const unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals |
+    aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+
 // ʹASSIMPļģͣvector<mesh>
 void Model::loadModel(string const& path)
 {
+    LoadTimer timer(path);
+    sourcePath = path;
+
+    // cooked cache is up to date: upload straight from the mapped file, no Assimp import
+    MeshCache cache;
+    if (cache.open(path, IMPORT_FLAGS))
+    {
+        directory = path.substr(0, path.find_last_of('/'));
+        vector<string> texturePaths;
+        for (const CookedMesh& mesh : cache.getMeshes())
+            for (const CookedTexture& texture : mesh.material.textures)
+                texturePaths.push_back(texture.path);
+        preloadTextures(texturePaths);
+
+        {
+            LoadTimer meshTimer("mesh upload");
+            loadCookedMeshes(cache);
+        }
+        TextureRegistry::instance().printStats();
+        finishLoad();
+        return;
+    }
+
     Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate |
-        aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    const aiScene* scene;
+    {
+        LoadTimer importTimer("assimp import");
+        scene = importer.ReadFile(path, IMPORT_FLAGS);
+    }
     // Ƿд
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
@@ -66,7 +328,19 @@ void Model::loadModel(string const& path)
     directory = path.substr(0, path.find_last_of('/'));
 
     // ݹ鴦ASSIMPĸڵ
-    processNode(scene->mRootNode, scene);
+    preloadTextures(collectTexturePaths(scene));
+    {
+        LoadTimer meshTimer("mesh processing + upload");
+        processNode(scene->mRootNode, scene);
+        uploadBatch();
+    }
+    releasePreloadedTextures();
+    TextureRegistry::instance().printStats();
+
+    // cook the import result for the next launch
+    if (!MeshCache::write(path, IMPORT_FLAGS, meshes, meshMaterials))
+        cout << "WARNING::MESH_CACHE:: failed to cook " << path << endl;
+    finishLoad();
 }
 
 
@@ -78,7 +352,8 @@ void Model::processNode(aiNode* node, const aiScene* scene)
     {
         // meshݴ洢sceneУڵֻmesh±
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        ImportedMesh imported = importMesh(mesh, scene);
+        meshes.push_back(createMesh(imported, MODEL_CONSOLIDATE_GEOMETRY != 0));
     }
     for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
@@ -88,16 +363,28 @@ void Model::processNode(aiNode* node, const aiScene* scene)
 }
 
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+#if MODEL_BUILD_COLLISION
+// triangle BVH over the first indexCount indices (LOD 0)
+static TriangleBvh buildCollision(const glm::vec3* positions, size_t vertexCount, const unsigned int* indices,
+    size_t indexCount)
+{
+    TriangleBvh collision;
+    collision.build(vector<glm::vec3>(positions, positions + vertexCount), indices, indexCount);
+    return collision;
+}
+#endif
+
+
+ImportedMesh Model::importMesh(aiMesh* mesh, const aiScene* scene)
 {
     // Ҫ
-    vector<Vertex> vertices;
-    vector<unsigned int> indices;
-    vector<Texture> textures;
+    ImportedMesh imported;
+    vector<Vertex>& vertices = imported.vertices;
+    vector<unsigned int>& indices = imported.indices;
 
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
-        Vertex vertex;
+        Vertex vertex = {};
         glm::vec3 vector;
         // positions
         vector.x = mesh->mVertices[i].x;
@@ -157,50 +444,815 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
     */
 
     // 1. diffuse maps
-    vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+    vector<CookedTexture>& textures = imported.material.textures;
+    vector<CookedTexture> diffuseMaps = materialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
     textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
     // 2. specular maps
-    vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+    vector<CookedTexture> specularMaps = materialTextures(material, aiTextureType_SPECULAR, "texture_specular");
     textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
     // 3. normal maps
-    std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+    std::vector<CookedTexture> normalMaps = materialTextures(material, aiTextureType_HEIGHT, "texture_normal");
     textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
     // 4. height maps
-    std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+    std::vector<CookedTexture> heightMaps = materialTextures(material, aiTextureType_AMBIENT, "texture_height");
     textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+    imported.material.params = materialParams(material);
 
-    return Mesh(vertices, indices, textures);
+#if MESH_OPTIMIZE_ON_IMPORT
+    MeshOptimizer::printStats(mesh->mName.C_Str(), MeshOptimizer::optimize(vertices, indices));
+#endif
+#if MESH_GENERATE_LODS
+    imported.lods = MeshOptimizer::generateLods(vertices, indices);
+    MeshOptimizer::printLods(mesh->mName.C_Str(), imported.lods);
+#endif
+#if MODEL_BUILD_COLLISION
+    vector<glm::vec3> positions;
+    VertexLayout::packPositions(vertices.data(), vertices.size(), positions);
+    imported.collision = buildCollision(positions.data(), positions.size(), indices.data(),
+        imported.lods.empty() ? indices.size() : imported.lods[0].indexCount);
+#endif
+    return imported;
 }
 
 
-// 鶨͵Ĳûloadload
-vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+Mesh Model::createMesh(ImportedMesh& imported, bool batched)
 {
-    vector<Texture> textures;
+    unsigned int material = createMaterial(imported.material);
+    meshMaterials.push_back(move(imported.material));
+#if MODEL_BUILD_COLLISION
+    meshCollision.push_back(move(imported.collision));
+#endif
+
+    if (imported.cooked)
+    {
+        const CookedMesh& cooked = *imported.cooked;
+        if (batched)
+            return Mesh(cooked.vertices, cooked.indices, cooked.indexCount, material, cooked.aabbMin, cooked.aabbMax,
+                cooked.boundingRadius, imported.lods, batch);
+        return Mesh(cooked.vertices, cooked.indices, cooked.indexCount, material, cooked.aabbMin, cooked.aabbMax,
+            cooked.boundingRadius, imported.lods);
+    }
+    if (batched)
+        return Mesh(move(imported.vertices), move(imported.indices), material, imported.lods, batch);
+    return Mesh(move(imported.vertices), move(imported.indices), material, imported.lods);
+}
+
+
+unsigned int Model::createMaterial(const CookedMaterial& cooked)
+{
+    // one texture per slot, further maps of a type were never sampled by any shader
+    Material material = {};
+    material.target = GL_TEXTURE_2D;
+    material.params = cooked.params;
+    for (const CookedTexture& ref : cooked.textures)
+    {
+        MaterialSlot slot = MaterialLibrary::slotOf(ref.type);
+        Texture texture = loadTexture(ref.path.c_str(), ref.type);
+        if (slot != MATERIAL_SLOT_COUNT && material.textures[slot] == 0)
+            material.textures[slot] = texture.id;
+    }
+    material.alphaTested = MaterialLibrary::hasAlpha(material.textures[MATERIAL_SLOT_DIFFUSE]) ? 1 : 0;
+    return MaterialLibrary::add(material);
+}
+
+
+// texture references of one type of a material, loaded later by createMesh
+vector<CookedTexture> Model::materialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+{
+    vector<CookedTexture> textures;
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
         aiString str;
         mat->GetTexture(type, i, &str);
-        // Ƿװع
-        bool skip = false;
-        for (unsigned int j = 0; j < textures_loaded.size(); j++)
+        CookedTexture texture = { typeName, str.C_Str() };
+        textures.push_back(texture);
+    }
+    return textures;
+}
+
+
+MaterialParams Model::materialParams(aiMaterial* mat)
+{
+    MaterialParams params = MaterialLibrary::defaultParams();
+    aiColor3D color;
+    float value;
+    if (mat->Get(AI_MATKEY_COLOR_DIFFUSE, color) == AI_SUCCESS)
+        params.diffuseColor = glm::vec4(color.r, color.g, color.b, params.diffuseColor.a);
+    if (mat->Get(AI_MATKEY_OPACITY, value) == AI_SUCCESS)
+        params.diffuseColor.a = value;
+    if (mat->Get(AI_MATKEY_COLOR_SPECULAR, color) == AI_SUCCESS)
+        params.specularColor = glm::vec4(color.r, color.g, color.b, params.specularColor.a);
+    if (mat->Get(AI_MATKEY_SHININESS, value) == AI_SUCCESS)
+        params.specularColor.a = value;
+    return params;
+}
+
+
+Texture Model::loadTexture(const char* path, const string& typeName)
+{
+    // Ƿװع
+    auto loaded = loadedTextureIndex.find(path);
+    if (loaded != loadedTextureIndex.end())
+        return textures_loaded[loaded->second];
+
+    Texture texture;
+    auto preloaded = preloadedTextures.find(path);
+    if (preloaded != preloadedTextures.end())
+    {
+        texture.id = preloaded->second;
+        preloadedTextures.erase(preloaded);
+    }
+    else
+        texture.id = TextureFromFile(path, this->directory);
+    texture.type = typeName;
+    texture.path = path;
+    loadedTextureIndex[texture.path] = textures_loaded.size();
+    textures_loaded.push_back(texture);
+    return texture;
+}
+
+
+void Model::importAsync(shared_ptr<AsyncLoad> state, string path)
+{
+    LoadTimer timer(path + " (background import)");
+
+    MeshCache& cache = state->cache;
+    if (cache.open(path, IMPORT_FLAGS))
+    {
         {
-            if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-            {
-                textures.push_back(textures_loaded[j]);
-                skip = true;
+            lock_guard<mutex> lock(state->loadMutex);
+            state->fromCache = true;
+            for (const CookedMesh& mesh : cache.getMeshes())
+                for (const CookedTexture& texture : mesh.material.textures)
+                    state->texturePaths.push(texture.path);
+        }
+        // the streams stay in the mapping, which lives as long as the state
+        for (const CookedMesh& cooked : cache.getMeshes())
+        {
+            if (state->cancelled)
                 break;
+            ImportedMesh imported;
+            imported.cooked = &cooked;
+            imported.lods = cooked.lods;
+            imported.material = cooked.material;
+#if MODEL_BUILD_COLLISION
+            imported.collision = buildCollision(cooked.vertices.positions, cooked.vertices.count, cooked.indices,
+                cooked.lods.empty() ? cooked.indexCount : cooked.lods[0].indexCount);
+#endif
+            lock_guard<mutex> lock(state->loadMutex);
+            state->meshes.push(move(imported));
+        }
+    }
+    else
+    {
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, IMPORT_FLAGS);
+        if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+        {
+            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            lock_guard<mutex> lock(state->loadMutex);
+            state->failed = true;
+            state->importDone = true;
+            return;
+        }
+
+        {
+            vector<string> paths = collectTexturePaths(scene);
+            lock_guard<mutex> lock(state->loadMutex);
+            for (const string& texturePath : paths)
+                state->texturePaths.push(texturePath);
+        }
+        // same order as processNode, so the mesh cache matches a blocking import
+        vector<aiNode*> nodes(1, scene->mRootNode);
+        while (!nodes.empty() && !state->cancelled)
+        {
+            aiNode* node = nodes.back();
+            nodes.pop_back();
+            for (unsigned int i = 0; i < node->mNumMeshes && !state->cancelled; i++)
+            {
+                ImportedMesh imported = importMesh(scene->mMeshes[node->mMeshes[i]], scene);
+                lock_guard<mutex> lock(state->loadMutex);
+                state->meshes.push(move(imported));
             }
+            for (unsigned int i = node->mNumChildren; i > 0; i--)
+                nodes.push_back(node->mChildren[i - 1]);
         }
-        if (!skip)
+    }
+
+    lock_guard<mutex> lock(state->loadMutex);
+    state->importDone = true;
+}
+
+
+void Model::update(double budgetMs)
+{
+    if (loaded || !asyncLoad)
+        return;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    AsyncLoad& state = *asyncLoad;
+
+    // new texture paths: share what the registry already has, decode the rest on the workers
+    vector<string> paths;
+    {
+        lock_guard<mutex> lock(state.loadMutex);
+        for (; !state.texturePaths.empty(); state.texturePaths.pop())
+            paths.push_back(state.texturePaths.front());
+    }
+    bool useCompressed = useCompressedTextures();
+    for (const string& path : paths)
+    {
+        if (!requestedTextures.insert(path).second || loadedTextureIndex.count(path) != 0)
+            continue;
+        unsigned int textureID = TextureRegistry::instance().acquire(textureKey(path, directory));
+        if (textureID != 0)
         {
-            Texture texture;
-            texture.id = TextureFromFile(str.C_Str(), this->directory);
-            texture.type = typeName;
-            texture.path = str.C_Str();
-            textures.push_back(texture);
-            textures_loaded.push_back(texture);
+            preloadedTextures[path] = textureID;
+            continue;
         }
+        shared_ptr<AsyncLoad> shared = asyncLoad;
+        string dir = directory;
+        state.imagesPending++;
+        ThreadPool::shared().submit([shared, path, dir, useCompressed] {
+            DecodedImage image = decodeImage(path, dir, useCompressed);
+            lock_guard<mutex> lock(shared->loadMutex);
+            shared->images.push(move(image));
+        });
     }
-    return textures;
+
+    // a mesh is created once every texture it binds is on the GPU
+    auto texturesReady = [this](const ImportedMesh& imported) {
+        for (const CookedTexture& texture : imported.material.textures)
+            if (preloadedTextures.count(texture.path) == 0 && loadedTextureIndex.count(texture.path) == 0)
+                return false;
+        return true;
+    };
+
+    // one image or mesh at a time until the frame's budget is spent
+    while (chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() < budgetMs)
+    {
+        DecodedImage image;
+        ImportedMesh imported;
+        bool haveImage = false, haveMesh = false;
+        {
+            lock_guard<mutex> lock(state.loadMutex);
+            if (!state.images.empty())
+            {
+                image = move(state.images.front());
+                state.images.pop();
+                haveImage = true;
+            }
+            else if (!state.meshes.empty() && texturesReady(state.meshes.front()))
+            {
+                imported = move(state.meshes.front());
+                state.meshes.pop();
+                haveMesh = true;
+            }
+        }
+
+        if (haveImage)
+        {
+            state.imagesPending--;
+            preloadedTextures[image.path] = registerImage(textureKey(image.path, directory), image);
+        }
+        else if (haveMesh)
+        {
+            // own buffers for now, finishAsyncLoad moves everything into the batch
+            meshes.push_back(createMesh(imported, false));
+        }
+        else
+            break;
+    }
+
+    bool done;
+    {
+        lock_guard<mutex> lock(state.loadMutex);
+        done = state.importDone && state.meshes.empty() && state.texturePaths.empty();
+    }
+    if (done && state.imagesPending == 0)
+        finishAsyncLoad();
+}
+
+
+void Model::finishAsyncLoad()
+{
+    loader.join();
+    // keeps the cache mapped until the meshes are in the batch
+    shared_ptr<AsyncLoad> state = move(asyncLoad);
+    bool fromCache = state->fromCache;
+    bool failed = state->failed;
+    requestedTextures.clear();
+    releasePreloadedTextures();
+
+    if (!failed && !fromCache && !MeshCache::write(sourcePath, IMPORT_FLAGS, meshes, meshMaterials))
+        cout << "WARNING::MESH_CACHE:: failed to cook " << sourcePath << endl;
+#if MODEL_CONSOLIDATE_GEOMETRY
+    // meshes are created in cache order
+    const vector<CookedMesh>& cooked = state->cache.getMeshes();
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        if (fromCache)
+            meshes[i].addTo(batch, cooked[i].vertices, cooked[i].indices, cooked[i].indexCount);
+        else
+            meshes[i].addTo(batch);
+    }
+    uploadBatch();
+#endif
+    TextureRegistry::instance().printStats();
+    finishLoad();
+    loaded = true;
+}
+
+
+void Model::loadCookedMeshes(const MeshCache& cache)
+{
+    const vector<CookedMesh>& cooked = cache.getMeshes();
+    meshes.reserve(cooked.size());
+    for (const CookedMesh& mesh : cooked)
+    {
+        unsigned int material = createMaterial(mesh.material);
+#if MODEL_BUILD_COLLISION
+        meshCollision.push_back(buildCollision(mesh.vertices.positions, mesh.vertices.count, mesh.indices,
+            mesh.lods.empty() ? mesh.indexCount : mesh.lods[0].indexCount));
+#endif
+#if MODEL_CONSOLIDATE_GEOMETRY
+        meshes.push_back(Mesh(mesh.vertices, mesh.indices, mesh.indexCount,
+            material, mesh.aabbMin, mesh.aabbMax, mesh.boundingRadius, mesh.lods, batch));
+#else
+        meshes.push_back(Mesh(mesh.vertices, mesh.indices, mesh.indexCount,
+            material, mesh.aabbMin, mesh.aabbMax, mesh.boundingRadius, mesh.lods));
+#endif
+    }
+    uploadBatch();
+    releasePreloadedTextures();
+}
+
+
+void Model::draw(Shader& shader, const LodView& view, const Frustum* frustum, RenderPass pass, HiZBuffer* occlusion)
+{
+    if (isDepthOnly(pass))
+    {
+        drawDepth(shader, nullptr, view, frustum, pass, occlusion);
+        return;
+    }
+    selectLevels(view, frustum, pass, occlusion);
+
+    if (hasTextureArrays())
+    {
+        batch.drawAll(textureArrays.material, meshes, &lodLevels);
+        return;
+    }
+    if (batch.isUploaded())
+    {
+        batch.draw(meshes, lodLevels);
+        return;
+    }
+    for (size_t i = 0; i < meshes.size(); i++)
+        if (lodLevels[i] != GEOMETRY_BATCH_SKIP)
+            meshes[i].draw(lodLevels[i]);
+}
+
+
+void Model::drawDepth(Shader& shader, Shader* maskedShader, const LodView& view, const Frustum* frustum, RenderPass pass,
+    HiZBuffer* occlusion)
+{
+    selectLevels(view, frustum, pass, occlusion);
+    shader.use();
+    // texture arrays don't matter here, masked meshes sample their own material's diffuse map
+    if (batch.isUploaded())
+    {
+        batch.drawDepth(meshes, lodLevels, maskedShader);
+        return;
+    }
+    bool masking = false;
+    for (size_t i = 0; i < meshes.size(); i++)
+        if (lodLevels[i] != GEOMETRY_BATCH_SKIP)
+        {
+            if (maskedShader && MaterialLibrary::isAlphaTested(meshes[i].material))
+                masking = true;
+            else
+                meshes[i].drawDepth(lodLevels[i]);
+        }
+    if (!masking)
+        return;
+    maskedShader->use();
+    for (size_t i = 0; i < meshes.size(); i++)
+        if (lodLevels[i] != GEOMETRY_BATCH_SKIP && MaterialLibrary::isAlphaTested(meshes[i].material))
+            meshes[i].draw(lodLevels[i]);
+}
+
+
+void Model::selectLevels(const LodView& view, const Frustum* frustum, RenderPass pass, HiZBuffer* occlusion)
+{
+    cullMeshes(view.model, frustum, pass, meshVisible);
+    lodLevels.resize(meshes.size());
+    lodStats = {};
+    occludedMeshes.clear();
+    occludedLevels.clear();
+    occludedModel = view.model;
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        if (!meshVisible[i])
+        {
+            lodLevels[i] = GEOMETRY_BATCH_SKIP;
+            continue;
+        }
+        lodLevels[i] = meshes[i].selectLod(view);
+        lodStats.triangles += meshes[i].lods[lodLevels[i]].indexCount / 3;
+        lodStats.meshesPerLevel[lodLevels[i]]++;
+        if (occlusion && !occlusion->isVisiblePrevious(view.model, meshes[i].aabbMin, meshes[i].aabbMax))
+        {
+            occludedMeshes.push_back(static_cast<unsigned int>(i));
+            occludedLevels.push_back(lodLevels[i]);
+            lodLevels[i] = GEOMETRY_BATCH_SKIP;
+        }
+    }
+    if (occlusion)
+    {
+        size_t tested = lodLevels.size() - count(meshVisible.begin(), meshVisible.end(), 0);
+        occlusion->record(static_cast<unsigned int>(tested), static_cast<unsigned int>(occludedMeshes.size()));
+    }
+}
+
+
+void Model::drawOccluded(Shader& shader, HiZBuffer& occlusion, const glm::mat4& viewProjection)
+{
+    if (occludedMeshes.empty())
+        return;
+    occludedBoxes.clear();
+    for (unsigned int i : occludedMeshes)
+        occludedBoxes.push_back({ meshes[i].aabbMin, meshes[i].aabbMax });
+    occlusion.testCurrent(viewProjection * occludedModel, occludedBoxes, occlusionQueries);
+
+    // one draw per mesh, each waits on its own query on the GPU
+    shader.use();
+    for (size_t k = 0; k < occludedMeshes.size(); k++)
+    {
+        const Mesh& mesh = meshes[occludedMeshes[k]];
+        unsigned int lod = occludedLevels[k];
+        MaterialLibrary::bind(hasTextureArrays() ? textureArrays.material : mesh.material);
+        GLState::bindVertexArray(mesh.VAO);
+        glBeginConditionalRender(occlusionQueries[k], GL_QUERY_WAIT);
+        glDrawElementsBaseVertex(GL_TRIANGLES, mesh.lods[lod].indexCount, mesh.indexType, mesh.indexOffset(lod),
+            mesh.baseVertex);
+        glEndConditionalRender();
+    }
+}
+
+
+void Model::submit(RenderQueue& queue, Shader& shader, const LodView& view, RenderPass pass, float depthRange,
+    const Frustum* frustum, Shader* maskedShader)
+{
+    // per thread, recordings of several passes cull the same model at once
+    static thread_local vector<uint8_t> visible;
+    cullMeshes(view.model, frustum, pass, visible);
+    unsigned int transform = queue.addTransform(view.model);
+    LodStats stats = {};
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        if (!visible[i])
+            continue;
+        const Mesh& mesh = meshes[i];
+        unsigned int lod = mesh.selectLod(view);
+        stats.triangles += mesh.lods[lod].indexCount / 3;
+        stats.meshesPerLevel[lod]++;
+
+        // distance of the bounds center, orthographic views only sort by state
+        float depth = 0.0f;
+        if (!view.isOrthographic)
+        {
+            glm::vec3 center = glm::vec3(view.model * glm::vec4((mesh.aabbMin + mesh.aabbMax) * 0.5f, 1.0f));
+            depth = glm::length(center - view.viewPosition) / depthRange;
+        }
+
+        // with texture arrays every mesh shares the arrays' material and the packets merge,
+        // depth only packets merge across materials unless the mesh is alpha tested
+        DrawPacket packet;
+        packet.shader = &shader;
+        packet.material = hasTextureArrays() ? textureArrays.material : mesh.material;
+        packet.VAO = mesh.VAO;
+        if (isDepthOnly(pass))
+        {
+            if (maskedShader && MaterialLibrary::isAlphaTested(mesh.material))
+            {
+                packet.shader = maskedShader;
+                packet.material = mesh.material;
+            }
+            else
+            {
+                packet.material = RENDER_QUEUE_NO_MATERIAL;
+                packet.VAO = mesh.depthVAO;
+            }
+        }
+        packet.key = RenderQueue::makeKey(pass, packet.shader->ID, packet.material, packet.VAO, depth);
+        packet.indexType = mesh.indexType;
+        packet.count = static_cast<GLsizei>(mesh.lods[lod].indexCount);
+        packet.offset = mesh.indexOffset(lod);
+        packet.baseVertex = mesh.baseVertex;
+        packet.transform = transform;
+        queue.submit(packet);
+    }
+    lock_guard<mutex> lock(statsMutex);
+    LodStats& total = submitStats[size_t(pass)];
+    total.triangles += stats.triangles;
+    for (unsigned int l = 0; l < MESH_MAX_LODS; l++)
+        total.meshesPerLevel[l] += stats.meshesPerLevel[l];
+}
+
+
+LodStats Model::getLodStats(RenderPass pass)
+{
+    lock_guard<mutex> lock(statsMutex);
+    return submitStats[size_t(pass)];
+}
+
+
+void Model::resetLodStats()
+{
+    lock_guard<mutex> lock(statsMutex);
+    for (LodStats& stats : submitStats)
+        stats = {};
+}
+
+
+void Model::cullMeshes(const glm::mat4& model, const Frustum* frustum, RenderPass pass, vector<uint8_t>& visible)
+{
+    if (!frustum)
+    {
+        visible.assign(meshes.size(), 1);
+        return;
+    }
+    updateMeshBounds();
+    Frustum objectFrustum = frustum->toObjectSpace(model);
+    size_t visibleCount = meshes.size() >= MODEL_BVH_CULLING_MIN_MESHES ?
+        meshBvh.cullFrustum(objectFrustum, visible) : FrustumCuller::cull(objectFrustum, meshBounds, visible);
+    FrustumCuller::record(pass, static_cast<unsigned int>(visibleCount), static_cast<unsigned int>(meshes.size() - visibleCount));
+}
+
+
+void Model::updateMeshBounds()
+{
+    // asynchronous loads keep adding meshes; the first of concurrent cullers rebuilds
+    lock_guard<mutex> lock(boundsMutex);
+    if (meshBvh.primitiveCount() == meshes.size())
+        return;
+    vector<BvhBox> boxes(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++)
+        boxes[i] = { meshes[i].aabbMin, meshes[i].aabbMax };
+    meshBvh.build(boxes);
+    if (meshes.size() < MODEL_BVH_CULLING_MIN_MESHES)
+        meshBounds.build(meshes);
+}
+
+
+bool Model::raycast(const glm::mat4& model, const BvhRay& ray, ModelHit& hit)
+{
+    updateMeshBounds();
+    // t is the same along the object space ray as long as its direction is not renormalized
+    glm::mat4 inverse = glm::inverse(model);
+    BvhRay objectRay = { glm::vec3(inverse * glm::vec4(ray.origin, 1.0f)),
+        glm::mat3(inverse) * ray.direction, ray.tMax };
+
+    hit.triangle = MODEL_NO_TRIANGLE;
+    auto intersectMesh = [this, &hit](unsigned int mesh, const BvhRay& ray, BvhHit& meshHit) {
+        if (mesh < meshCollision.size() && meshCollision[mesh].isBuilt())
+        {
+            BvhRay clipped = ray;
+            clipped.tMax = meshHit.t;
+            BvhHit triangleHit;
+            if (!meshCollision[mesh].raycast(clipped, triangleHit))
+                return false;
+            meshHit = triangleHit;
+            hit.triangle = triangleHit.primitive;
+        }
+        else
+        {
+            float t = Bvh::intersectBox(meshBvh.primitiveBounds(mesh), ray.origin,
+                Bvh::inverseDirection(ray.direction), meshHit.t);
+            if (t == FLT_MAX)
+                return false;
+            meshHit.t = t;
+            hit.triangle = MODEL_NO_TRIANGLE;
+        }
+        meshHit.primitive = mesh;
+        return true;
+    };
+    BvhHit meshHit;
+    if (!meshBvh.raycast(objectRay, intersectMesh, meshHit))
+        return false;
+    hit.t = meshHit.t;
+    hit.position = ray.origin + ray.direction * meshHit.t;
+    hit.mesh = meshHit.primitive;
+    return true;
+}
+
+
+void Model::overlapSphere(const glm::mat4& model, const glm::vec3& center, float radius, vector<unsigned int>& out)
+{
+    updateMeshBounds();
+    glm::mat4 inverse = glm::inverse(model);
+    float scale = max(glm::length(glm::vec3(inverse[0])), max(glm::length(glm::vec3(inverse[1])),
+        glm::length(glm::vec3(inverse[2]))));
+    meshBvh.overlapSphere(glm::vec3(inverse * glm::vec4(center, 1.0f)), radius * scale, out);
+}
+
+
+void Model::overlapBox(const glm::mat4& model, const BvhBox& box, vector<unsigned int>& out)
+{
+    updateMeshBounds();
+    // object space box around the world box's corners
+    glm::mat4 inverse = glm::inverse(model);
+    BvhBox objectBox = BvhBox::empty();
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 point(corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y,
+            corner & 4 ? box.max.z : box.min.z);
+        objectBox.grow(glm::vec3(inverse * glm::vec4(point, 1.0f)));
+    }
+    meshBvh.overlapBox(objectBox, out);
+}
+
+
+BvhBox Model::bounds(const glm::mat4& model) const
+{
+    BvhBox objectBox = BvhBox::empty();
+    for (const Mesh& mesh : meshes)
+        objectBox.grow(BvhBox{ mesh.aabbMin, mesh.aabbMax });
+    BvhBox box = BvhBox::empty();
+    if (meshes.empty())
+        return box;
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 point(corner & 1 ? objectBox.max.x : objectBox.min.x, corner & 2 ? objectBox.max.y : objectBox.min.y,
+            corner & 4 ? objectBox.max.z : objectBox.min.z);
+        box.grow(glm::vec3(model * glm::vec4(point, 1.0f)));
+    }
+    return box;
+}
+
+
+void Model::uploadBatch()
+{
+#if MODEL_CONSOLIDATE_GEOMETRY
+    if (meshes.empty())
+        return;
+    vector<MaterialLayers> meshLayers;
+    if (useTextureArrays && buildTextureArrays(meshLayers))
+        batch.upload(meshes, &meshLayers);
+    else
+        batch.upload(meshes);
+    cout << "MODEL:: " << meshes.size() << " meshes in " << (hasTextureArrays() ? 1 : batch.getDrawGroupCount())
+        << " draw calls" << endl;
+#endif
+}
+
+
+bool Model::buildTextureArrays(vector<MaterialLayers>& meshLayers)
+{
+    vector<unsigned int> materials;
+    for (const Mesh& mesh : meshes)
+        if (find(materials.begin(), materials.end(), mesh.material) == materials.end())
+            materials.push_back(mesh.material);
+    if (!textureArrays.build(materials))
+        return false;
+    for (const Mesh& mesh : meshes)
+        meshLayers.push_back(textureArrays.layersOf(mesh.material));
+    return true;
+}
+
+
+void Model::finishLoad()
+{
+#if MODEL_RELEASE_CPU_GEOMETRY
+    for (Mesh& mesh : meshes)
+        mesh.releaseGeometry();
+#endif
+    vector<CookedMaterial>().swap(meshMaterials);
+    printMemoryReport();
+}
+
+
+size_t Model::cpuBytes() const
+{
+    size_t bytes = meshes.capacity() * sizeof(Mesh) + textures_loaded.capacity() * sizeof(Texture) +
+        lodLevels.capacity() * sizeof(unsigned int) + meshMaterials.capacity() * sizeof(CookedMaterial) +
+        batch.cpuBytes() + meshBvh.cpuBytes() + meshCollision.capacity() * sizeof(TriangleBvh);
+    for (const TriangleBvh& collision : meshCollision)
+        bytes += collision.cpuBytes();
+    for (const Mesh& mesh : meshes)
+        bytes += mesh.cpuBytes();
+    for (const Texture& texture : textures_loaded)
+        bytes += texture.type.capacity() + texture.path.capacity();
+    // hash node + key per entry, roughly
+    bytes += loadedTextureIndex.size() * (sizeof(pair<string, size_t>) + 2 * sizeof(void*));
+    return bytes;
+}
+
+
+void Model::printMemoryReport() const
+{
+    size_t geometry = 0;
+    size_t vertices = 0;
+    for (const Mesh& mesh : meshes)
+    {
+        geometry += mesh.vertices.capacity() * sizeof(Vertex) + mesh.indices.capacity() * sizeof(unsigned int);
+        vertices += mesh.vertexCount;
+    }
+    cout << "MODEL_MEMORY:: " << sourcePath << ": " << meshes.size() << " meshes, " << vertices
+        << " vertices, " << cpuBytes() / 1024 << " KB resident on the CPU (" << geometry / 1024
+        << " KB geometry)" << endl;
+}
+
+
+vector<string> Model::collectTexturePaths(const aiScene* scene)
+{
+    // same texture types as processMesh
+    const aiTextureType types[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR,
+        aiTextureType_HEIGHT, aiTextureType_AMBIENT };
+
+    vector<string> paths;
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+    {
+        aiMaterial* material = scene->mMaterials[scene->mMeshes[m]->mMaterialIndex];
+        for (aiTextureType type : types)
+        {
+            for (unsigned int i = 0; i < material->GetTextureCount(type); i++)
+            {
+                aiString str;
+                material->GetTexture(type, i, &str);
+                paths.push_back(str.C_Str());
+            }
+        }
+    }
+    return paths;
+}
+
+
+void Model::preloadTextures(const vector<string>& paths)
+{
+    TextureRegistry& registry = TextureRegistry::instance();
+
+    // unique images not loaded yet, images another model already loaded are shared right away
+    vector<string> pending;
+    for (const string& path : paths)
+    {
+        if (preloadedTextures.count(path) != 0 || loadedTextureIndex.count(path) != 0 ||
+            find(pending.begin(), pending.end(), path) != pending.end())
+            continue;
+        unsigned int textureID = registry.acquire(textureKey(path, directory));
+        if (textureID != 0)
+            preloadedTextures[path] = textureID;
+        else
+            pending.push_back(path);
+    }
+    if (pending.empty())
+        return;
+
+    LoadTimer timer("texture decode + upload (" + to_string(pending.size()) + " images)");
+
+    // workers decode and hash, the GL thread uploads each image as soon as it is ready
+    mutex doneMutex;
+    condition_variable doneSignal;
+    queue<DecodedImage> done;
+    vector<future<void>> jobs;
+    bool useCompressed = useCompressedTextures();
+    for (const string& path : pending)
+    {
+        jobs.push_back(ThreadPool::shared().submit([&, path] {
+            DecodedImage image = decodeImage(path, directory, useCompressed);
+            {
+                lock_guard<mutex> lock(doneMutex);
+                done.push(move(image));
+            }
+            doneSignal.notify_one();
+        }));
+    }
+
+    double decodeMs = 0.0;
+    for (size_t uploaded = 0; uploaded < pending.size(); uploaded++)
+    {
+        DecodedImage image;
+        {
+            unique_lock<mutex> lock(doneMutex);
+            doneSignal.wait(lock, [&] { return !done.empty(); });
+            image = move(done.front());
+            done.pop();
+        }
+        decodeMs += image.decodeMs;
+        preloadedTextures[image.path] = registerImage(textureKey(image.path, directory), image);
+    }
+    for (future<void>& job : jobs)
+        job.get();
+
+    cout << "LOAD::texture decode: " << decodeMs << " ms of decoding on "
+        << ThreadPool::shared().size() << " worker threads" << endl;
+}
+
+
+void Model::releasePreloadedTextures()
+{
+    // preloaded but never referenced by a mesh
+    for (auto& preloaded : preloadedTextures)
+        TextureRegistry::instance().release(preloaded.second);
+    preloadedTextures.clear();
 }
\ No newline at end of file
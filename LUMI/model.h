@@ -2,13 +2,78 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
+#include "bvh.h"
+#include "frustum_culling.h"
+#include "geometry_batch.h"
+#include "hiz.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "render_queue.h"
 #include "shader.h"
 using namespace std;
 
+// pack all meshes of a model into shared buffers and draw one multi draw per material
+#define MODEL_CONSOLIDATE_GEOMETRY 1
+// drop the CPU copy of the geometry once it is uploaded and cached, only counts and bounds stay
+#define MODEL_RELEASE_CPU_GEOMETRY 1
+// GL time Model::update may spend per frame on an asynchronous load
+#define MODEL_UPLOAD_BUDGET_MS 4.0
+// models with at least this many meshes cull through their mesh BVH instead of testing every mesh
+#define MODEL_BVH_CULLING_MIN_MESHES 64
+// keep a triangle BVH of every mesh's LOD 0 for exact ray queries, box hits only without it.
+// Off by default: it holds a CPU copy of every position and triangle, which MODEL_RELEASE_CPU_GEOMETRY
+// gives back, and is rebuilt on the GL thread whenever the model loads from its mesh cache
+#define MODEL_BUILD_COLLISION 0
+
+
+// CPU side result of importing one mesh, no GL objects yet; a mesh read from the mesh cache
+// keeps its packed streams in the mapping and leaves vertices/indices empty
+struct ImportedMesh
+{
+    vector<Vertex>        vertices;
+    vector<unsigned int>  indices;
+    const CookedMesh*     cooked = nullptr;
+    vector<MeshLod>       lods;
+    CookedMaterial        material;
+    TriangleBvh           collision;     // MODEL_BUILD_COLLISION only
+};
+
+enum class ModelLoadMode
+{
+    Blocking,   // the constructor returns with every mesh uploaded
+    Async       // import on a background thread, meshes appear through update()
+};
+
+// shared between an asynchronous load's threads, defined in model.cpp
+struct AsyncLoad;
+
+// what the last LOD draw of a model submitted
+struct LodStats
+{
+    unsigned int triangles;
+    unsigned int meshesPerLevel[MESH_MAX_LODS];
+};
+
+// ModelHit::triangle of a mesh without collision triangles
+#define MODEL_NO_TRIANGLE 0xFFFFFFFFu
+
+// nearest mesh a ray hit, t is in units of the ray's direction like BvhHit
+struct ModelHit
+{
+    float        t;
+    glm::vec3    position;      // world space
+    unsigned int mesh;
+    unsigned int triangle;      // index buffer position / 3 in LOD 0, or MODEL_NO_TRIANGLE
+};
+
 
 class Model
 {
@@ -17,20 +82,114 @@ public:
     vector<Mesh>    meshes;
     string          directory;
     bool            gammaCorrection;
+    LodStats        lodStats;
 
 
-    Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const& path, bool gamma = false) : gammaCorrection(gamma), lodStats(), loaded(false),
+        useTextureArrays(false)
     {
+        resetLodStats();
         loadModel(path);
+        loaded = true;
     }
 
+    // Async returns right away, the model draws whatever meshes have arrived so far.
+    // textureArrays copies the material textures into MaterialTextureArrays once every
+    // mesh is loaded, the model then draws in a single call with any material
+    Model(string const& path, ModelLoadMode mode, bool gamma = false, bool textureArrays = false);
 
-    virtual void draw(Shader& shader)
+    // gives the model's texture references back to the TextureRegistry
+    virtual ~Model();
+
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+
+    // with the shader in use, materials bind through MaterialLibrary (Prefab reads the shader)
+    virtual void draw(Shader& /*shader*/)
     {
+        if (hasTextureArrays())
+        {
+            batch.drawAll(textureArrays.material, meshes);
+            return;
+        }
+        if (batch.isUploaded())
+        {
+            batch.draw();
+            return;
+        }
         for (unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].draw(shader);
+            meshes[i].draw();
     }
 
+    // every mesh at the level its projected size calls for, the view carries the pass bias.
+    // With a (world space) frustum, meshes outside it are skipped and counted under pass.
+    // With occlusion this is the first phase of occlusion culling: meshes the previous
+    // frames' pyramid hides are not drawn but kept for drawOccluded(). Depth only passes
+    // draw through drawDepth() without a masked shader, occlusion included
+    void draw(Shader& shader, const LodView& view, const Frustum* frustum = nullptr,
+        RenderPass pass = RenderPass::Opaque, HiZBuffer* occlusion = nullptr);
+
+    // depth only (shadow maps, depth pre-pass), shader is made current: opaque meshes from the
+    // position streams without binding materials, alpha tested ones (foliage) with maskedShader,
+    // which samples texture_diffuse1 and takes the same uniforms. Without it they are solid.
+    // occlusion works as in draw(), a depth pre-pass leaves the meshes it hides for drawOccluded()
+    void drawDepth(Shader& shader, Shader* maskedShader, const LodView& view, const Frustum* frustum = nullptr,
+        RenderPass pass = RenderPass::Shadow, HiZBuffer* occlusion = nullptr);
+
+    // second phase, once occlusion has been built from the depth the first phase left: the
+    // meshes it skipped are tested against that pyramid and drawn under conditional rendering
+    void drawOccluded(Shader& shader, HiZBuffer& occlusion, const glm::mat4& viewProjection);
+
+    // same level selection and culling, one packet per visible mesh into the queue instead
+    // of drawing, depthRange is the view distance that maps to the far end of the depth key.
+    // Makes no GL calls: several threads may submit the model into queues of their own at once
+    // (CommandBuffer recordings), as long as nothing loads into it meanwhile.
+    // Depth only passes submit like drawDepth(): the position stream without a material, and
+    // alpha tested meshes with maskedShader if given
+    void submit(RenderQueue& queue, Shader& shader, const LodView& view, RenderPass pass, float depthRange,
+        const Frustum* frustum = nullptr, Shader* maskedShader = nullptr);
+
+    // what submit() put into pass, summed over its submits (several shadow cascades, say) since
+    // the last resetLodStats(); lodStats only holds the last draw()
+    LodStats getLodStats(RenderPass pass);
+    void resetLodStats();
+
+    // nearest mesh along a world space ray with the model placed at model (picking, probe
+    // placement, baking), exact against the triangles with MODEL_BUILD_COLLISION
+    bool raycast(const glm::mat4& model, const BvhRay& ray, ModelHit& hit);
+
+    // meshes whose bounds touch a world space sphere or box (light ranges), appended to out.
+    // The sphere's radius is scaled by the model's largest axis scale
+    void overlapSphere(const glm::mat4& model, const glm::vec3& center, float radius, vector<unsigned int>& out);
+    void overlapBox(const glm::mat4& model, const BvhBox& box, vector<unsigned int>& out);
+
+    // world space box around the meshes loaded so far with the model placed at model (shadow
+    // caster bounds), BvhBox::empty() without any
+    BvhBox bounds(const glm::mat4& model) const;
+
+    // GL thread, once per frame while loading asynchronously: uploads finished textures
+    // and meshes for at most budgetMs
+    void update(double budgetMs = MODEL_UPLOAD_BUDGET_MS);
+
+    // every mesh is uploaded (always true for blocking loads)
+    bool isLoaded() const { return loaded; }
+
+    // the model draws through texture_<type>_array samplers and the layer attribute
+    // (texture_array.h) instead of texture_<type>1
+    bool hasTextureArrays() const { return textureArrays.isBuilt(); }
+
+    // heap memory the model keeps on the CPU: geometry, mesh records, texture references, batch
+    size_t cpuBytes() const;
+
+    void printMemoryReport() const;
+
+protected:
+    // shared buffers of all meshes when MODEL_CONSOLIDATE_GEOMETRY is on
+    GeometryBatch         batch;
+    // every material's textures in one array per slot, built with the batch if requested
+    MaterialTextureArrays textureArrays;
+
 private:
     // ʹASSIMPļģͣvector<mesh>
     void loadModel(string const& path);
@@ -40,9 +199,110 @@ private:
     void processNode(aiNode* node, const aiScene* scene);
 
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+    // vertex conversion, optimization and LODs, no GL calls so it can run on any thread
+    static ImportedMesh importMesh(aiMesh* mesh, const aiScene* scene);
+
+
+    // resolve the textures and upload, into the batch or into buffers of the mesh's own
+    Mesh createMesh(ImportedMesh& imported, bool batched);
+
+
+    // load the material's textures and return the id of its MaterialLibrary record
+    unsigned int createMaterial(const CookedMaterial& cooked);
+
+
+    // background half of an asynchronous load
+    static void importAsync(shared_ptr<AsyncLoad> state, string path);
+
+
+    // asynchronous load is complete: write the mesh cache and consolidate the buffers
+    void finishAsyncLoad();
+
+
+    // build the meshes from a valid cooked mesh cache
+    void loadCookedMeshes(const MeshCache& cache);
+
+
+    // upload the consolidated buffers once every mesh has been added
+    void uploadBatch();
+
+
+    // copy the materials of all meshes into textureArrays, layers of each mesh
+    bool buildTextureArrays(vector<MaterialLayers>& meshLayers);
+
+
+    // cull, pick every mesh's level into lodLevels (GEOMETRY_BATCH_SKIP: not drawn) and lodStats,
+    // meshes occlusion hides go to occludedMeshes instead
+    void selectLevels(const LodView& view, const Frustum* frustum, RenderPass pass, HiZBuffer* occlusion);
+
+
+    // fill visible (all 1 without a frustum) and count the result under pass
+    void cullMeshes(const glm::mat4& model, const Frustum* frustum, RenderPass pass, vector<uint8_t>& visible);
+
+
+    // rebuild meshBvh (and meshBounds for the flat culling path) when the mesh count changed
+    void updateMeshBounds();
+
+
+    // everything is on the GPU and in the mesh cache: release the CPU geometry, report memory
+    void finishLoad();
+
+
+    // every texture path referenced by the materials of the scene's meshes
+    static vector<string> collectTexturePaths(const aiScene* scene);
+
+
+    // decode the images on the worker pool and upload them as they finish,
+    // loadTexture then picks the GL ids up from preloadedTextures
+    void preloadTextures(const vector<string>& paths);
+
+
+    // drop the registry references of preloaded textures no mesh ended up using
+    void releasePreloadedTextures();
+
+
+    // texture references of one type of a material, loaded later by createMesh
+    static vector<CookedTexture> materialTextures(aiMaterial* mat, aiTextureType type, string typeName);
+
+
+    // constant colors of an Assimp material
+    static MaterialParams materialParams(aiMaterial* mat);
+
+
+    // load a texture relative to the model directory unless it was already loaded
+    Texture loadTexture(const char* path, const string& typeName);
 
 
-    // 鶨͵Ĳûloadload
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
+    // scratch for the LOD draw, level per mesh
+    vector<unsigned int>                lodLevels;
+    // culling input, rebuilt when the mesh count changes (under boundsMutex), and result per mesh
+    BoundsSoA                           meshBounds;
+    vector<uint8_t>                     meshVisible;
+    mutex                               boundsMutex;
+    // submitStats of concurrent submits
+    mutex                               statsMutex;
+    LodStats                            submitStats[size_t(RenderPass::Overlay) + 1];
+    // meshes the first occlusion phase skipped, their levels and the model matrix they were drawn with
+    vector<unsigned int>                occludedMeshes;
+    vector<unsigned int>                occludedLevels;
+    glm::mat4                           occludedModel;
+    // second phase scratch
+    vector<BvhBox>                      occludedBoxes;
+    vector<unsigned int>                occlusionQueries;
+    // object space hierarchy over the mesh bounds, and the triangles of each mesh (empty without
+    // MODEL_BUILD_COLLISION)
+    Bvh                                 meshBvh;
+    vector<TriangleBvh>                 meshCollision;
+    // imported material of each mesh, what MeshCache::write stores; released by finishLoad
+    vector<CookedMaterial>              meshMaterials;
+    unordered_map<string, unsigned int> preloadedTextures;
+    bool                                loaded;
+    bool                                useTextureArrays;
+    string                              sourcePath;
+    shared_ptr<AsyncLoad>               asyncLoad;
+    thread                              loader;
+    // texture paths an asynchronous load already asked the registry / the workers for
+    unordered_set<string>               requestedTextures;
+    // path -> index into textures_loaded
+    unordered_map<string, size_t>       loadedTextureIndex;
 };
\ No newline at end of file
@@ -1,59 +1,199 @@
 #pragma once
+#include <cassert>
+
 #include "model.h"
+#include "gl_state.h"
+#include "gpu_culling.h"
+#include "instance_ring.h"
+
+// first instance attribute: the matrix at 8 - 11 and the cull stamp at 12, clear of the
+// vertex formats (0 - 6) and the texture array layers (7)
+#define PREFAB_INSTANCE_ATTRIBUTE 8
+// free handle slot
+#define PREFAB_NO_INSTANCE 0xFFFFFFFFu
 
+/*
+* Many instances of one model. Instances are added, moved and removed through
+* handles that stay valid until removed; the matrices are kept densely (a
+* removal moves the last one into the hole) and streamed into an InstanceRing
+* in frames they changed. draw() with a view projection culls them on the GPU
+* (GpuInstanceCuller) and draws the compacted survivors, the instance
+* attributes have slots of their own so the model's vertex streams keep theirs.
+*/
 class Prefab : public Model
 {
 public:
-	Prefab(string const& _path, glm::mat4* _modelMatrices, 
-        unsigned int _amount = 1, bool _gamma = false) : Model(_path, _gamma)
+	Prefab(string const& _path, glm::mat4* _modelMatrices = nullptr, 
+        unsigned int _amount = 0, bool _gamma = false) : Model(_path, _gamma), culler(_amount),
+        ring(_amount * sizeof(glm::mat4))
 	{
-		amount = _amount;
-		modelMatrices = _modelMatrices;
-		
+        dirty = false;
+        instanceOffset = 0;
 		// ʵ
-		unsigned int buffer;
-		glGenBuffers(1, &buffer);
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), &modelMatrices[0], GL_STATIC_DRAW);
-
+        for (unsigned int i = 0; i < _amount; i++)
+            addInstance(_modelMatrices[i]);
 
+        // every instance is culled with the box around all meshes
+        bounds = BvhBox::empty();
         for (unsigned int i = 0; i < meshes.size(); i++)
         {
-            unsigned int VAO = meshes[i].VAO;
-            glBindVertexArray(VAO);
-            // set attribute pointers for matrix (4 times vec4)
-            glEnableVertexAttribArray(3);
-            glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-            glEnableVertexAttribArray(4);
-            glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4)));
-            glEnableVertexAttribArray(5);
-            glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-            glEnableVertexAttribArray(6);
-            glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-
-            glVertexAttribDivisor(3, 1);
-            glVertexAttribDivisor(4, 1);
-            glVertexAttribDivisor(5, 1);
-            glVertexAttribDivisor(6, 1);
-
-            glBindVertexArray(0);
+            bounds.grow(meshes[i].aabbMin);
+            bounds.grow(meshes[i].aabbMax);
         }
 	}
 
+    // handle of the new instance
+    unsigned int addInstance(const glm::mat4& matrix)
+    {
+        unsigned int handle;
+        if (freeHandles.empty())
+        {
+            handle = static_cast<unsigned int>(handleSlots.size());
+            handleSlots.push_back(PREFAB_NO_INSTANCE);
+        }
+        else
+        {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+        }
+        handleSlots[handle] = static_cast<unsigned int>(matrices.size());
+        matrices.push_back(matrix);
+        slotHandles.push_back(handle);
+        dirty = true;
+        return handle;
+    }
+
+    // false for handles that were removed (or never added)
+    bool hasInstance(unsigned int handle) const
+    {
+        return handle < handleSlots.size() && handleSlots[handle] != PREFAB_NO_INSTANCE;
+    }
+
+    // removed handles are ignored
+    void setInstance(unsigned int handle, const glm::mat4& matrix)
+    {
+        if (!hasInstance(handle))
+            return;
+        matrices[handleSlots[handle]] = matrix;
+        dirty = true;
+    }
+
+    const glm::mat4& getInstance(unsigned int handle) const
+    {
+        assert(hasInstance(handle));
+        return matrices[handleSlots[handle]];
+    }
+
+    // removed handles are ignored
+    void removeInstance(unsigned int handle)
+    {
+        if (!hasInstance(handle))
+            return;
+        unsigned int slot = handleSlots[handle];
+        unsigned int last = static_cast<unsigned int>(matrices.size()) - 1;
+        matrices[slot] = matrices[last];
+        slotHandles[slot] = slotHandles[last];
+        handleSlots[slotHandles[slot]] = slot;
+        matrices.pop_back();
+        slotHandles.pop_back();
+        handleSlots[handle] = PREFAB_NO_INSTANCE;
+        freeHandles.push_back(handle);
+        dirty = true;
+    }
+
+    unsigned int instanceCount() const { return static_cast<unsigned int>(matrices.size()); }
+
+    // every instance, instanceStamp 0 lets the shader take every entry of the stream
     virtual void draw(Shader& shader)
     {
+        if (!upload())
+            return;
+        shader.setInt("instanceStamp", 0);
         shader.setInt("texture_diffuse1", 0);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textures_loaded[0].id); // note: we also made the textures_loaded vector public (instead of private) from the model class.
+        GLState::bindTextureUnit(0, GL_TEXTURE_2D, textures_loaded[0].id); // note: we also made the textures_loaded vector public (instead of private) from the model class.
         for (unsigned int i = 0; i < meshes.size(); i++)
         {
-            glBindVertexArray(meshes[i].VAO);
-            glDrawElementsInstanced(GL_TRIANGLES, static_cast<unsigned int>(meshes[i].indices.size()), GL_UNSIGNED_INT, 0, amount);
-            glBindVertexArray(0);
+            GLState::bindVertexArray(meshes[i].VAO);
+            bindSourceInstances();
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, meshes[i].indexCount, meshes[i].indexType,
+                meshes[i].indexOffset(), instanceCount(), meshes[i].baseVertex);
         }
+        ring.fence();
+    }
+
+    // instances outside the frustum, and with occlusion those behind the depth of its last
+    // build(), are dropped on the GPU; the rest are drawn from the compacted stream in chunks
+    void draw(Shader& shader, const glm::mat4& viewProjection, const HiZBuffer* occlusion = nullptr)
+    {
+        if (!upload())
+            return;
+        culler.cull(ring.buffer, instanceOffset, instanceCount(), bounds, viewProjection, occlusion);
+        ring.fence();
+        shader.use();
+        shader.setInt("instanceStamp", culler.getStamp());
+        shader.setInt("texture_diffuse1", 0);
+        GLState::bindTextureUnit(0, GL_TEXTURE_2D, textures_loaded[0].id);
+        culler.drawChunks([this](unsigned int first, unsigned int count) {
+            for (unsigned int i = 0; i < meshes.size(); i++)
+            {
+                GLState::bindVertexArray(meshes[i].VAO);
+                culler.bindInstanceAttributes(PREFAB_INSTANCE_ATTRIBUTE, first);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, meshes[i].indexCount, meshes[i].indexType,
+                    meshes[i].indexOffset(), count, meshes[i].baseVertex);
+            }
+        });
+    }
+
+    // once per frame, for the culling and streaming reports
+    void endFrame()
+    {
+        culler.endFrame();
+        ring.endFrame();
     }
 
 private:
-	unsigned int amount;
-	glm::mat4* modelMatrices;
+    // dense matrices and the handle of each, slot of each handle
+    vector<glm::mat4>    matrices;
+    vector<unsigned int> slotHandles;
+    vector<unsigned int> handleSlots;
+    vector<unsigned int> freeHandles;
+    // matrices changed since the last upload, where the last upload is in the ring
+    bool                 dirty;
+    size_t               instanceOffset;
+    BvhBox               bounds;
+    GpuInstanceCuller    culler;
+    InstanceRing         ring;
+
+    // streams the matrices into the next ring region when they changed, false when there is nothing to draw
+    bool upload()
+    {
+        if (matrices.empty())
+            return false;
+        if (!dirty)
+            return true;
+        void* data = ring.map(matrices.size() * sizeof(glm::mat4));
+        if (!data)
+            return false;
+        memcpy(data, matrices.data(), matrices.size() * sizeof(glm::mat4));
+        instanceOffset = ring.unmap();
+        dirty = false;
+        return true;
+    }
+
+    // instance matrices at PREFAB_INSTANCE_ATTRIBUTE of the bound vertex array, straight from the ring.
+    // The stamp attribute a culled draw left enabled points into the culler's output, which may be
+    // shorter than the instances; disabled it reads a constant 0, what instanceStamp 0 takes anyway
+    void bindSourceInstances()
+    {
+        glDisableVertexAttribArray(PREFAB_INSTANCE_ATTRIBUTE + 4);
+        glVertexAttribI1i(PREFAB_INSTANCE_ATTRIBUTE + 4, 0);
+        GLState::bindBuffer(GL_ARRAY_BUFFER, ring.buffer);
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            glEnableVertexAttribArray(PREFAB_INSTANCE_ATTRIBUTE + column);
+            glVertexAttribPointer(PREFAB_INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                (void*)(instanceOffset + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(PREFAB_INSTANCE_ATTRIBUTE + column, 1);
+        }
+    }
 };
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include <cstring>
+#include <iostream>
+
+#include "render_queue.h"
+#include "gl_state.h"
+
+
+// bit layout of the sort key
+#define KEY_PASS_SHIFT     60
+#define KEY_PROGRAM_SHIFT  50
+#define KEY_MATERIAL_SHIFT 34
+#define KEY_VAO_SHIFT      24
+#define KEY_DEPTH_BITS     24
+
+
+RenderQueue::RenderQueue()
+{
+    mergeFirst = nullptr;
+    frames = 0;
+    resetStats();
+}
+
+
+unsigned int RenderQueue::addTransform(const glm::mat4& model)
+{
+    transforms.push_back(model);
+    return static_cast<unsigned int>(transforms.size() - 1);
+}
+
+
+void RenderQueue::submit(const DrawPacket& packet)
+{
+    packets.push_back(packet);
+}
+
+
+uint64_t RenderQueue::makeKey(RenderPass pass, unsigned int program, unsigned int material,
+    unsigned int vertexArray, float depth)
+{
+    // depth in [0, 1], 0 nearest
+    uint64_t quantized = static_cast<uint64_t>(glm::clamp(depth, 0.0f, 1.0f) * float((1 << KEY_DEPTH_BITS) - 1));
+    uint64_t key = uint64_t(pass) << KEY_PASS_SHIFT;
+    if (pass == RenderPass::Transparent)
+    {
+        // back to front wins over state
+        uint64_t inverted = ((1 << KEY_DEPTH_BITS) - 1) - quantized;
+        return key | (inverted << (KEY_PASS_SHIFT - KEY_DEPTH_BITS)) | ((uint64_t(program) & 0x3FF) << 26) |
+            ((uint64_t(material) & 0xFFFF) << 10) | (uint64_t(vertexArray) & 0x3FF);
+    }
+    return key | ((uint64_t(program) & 0x3FF) << KEY_PROGRAM_SHIFT) | ((uint64_t(material) & 0xFFFF) << KEY_MATERIAL_SHIFT) |
+        ((uint64_t(vertexArray) & 0x3FF) << KEY_VAO_SHIFT) | quantized;
+}
+
+
+void RenderQueue::flush()
+{
+    sortPackets();
+    drawSorted();
+}
+
+
+void RenderQueue::sortPackets()
+{
+    if (packets.empty())
+        return;
+    countUnsortedBinds();
+    sort();
+}
+
+
+void RenderQueue::drawSorted()
+{
+    if (!packets.empty())
+        execute();
+    packets.clear();
+    transforms.clear();
+}
+
+
+void RenderQueue::clear()
+{
+    packets.clear();
+    transforms.clear();
+}
+
+
+void RenderQueue::countUnsortedBinds()
+{
+    const DrawPacket* previous = nullptr;
+    for (const DrawPacket& packet : packets)
+    {
+        if (!previous || previous->shader->ID != packet.shader->ID)
+            stats.unsortedProgramBinds++;
+        if (!previous || previous->material != packet.material)
+            stats.unsortedMaterialBinds++;
+        if (!previous || previous->VAO != packet.VAO)
+            stats.unsortedVertexArrayBinds++;
+        previous = &packet;
+    }
+}
+
+
+void RenderQueue::sort()
+{
+    size_t count = packets.size();
+    order.resize(count);
+    scratch.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        order[i].key = packets[i].key;
+        order[i].packet = static_cast<uint32_t>(i);
+    }
+
+    // LSD radix sort, 8 bit digits, one histogram pass for all digits
+    size_t histogram[8][256];
+    memset(histogram, 0, sizeof(histogram));
+    for (const SortEntry& entry : order)
+        for (int digit = 0; digit < 8; digit++)
+            histogram[digit][(entry.key >> (digit * 8)) & 0xFF]++;
+
+    for (int digit = 0; digit < 8; digit++)
+    {
+        // every key has the same byte here (unused id bits, single pass): nothing to do
+        size_t* buckets = histogram[digit];
+        if (buckets[(order[0].key >> (digit * 8)) & 0xFF] == count)
+            continue;
+
+        size_t offset = 0;
+        for (int bucket = 0; bucket < 256; bucket++)
+        {
+            size_t size = buckets[bucket];
+            buckets[bucket] = offset;
+            offset += size;
+        }
+        for (const SortEntry& entry : order)
+            scratch[buckets[(entry.key >> (digit * 8)) & 0xFF]++] = entry;
+        order.swap(scratch);
+    }
+}
+
+
+void RenderQueue::execute()
+{
+    const DrawPacket* previous = nullptr;
+    for (const SortEntry& entry : order)
+    {
+        const DrawPacket& packet = packets[entry.packet];
+        bool programChanged = !previous || previous->shader->ID != packet.shader->ID;
+        bool materialChanged = programChanged || previous->material != packet.material;
+        bool vaoChanged = !previous || previous->VAO != packet.VAO;
+        bool transformChanged = programChanged || previous->transform != packet.transform;
+
+        // same state: extend the multi draw
+        if (!materialChanged && !vaoChanged && !transformChanged && previous->indexType == packet.indexType)
+        {
+            mergeCounts.push_back(packet.count);
+            mergeOffsets.push_back(packet.offset);
+            mergeBaseVertices.push_back(packet.baseVertex);
+            previous = &packet;
+            stats.packets++;
+            continue;
+        }
+        drawMerged();
+
+        if (programChanged)
+        {
+            packet.shader->use();
+            stats.programBinds++;
+        }
+        if (materialChanged && packet.material != RENDER_QUEUE_NO_MATERIAL)
+        {
+            MaterialLibrary::bind(packet.material);
+            stats.materialBinds++;
+        }
+        if (vaoChanged)
+        {
+            GLState::bindVertexArray(packet.VAO);
+            stats.vertexArrayBinds++;
+        }
+        if (transformChanged)
+            packet.shader->setMat4("model", transforms[packet.transform]);
+
+        mergeFirst = &packet;
+        mergeCounts.assign(1, packet.count);
+        mergeOffsets.assign(1, packet.offset);
+        mergeBaseVertices.assign(1, packet.baseVertex);
+        previous = &packet;
+        stats.packets++;
+    }
+    drawMerged();
+}
+
+
+void RenderQueue::drawMerged()
+{
+    if (!mergeFirst)
+        return;
+    if (mergeCounts.size() == 1)
+        glDrawElementsBaseVertex(GL_TRIANGLES, mergeCounts[0], mergeFirst->indexType, mergeOffsets[0], mergeBaseVertices[0]);
+    else
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, mergeCounts.data(), mergeFirst->indexType, mergeOffsets.data(),
+            static_cast<GLsizei>(mergeCounts.size()), mergeBaseVertices.data());
+    stats.drawCalls++;
+    mergeFirst = nullptr;
+}
+
+
+void RenderQueue::resetStats()
+{
+    stats = {};
+}
+
+
+RenderQueueStats& RenderQueueStats::operator+=(const RenderQueueStats& other)
+{
+    packets += other.packets;
+    drawCalls += other.drawCalls;
+    programBinds += other.programBinds;
+    materialBinds += other.materialBinds;
+    vertexArrayBinds += other.vertexArrayBinds;
+    unsortedProgramBinds += other.unsortedProgramBinds;
+    unsortedMaterialBinds += other.unsortedMaterialBinds;
+    unsortedVertexArrayBinds += other.unsortedVertexArrayBinds;
+    return *this;
+}
+
+
+void RenderQueueStats::divide(unsigned int frames)
+{
+    packets /= frames;
+    drawCalls /= frames;
+    programBinds /= frames;
+    materialBinds /= frames;
+    vertexArrayBinds /= frames;
+    unsortedProgramBinds /= frames;
+    unsortedMaterialBinds /= frames;
+    unsortedVertexArrayBinds /= frames;
+}
+
+
+void RenderQueue::printStats(const RenderQueueStats& stats)
+{
+    cout << "RENDER_QUEUE:: " << stats.packets << " packets in " << stats.drawCalls << " draw calls, binds saved by sorting: "
+        << "program " << int(stats.unsortedProgramBinds) - int(stats.programBinds)
+        << ", material " << int(stats.unsortedMaterialBinds) - int(stats.materialBinds)
+        << ", vertex array " << int(stats.unsortedVertexArrayBinds) - int(stats.vertexArrayBinds) << endl;
+}
+
+
+void RenderQueue::endFrame()
+{
+#if RENDER_QUEUE_REPORT_FRAMES
+    if (++frames < RENDER_QUEUE_REPORT_FRAMES)
+        return;
+    frames = 0;
+    // per frame averages
+    stats.divide(RENDER_QUEUE_REPORT_FRAMES);
+    cout << "RENDER_QUEUE:: per frame over the last " << RENDER_QUEUE_REPORT_FRAMES << " frames" << endl;
+    printStats();
+    resetStats();
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+#include "shader.h"
+using namespace std;
+
+// print and reset the counters every this many frames (0: never)
+#define RENDER_QUEUE_REPORT_FRAMES 600
+
+
+// most significant part of the sort key, passes never interleave
+enum class RenderPass
+{
+    Shadow,
+    Depth,
+    Opaque,
+    Transparent,    // sorted back to front before anything else
+    Overlay
+};
+
+// passes that only write depth: draws take the position stream and bind no material
+inline bool isDepthOnly(RenderPass pass)
+{
+    return pass == RenderPass::Shadow || pass == RenderPass::Depth;
+}
+
+// DrawPacket::material of a draw that samples no material texture
+#define RENDER_QUEUE_NO_MATERIAL 0xFFFFFFFFu
+
+// one indexed draw with everything needed to submit it
+struct DrawPacket
+{
+    uint64_t               key;
+    Shader*                shader;
+    unsigned int           material;    // MaterialLibrary id or RENDER_QUEUE_NO_MATERIAL
+    unsigned int           VAO;
+    GLenum                 indexType;
+    GLsizei                count;
+    const void*            offset;      // byte offset into the index buffer
+    GLint                  baseVertex;
+    unsigned int           transform;   // RenderQueue::addTransform index, set as "model"
+};
+
+struct RenderQueueStats
+{
+    unsigned int packets;
+    unsigned int drawCalls;             // packets merged into multi draws count once
+    unsigned int programBinds;
+    unsigned int materialBinds;
+    unsigned int vertexArrayBinds;
+    // the same packets in submission order, the difference is what sorting saved
+    unsigned int unsortedProgramBinds;
+    unsigned int unsortedMaterialBinds;
+    unsigned int unsortedVertexArrayBinds;
+
+    RenderQueueStats& operator+=(const RenderQueueStats& other);
+    // counters summed over frames to per frame averages
+    void divide(unsigned int frames);
+};
+
+
+/*
+* Draw submission sorted by a 64 bit key.
+*
+* Opaque key, most significant first:
+*   pass (4) | program (10) | material (16) | vertex array (10) | depth (24)
+* so state changes are ordered by cost and draws sharing all state run front
+* to back for early-Z. Transparent packets put the inverted depth right after
+* the pass to draw back to front. Ids wider than their field are folded into
+* it: a collision only costs a state change, every packet binds its own state
+* (through GLState and the shader's uniform cache, so repeats are free).
+*
+* flush() radix sorts the keys and merges consecutive packets that share
+* program, material, vertex array, index type and transform into one
+* glMultiDrawElementsBaseVertex. A material bind is the texture binds of
+* its MaterialLibrary record, packets without a material bind nothing.
+*/
+class RenderQueue
+{
+public:
+    RenderQueue();
+
+    // model matrix packets refer to by index, valid until the next flush
+    unsigned int addTransform(const glm::mat4& model);
+
+    void submit(const DrawPacket& packet);
+
+    // sort, draw and clear
+    void flush();
+
+    // flush() in two halves: the sort touches no GL and may run on a recording thread,
+    // the draw runs on the GL thread afterwards
+    void sortPackets();
+    void drawSorted();
+
+    size_t size() const { return packets.size(); }
+
+    // drop the packets without drawing them
+    void clear();
+
+    static uint64_t makeKey(RenderPass pass, unsigned int program, unsigned int material,
+        unsigned int vertexArray, float depth);
+
+    RenderQueueStats getStats() const { return stats; }
+    void resetStats();
+    void printStats() const { printStats(stats); }
+
+    // counters of any queue, or of several summed with +=, e.g. those CommandBuffers own
+    static void printStats(const RenderQueueStats& stats);
+
+    // once per frame, prints and resets the counters every RENDER_QUEUE_REPORT_FRAMES frames
+    void endFrame();
+
+private:
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t packet;
+    };
+
+    void sort();
+    void countUnsortedBinds();
+    void execute();
+    void drawMerged();
+
+    vector<DrawPacket>  packets;
+    vector<glm::mat4>   transforms;
+    vector<SortEntry>   order;
+    vector<SortEntry>   scratch;
+    // current multi draw
+    const DrawPacket*   mergeFirst;
+    vector<GLsizei>     mergeCounts;
+    vector<const void*> mergeOffsets;
+    vector<GLint>       mergeBaseVertices;
+
+    RenderQueueStats    stats;
+    unsigned int        frames;
+};
\ No newline at end of file
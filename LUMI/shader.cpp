@@ -2,10 +2,12 @@
 #include <sstream>
 #include <iostream>
 #include "shader.h"
+#include "material.h"
+#include "uniform_blocks.h"
 
 
 Shader::Shader(const char* vertexPath, const char* fragmentPath, 
-	const char* geometryPath)
+	const char* geometryPath, const vector<const char*>& feedbackVaryings)
 {
 	// 1. retrieve the vertex/fragment source code from filePath
 	string vertexCode, fragmentCode, geometryCode;
@@ -73,8 +75,13 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath,
 	glAttachShader(ID, fragment);
 	if (geometryPath != nullptr)
 		glAttachShader(ID, geometry);
+	if (!feedbackVaryings.empty())
+		glTransformFeedbackVaryings(ID, (GLsizei)feedbackVaryings.size(), feedbackVaryings.data(), GL_INTERLEAVED_ATTRIBS);
 	glLinkProgram(ID);
 	checkCompileErrors(ID, "PROGRAM");
+	reflectUniforms();
+	bindUniformBlocks();
+	bindMaterialSamplers();
 	// delete the shaders as they're linked into our program now and no longer necessary
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
@@ -108,4 +115,87 @@ void Shader::checkCompileErrors(unsigned int shader, string type)
 				<< type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << endl;
 		}
 	}
+}
+
+
+void Shader::reflectUniforms()
+{
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	vector<char> name(maxLength + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type;
+		glGetActiveUniform(ID, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, name.data());
+		string uniformName(name.data(), length);
+		// members of uniform blocks are set through their buffer
+		GLuint index = (GLuint)i;
+		GLint blockIndex = -1;
+		glGetActiveUniformsiv(ID, 1, &index, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+		if (blockIndex >= 0)
+			continue;
+
+		// arrays are reported once as "name[0]", every element gets its own entry and
+		// the bare name refers to the first one, like glGetUniformLocation does
+		size_t suffix = uniformName.size() >= 3 ? uniformName.size() - 3 : string::npos;
+		if (suffix != string::npos && uniformName.compare(suffix, 3, "[0]") == 0)
+		{
+			string base = uniformName.substr(0, suffix);
+			for (GLint element = 0; element < size; element++)
+				addUniform(base + "[" + to_string(element) + "]");
+			auto first = uniformIndex.find(uniformName);
+			if (first != uniformIndex.end())
+				uniformIndex[base] = first->second;
+		}
+		else
+			addUniform(uniformName);
+	}
+}
+
+
+void Shader::addUniform(const string& name)
+{
+	GLint location = glGetUniformLocation(ID, name.c_str());
+	if (location < 0 || uniformIndex.count(name) != 0)
+		return;
+	UniformSlot slot = {};
+	slot.location = location;
+	uniformIndex[name] = static_cast<int>(uniforms.size());
+	uniforms.push_back(slot);
+}
+
+
+void Shader::bindUniformBlocks()
+{
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+	vector<char> name(maxLength + 1);
+	for (GLint i = 0; i < count; i++)
+	{
+		GLsizei length = 0;
+		glGetActiveUniformBlockName(ID, (GLuint)i, (GLsizei)name.size(), &length, name.data());
+		int binding = UniformBuffer::bindingPoint(string(name.data(), length));
+		if (binding >= 0)
+			glUniformBlockBinding(ID, (GLuint)i, (GLuint)binding);
+		else
+			cout << "WARNING::SHADER:: no binding point for uniform block " << name.data() << endl;
+	}
+}
+
+
+void Shader::bindMaterialSamplers()
+{
+	// material textures always sit on the same units (material.h), point the samplers there once
+	for (const auto& entry : uniformIndex)
+	{
+		int unit = MaterialLibrary::samplerUnit(entry.first);
+		if (unit < 0)
+			continue;
+		use();
+		setInt(UniformHandle{ entry.second }, unit);
+	}
 }
\ No newline at end of file
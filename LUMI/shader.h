@@ -1,73 +1,184 @@
 #pragma once
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <cstring>
 #include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_state.h"
 using namespace std;
 
+// an active uniform resolved once after linking, stays valid for the lifetime of the program
+struct UniformHandle
+{
+	int slot;	// -1: not an active uniform, the setters ignore it
+
+	bool valid() const { return slot >= 0; }
+};
+
+/*
+* Every active uniform (each element of an array, each member of a struct array)
+* is reflected at link time into a hashed name table, so setting by name costs a
+* hash lookup instead of a glGetUniformLocation. Hot loops resolve UniformHandles
+* once and skip the lookup too. The last value uploaded to each uniform is kept
+* and unchanged values are not sent again; this relies on uniforms only being set
+* through this class while the program is in use. Uniform blocks are bound to
+* the binding points of uniform_blocks.h by name.
+*/
 class Shader
 {
 public:
 	unsigned int ID;
 
+	// feedbackVaryings: outputs captured interleaved into one transform feedback buffer
 	Shader(const char* vertexPath, const char* fragmentPath, 
-		const char* geometryPath = nullptr);
+		const char* geometryPath = nullptr, const vector<const char*>& feedbackVaryings = {});
 
 	// activate the shader
 	void use()
 	{
-		glUseProgram(ID);
+		GLState::useProgram(ID);
+	}
+
+	// pre-resolved handle for a hot uniform, e.g. "lights[3].Color"
+	UniformHandle uniform(const string& name) const
+	{
+		auto found = uniformIndex.find(name);
+		UniformHandle handle = { found != uniformIndex.end() ? found->second : -1 };
+		return handle;
 	}
 
 	// utility uniform functions
 	void setBool(const string& name, bool value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		setInt(uniform(name), (int)value);
 	}
 
 	void setInt(const string& name, int value) const {
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		setInt(uniform(name), value);
 	}
 
 	void setFloat(const string& name, float value) const {
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		setFloat(uniform(name), value);
 	}
 	
 	void setVec2(const string& name, const glm::vec2& value) const {
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec2(uniform(name), value);
 	}
 	
 	void setVec2(const string& name, float x, float y) const {
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		setVec2(uniform(name), glm::vec2(x, y));
 	}
 	
 	void setVec3(const string& name, const glm::vec3& value) const {
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec3(uniform(name), value);
 	}
 	
 	void setVec3(const string& name, float x, float y, float z) const {
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		setVec3(uniform(name), glm::vec3(x, y, z));
 	}
 	
 	void setVec4(const string& name, const glm::vec4& value) const {
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		setVec4(uniform(name), value);
 	}
 	
 	void setVec4(const string& name, float x, float y, float z, float w) const {
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		setVec4(uniform(name), glm::vec4(x, y, z, w));
 	}
 	
 	void setMat2(const string& name, const glm::mat2& mat) const {
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat2(uniform(name), mat);
 	}
 	
 	void setMat3(const string& name, const glm::mat3& mat) const {
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat3(uniform(name), mat);
 	}
 	
 	void setMat4(const string& name, const glm::mat4& mat) const {
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		setMat4(uniform(name), mat);
+	}
+
+	// same through a handle
+	void setBool(UniformHandle handle, bool value) const {
+		setInt(handle, (int)value);
+	}
+
+	void setInt(UniformHandle handle, int value) const {
+		if (changed(handle, &value, sizeof(value)))
+			glUniform1i(uniforms[handle.slot].location, value);
+	}
+
+	void setFloat(UniformHandle handle, float value) const {
+		if (changed(handle, &value, sizeof(value)))
+			glUniform1f(uniforms[handle.slot].location, value);
+	}
+
+	void setVec2(UniformHandle handle, const glm::vec2& value) const {
+		if (changed(handle, &value[0], sizeof(value)))
+			glUniform2fv(uniforms[handle.slot].location, 1, &value[0]);
+	}
+
+	void setVec3(UniformHandle handle, const glm::vec3& value) const {
+		if (changed(handle, &value[0], sizeof(value)))
+			glUniform3fv(uniforms[handle.slot].location, 1, &value[0]);
+	}
+
+	void setVec4(UniformHandle handle, const glm::vec4& value) const {
+		if (changed(handle, &value[0], sizeof(value)))
+			glUniform4fv(uniforms[handle.slot].location, 1, &value[0]);
+	}
+
+	void setMat2(UniformHandle handle, const glm::mat2& mat) const {
+		if (changed(handle, &mat[0][0], sizeof(mat)))
+			glUniformMatrix2fv(uniforms[handle.slot].location, 1, GL_FALSE, &mat[0][0]);
+	}
+
+	void setMat3(UniformHandle handle, const glm::mat3& mat) const {
+		if (changed(handle, &mat[0][0], sizeof(mat)))
+			glUniformMatrix3fv(uniforms[handle.slot].location, 1, GL_FALSE, &mat[0][0]);
+	}
+
+	void setMat4(UniformHandle handle, const glm::mat4& mat) const {
+		if (changed(handle, &mat[0][0], sizeof(mat)))
+			glUniformMatrix4fv(uniforms[handle.slot].location, 1, GL_FALSE, &mat[0][0]);
 	}
 
 private:
+	struct UniformSlot
+	{
+		GLint location;
+		bool  uploaded;			// value holds the last upload
+		float value[16];		// raw bits of the last upload, a mat4 at most
+	};
+
 	// utility function for checking shader compilation/linking errors.
 	void checkCompileErrors(unsigned int shader, string type);
+
+	// fill the uniform table from the linked program
+	void reflectUniforms();
+
+	void addUniform(const string& name);
+
+	// point the program's uniform blocks at the shared binding points (uniform_blocks.h)
+	void bindUniformBlocks();
+
+	// point texture_<type>1 samplers at the fixed units of their material slot
+	void bindMaterialSamplers();
+
+	// false for invalid handles and values equal to the last upload, otherwise remember the value
+	bool changed(UniformHandle handle, const void* value, size_t bytes) const
+	{
+		if (handle.slot < 0)
+			return false;
+		UniformSlot& slot = uniforms[handle.slot];
+		if (slot.uploaded && memcmp(slot.value, value, bytes) == 0)
+			return false;
+		memcpy(slot.value, value, bytes);
+		slot.uploaded = true;
+		return true;
+	}
+
+	unordered_map<string, int>	uniformIndex;
+	// the cached values change in const setters
+	mutable vector<UniformSlot>	uniforms;
 };
\ No newline at end of file
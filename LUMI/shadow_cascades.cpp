@@ -0,0 +1,361 @@
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+#include "shadow_cascades.h"
+#include "gl_state.h"
+
+
+namespace
+{
+    // where a grid texel lives in a size x size toroidal cache
+    int wrapTexel(int texel, int size)
+    {
+        return ((texel % size) + size) % size;
+    }
+
+    // cuts first to first + extent (at most size) where it wraps around, returns the piece count
+    int wrapSplit(int first, int extent, int size, int* starts, int* extents)
+    {
+        starts[0] = first;
+        extents[0] = min(extent, size - wrapTexel(first, size));
+        if (extents[0] == extent)
+            return 1;
+        starts[1] = first + extents[0];
+        extents[1] = extent - extents[0];
+        return 2;
+    }
+
+    // grid texels first to first + extent as up to four (x, y, width, height) pieces that don't wrap
+    int wrapPieces(glm::ivec2 first, glm::ivec2 extent, int size, glm::ivec4* pieces)
+    {
+        int xStarts[2], widths[2], yStarts[2], heights[2];
+        int xCount = wrapSplit(first.x, extent.x, size, xStarts, widths);
+        int yCount = wrapSplit(first.y, extent.y, size, yStarts, heights);
+        int count = 0;
+        for (int y = 0; y < yCount; y++)
+            for (int x = 0; x < xCount; x++)
+                pieces[count++] = glm::ivec4(xStarts[x], yStarts[y], widths[x], heights[y]);
+        return count;
+    }
+}
+
+
+CascadedShadowMap::CascadedShadowMap(GLsizei size, unsigned int cascadeCount)
+{
+    this->size = size;
+    this->cascadeCount = min(max(cascadeCount, 1u), (unsigned int)SHADOW_MAX_CASCADES);
+    lightDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+    nearPlane = 0.0f;
+    for (ShadowCascade& cascade : cascades)
+        cascade = {};
+    lightView = glm::mat4(1.0f);
+    for (StaticCache& cache : staticCaches)
+        cache = {};
+    stats = {};
+    statFrames = 0;
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    createLayers(texture, framebuffers);
+    createLayers(staticTexture, staticFramebuffers);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+}
+
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+    GLState::deleteFramebuffers(cascadeCount, framebuffers);
+    GLState::deleteFramebuffers(cascadeCount, staticFramebuffers);
+    GLState::deleteTextures(1, &texture);
+    GLState::deleteTextures(1, &staticTexture);
+}
+
+
+void CascadedShadowMap::update(const glm::mat4& cameraView, float fovY, float aspect, float nearPlane,
+    float shadowDistance, const glm::vec3& lightDirection, const BvhBox& casterBounds)
+{
+    this->lightDirection = glm::normalize(lightDirection);
+    this->nearPlane = nearPlane;
+
+    // the light looks along its direction from the world origin, every cascade shares the orientation
+    // so texel snapping in light space is stable
+    glm::vec3 up = fabs(this->lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    lightView = glm::lookAt(glm::vec3(0.0f), this->lightDirection, up);
+
+    // light space z range of the casters, the light looks down -z; it doesn't move with the camera,
+    // so neither do the depths of the static cache
+    bool hasCasters = casterBounds.min.x <= casterBounds.max.x;
+    float casterTop = -FLT_MAX;
+    float casterBottom = FLT_MAX;
+    if (hasCasters)
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 point((corner & 1) ? casterBounds.max.x : casterBounds.min.x,
+                (corner & 2) ? casterBounds.max.y : casterBounds.min.y,
+                (corner & 4) ? casterBounds.max.z : casterBounds.min.z);
+            float z = (lightView * glm::vec4(point, 1.0f)).z;
+            casterTop = max(casterTop, z);
+            casterBottom = min(casterBottom, z);
+        }
+
+    glm::mat4 cameraWorld = glm::inverse(cameraView);
+    float tanY = tan(fovY * 0.5f);
+    float tanX = tanY * aspect;
+    float splitNear = nearPlane;
+    for (unsigned int i = 0; i < cascadeCount; i++)
+    {
+        float t = float(i + 1) / float(cascadeCount);
+        float logSplit = nearPlane * pow(shadowDistance / nearPlane, t);
+        float uniformSplit = nearPlane + (shadowDistance - nearPlane) * t;
+        float splitFar = glm::mix(uniformSplit, logSplit, SHADOW_CASCADE_SPLIT_LAMBDA);
+
+        // bounding sphere of the slice, its radius doesn't change while the camera turns
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            float distance = (corner & 4) ? splitFar : splitNear;
+            glm::vec4 viewCorner(((corner & 1) ? tanX : -tanX) * distance, ((corner & 2) ? tanY : -tanY) * distance,
+                -distance, 1.0f);
+            corners[corner] = glm::vec3(cameraWorld * viewCorner);
+            center += corners[corner] / 8.0f;
+        }
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners)
+            radius = max(radius, glm::length(corner - center));
+        // rounded up so float noise never resizes the cascade
+        radius = ceil(radius * 16.0f) / 16.0f;
+
+        // move in whole texels only, the texels keep covering the same world positions and the
+        // static cache can scroll by them
+        float texelSize = 2.0f * radius / float(size);
+        glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+        glm::ivec2 origin(int(floor(lightCenter.x / texelSize)) - size / 2,
+            int(floor(lightCenter.y / texelSize)) - size / 2);
+        // a texel past the casters either way so flat bounds keep a depth range
+        float zNear = hasCasters ? -(casterTop + texelSize) : -(lightCenter.z + radius);
+        float zFar = hasCasters ? -(casterBottom - texelSize) : -(lightCenter.z - radius);
+
+        ShadowCascade& cascade = cascades[i];
+        cascade.view = lightView;
+        cascade.projection = glm::ortho(origin.x * texelSize, (origin.x + size) * texelSize,
+            origin.y * texelSize, (origin.y + size) * texelSize, zNear, zFar);
+        cascade.viewProjection = cascade.projection * lightView;
+        cascade.casterFrustum = Frustum::fromMatrix(cascade.viewProjection);
+        cascade.splitNear = splitNear;
+        cascade.splitFar = splitFar;
+        cascade.texelSize = texelSize;
+        cascade.origin = origin;
+        splitNear = splitFar;
+
+        // the static cache keeps its texels while the light, the casters' depth range and the
+        // cascade's texel size stay, a move only exposes new ones at the edges
+        StaticCache& cache = staticCaches[i];
+        glm::ivec2 shift = origin - cache.origin;
+        bool redraw = !cache.valid || cache.lightDirection != this->lightDirection || cache.texelSize != texelSize
+            || cache.zNear != zNear || cache.zFar != zFar || abs(shift.x) >= size || abs(shift.y) >= size;
+        cache.lightDirection = this->lightDirection;
+        cache.texelSize = texelSize;
+        cache.zNear = zNear;
+        cache.zFar = zFar;
+
+        cascade.staticRegionCount = 0;
+        if (redraw)
+        {
+            addStaticRegion(cascade, cache, origin, glm::ivec2(size));
+            stats.redrawn++;
+        }
+        else
+        {
+            // the columns, then the rows a move exposed, their shared corner once
+            if (shift.x != 0)
+                addStaticRegion(cascade, cache, glm::ivec2(shift.x > 0 ? cache.origin.x + size : origin.x, origin.y),
+                    glm::ivec2(abs(shift.x), size));
+            if (shift.y != 0)
+            {
+                int left = max(origin.x, cache.origin.x);
+                addStaticRegion(cascade, cache, glm::ivec2(left, shift.y > 0 ? cache.origin.y + size : origin.y),
+                    glm::ivec2(min(origin.x, cache.origin.x) + size - left, abs(shift.y)));
+            }
+            // the footprints of changed casters, as far as the cascade covers them
+            if (cache.dirty)
+            {
+                glm::ivec2 first = glm::max(cache.dirtyMin, origin);
+                glm::ivec2 last = glm::min(cache.dirtyMax, origin + glm::ivec2(size));
+                if (first.x < last.x && first.y < last.y)
+                    addStaticRegion(cascade, cache, first, last - first);
+            }
+            if (cascade.staticRegionCount)
+                stats.scrolled++;
+            else
+                stats.reused++;
+        }
+        cache.valid = true;
+        cache.origin = origin;
+        cache.dirty = false;
+    }
+}
+
+
+ShadowBlock CascadedShadowMap::block() const
+{
+    ShadowBlock block = {};
+    for (unsigned int i = 0; i < cascadeCount; i++)
+    {
+        block.cascadeMatrices[i] = cascades[i].viewProjection;
+        block.cascadeSplits[i] = cascades[i].splitFar;
+        block.cascadeTexelSizes[i] = cascades[i].texelSize;
+    }
+    block.shadowParams = glm::vec4(float(cascadeCount), SHADOW_CASCADE_BLEND, 1.0f / float(size), nearPlane);
+    block.lightDirection = glm::vec4(lightDirection, 0.0f);
+    return block;
+}
+
+
+void CascadedShadowMap::invalidateStatic()
+{
+    for (unsigned int i = 0; i < cascadeCount; i++)
+        staticCaches[i].valid = false;
+}
+
+
+void CascadedShadowMap::invalidateStatic(const BvhBox& bounds)
+{
+    if (bounds.min.x > bounds.max.x)
+        return;
+
+    // the box's light space footprint, the view is still the one the caches were drawn with
+    glm::vec2 footprintMin(FLT_MAX);
+    glm::vec2 footprintMax(-FLT_MAX);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 point((corner & 1) ? bounds.max.x : bounds.min.x, (corner & 2) ? bounds.max.y : bounds.min.y,
+            (corner & 4) ? bounds.max.z : bounds.min.z);
+        glm::vec2 lightPoint = glm::vec2(lightView * glm::vec4(point, 1.0f));
+        footprintMin = glm::min(footprintMin, lightPoint);
+        footprintMax = glm::max(footprintMax, lightPoint);
+    }
+
+    for (unsigned int i = 0; i < cascadeCount; i++)
+    {
+        StaticCache& cache = staticCaches[i];
+        if (!cache.valid)
+            continue;
+        glm::ivec2 first = glm::ivec2(glm::floor(footprintMin / cache.texelSize));
+        glm::ivec2 last = glm::ivec2(glm::ceil(footprintMax / cache.texelSize));
+        cache.dirtyMin = cache.dirty ? glm::min(cache.dirtyMin, first) : first;
+        cache.dirtyMax = cache.dirty ? glm::max(cache.dirtyMax, last) : last;
+        cache.dirty = true;
+    }
+}
+
+
+void CascadedShadowMap::beginStaticRegion(unsigned int cascade, unsigned int region)
+{
+    const ShadowRegion& rect = cascades[cascade].staticRegions[region];
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, staticFramebuffers[cascade]);
+    GLState::viewport(rect.x, rect.y, rect.width, rect.height);
+    // the clear ignores the viewport
+    GLState::enable(GL_SCISSOR_TEST);
+    glScissor(rect.x, rect.y, rect.width, rect.height);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    GLState::disable(GL_SCISSOR_TEST);
+}
+
+
+void CascadedShadowMap::copyStatic(unsigned int cascade)
+{
+    // the cascade's texels, unwrapped from the cache
+    glm::ivec2 origin = cascades[cascade].origin;
+    glm::ivec4 pieces[4];
+    int count = wrapPieces(origin, glm::ivec2(size), size, pieces);
+    GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffers[cascade]);
+    GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[cascade]);
+    for (int p = 0; p < count; p++)
+    {
+        const glm::ivec4& piece = pieces[p];
+        GLint sourceX = wrapTexel(piece.x, size);
+        GLint sourceY = wrapTexel(piece.y, size);
+        GLint targetX = piece.x - origin.x;
+        GLint targetY = piece.y - origin.y;
+        glBlitFramebuffer(sourceX, sourceY, sourceX + piece.z, sourceY + piece.w,
+            targetX, targetY, targetX + piece.z, targetY + piece.w, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    }
+}
+
+
+void CascadedShadowMap::resetStats()
+{
+    stats = {};
+}
+
+
+void CascadedShadowMap::printStats() const
+{
+    cout << "SHADOW:: over " << stats.frames << " frames " << stats.reused << " cascades reused their static depth, "
+        << stats.scrolled << " redrew the texels that moved in or changed, " << stats.redrawn << " redrew all of it ("
+        << (stats.frames ? float(stats.redrawn) / float(stats.frames) : 0.0f) << " per frame)" << endl;
+}
+
+
+void CascadedShadowMap::endFrame()
+{
+    stats.frames++;
+#if SHADOW_REPORT_FRAMES
+    if (++statFrames < SHADOW_REPORT_FRAMES)
+        return;
+    statFrames = 0;
+    printStats();
+    resetStats();
+#endif
+}
+
+
+void CascadedShadowMap::createLayers(unsigned int& layers, unsigned int* layerFramebuffers)
+{
+    glGenTextures(1, &layers);
+    GLState::activeTexture(GL_TEXTURE0);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, layers);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, cascadeCount, 0,
+        GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    GLfloat borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+    glGenFramebuffers(cascadeCount, layerFramebuffers);
+    for (unsigned int i = 0; i < cascadeCount; i++)
+    {
+        GLState::bindFramebuffer(GL_FRAMEBUFFER, layerFramebuffers[i]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, layers, 0, i);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+}
+
+
+void CascadedShadowMap::addStaticRegion(ShadowCascade& cascade, const StaticCache& cache, glm::ivec2 first,
+    glm::ivec2 extent)
+{
+    glm::ivec4 pieces[4];
+    int count = wrapPieces(first, extent, size, pieces);
+    for (int p = 0; p < count && cascade.staticRegionCount < SHADOW_MAX_STATIC_REGIONS; p++)
+    {
+        const glm::ivec4& piece = pieces[p];
+        float texelSize = cache.texelSize;
+        ShadowRegion& region = cascade.staticRegions[cascade.staticRegionCount++];
+        region.projection = glm::ortho(piece.x * texelSize, (piece.x + piece.z) * texelSize,
+            piece.y * texelSize, (piece.y + piece.w) * texelSize, cache.zNear, cache.zFar);
+        region.viewProjection = region.projection * lightView;
+        region.casterFrustum = Frustum::fromMatrix(region.viewProjection);
+        region.x = wrapTexel(piece.x, size);
+        region.y = wrapTexel(piece.y, size);
+        region.width = piece.z;
+        region.height = piece.w;
+    }
+}
\ No newline at end of file
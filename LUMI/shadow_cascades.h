@@ -0,0 +1,158 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bvh.h"
+#include "frustum_culling.h"
+#include "uniform_blocks.h"
+using namespace std;
+
+// split distribution between uniform (0) and logarithmic (1), the practical split scheme
+#define SHADOW_CASCADE_SPLIT_LAMBDA 0.75f
+// part of a cascade's depth range, at its far end, that fades into the next cascade
+#define SHADOW_CASCADE_BLEND 0.1f
+// print and reset the cache counters every this many frames (0: never)
+#define SHADOW_REPORT_FRAMES 600
+// rectangles a cascade's static cache can redraw in one update: the strips a move exposes and a
+// changed caster's footprint, each split in up to four where it wraps around the cache
+#define SHADOW_MAX_STATIC_REGIONS 12
+
+
+// a rectangle of a cascade's static cache to clear and draw the static casters into
+struct ShadowRegion
+{
+    glm::mat4 projection;       // orthographic over the rectangle's texels
+    glm::mat4 viewProjection;   // lightSpaceMatrix of its depth pass
+    Frustum   casterFrustum;
+    GLint     x, y;             // in the cache layer
+    GLsizei   width, height;
+};
+
+
+struct ShadowCascade
+{
+    glm::mat4 projection;       // orthographic, texel snapped
+    glm::mat4 view;             // the light's orientation, shared by all cascades
+    glm::mat4 viewProjection;   // world to light clip space, lightSpaceMatrix of its depth pass
+    Frustum   casterFrustum;    // world space, reaches back to every caster between light and slice
+    float     splitNear;        // view distance range of the camera frustum it covers
+    float     splitFar;
+    float     texelSize;        // world units per shadow texel
+    glm::ivec2 origin;          // first texel of the cascade on the light space texel grid
+    // parts of the static cache to redraw before copyStatic(), none when it was reused as it was
+    ShadowRegion staticRegions[SHADOW_MAX_STATIC_REGIONS];
+    unsigned int staticRegionCount;
+};
+
+struct ShadowCacheStats
+{
+    unsigned int frames;
+    unsigned int reused;        // cascades whose cached static depth was copied as it was
+    unsigned int scrolled;      // cascades that redrew only the texels a move exposed or a caster changed
+    unsigned int redrawn;       // cascades whose static casters were all drawn again
+};
+
+
+/*
+* Cascaded shadow map of a directional light, one layer of a depth texture
+* array per cascade.
+*
+* update() cuts the camera frustum into slices between the practical split
+* scheme's distances and fits a cascade around each: the slice's bounding
+* sphere, so the cascade keeps its size while the camera turns, with the
+* light space origin snapped to whole texels so static shadows don't shimmer
+* while it moves. The light's orientation is the same for every cascade and
+* the depth range is the light space extent of casterBounds, which doesn't
+* follow the camera; casterFrustum culls the casters of each cascade. Each layer has a framebuffer of its own, depth passes bind
+* framebuffers[i] and render with cascades[i].viewProjection.
+*
+* Receivers read the cascades from a ShadowBlock: the cascade is picked by
+* the fragment's view distance and fades into the next one over the last
+* SHADOW_CASCADE_BLEND of its range.
+*
+* Static casters are drawn into a second array, staticTexture, that is kept
+* between frames and doesn't depend on the camera: each layer is a toroidal
+* cache of the static depth on its cascade's light space texel grid, texel
+* (x, y) of the grid lives at (x mod size, y mod size). When the camera moves
+* the cascade by whole texels, only the strips it exposes are redrawn; the
+* light, the caster bounds or the cascade's texel size changing redraws the
+* whole layer, and a static caster changing redraws its footprint, which the
+* caller reports through invalidateStatic(). update() fills staticRegions
+* with those rectangles, the caller draws the static casters into each after
+* beginStaticRegion(); every frame copyStatic() then unwraps the cache into
+* the sampled layer and the dynamic casters are drawn over it with the
+* camera fitted viewProjection.
+*/
+class CascadedShadowMap
+{
+public:
+    // GL_DEPTH_COMPONENT24 array, cascadeCount layers of size x size
+    unsigned int  texture;
+    unsigned int  framebuffers[SHADOW_MAX_CASCADES];
+    // the same for the static casters' depth, kept between frames and never sampled
+    unsigned int  staticTexture;
+    unsigned int  staticFramebuffers[SHADOW_MAX_CASCADES];
+    GLsizei       size;
+    unsigned int  cascadeCount;
+    ShadowCascade cascades[SHADOW_MAX_CASCADES];
+
+
+    CascadedShadowMap(GLsizei size, unsigned int cascadeCount = SHADOW_MAX_CASCADES);
+    ~CascadedShadowMap();
+
+    CascadedShadowMap(const CascadedShadowMap&) = delete;
+    CascadedShadowMap& operator=(const CascadedShadowMap&) = delete;
+
+    // fit the cascades to the camera frustum from nearPlane to shadowDistance (fovY in radians),
+    // lightDirection is the way the light travels, casterBounds the world space box of every caster
+    // and receiver, static or dynamic
+    void update(const glm::mat4& cameraView, float fovY, float aspect, float nearPlane, float shadowDistance,
+        const glm::vec3& lightDirection, const BvhBox& casterBounds);
+
+    // receiver constants of the current cascades
+    ShadowBlock block() const;
+
+    // a static caster changed: every cascade, or those whose casters reach into the world space bounds
+    // (call it with the caster's bounds before and after a move), redraw their static depth next update()
+    void invalidateStatic();
+    void invalidateStatic(const BvhBox& bounds);
+
+    // GL thread: binds the cascade's static framebuffer and clears one of its staticRegions,
+    // the region's static casters draw next with its viewProjection
+    void beginStaticRegion(unsigned int cascade, unsigned int region);
+
+    // GL thread: the cascade's static depth into its sampled layer, before the dynamic casters draw
+    void copyStatic(unsigned int cascade);
+
+    ShadowCacheStats getStats() const { return stats; }
+    void resetStats();
+    void printStats() const;
+
+    // once per frame, prints and resets the counters every SHADOW_REPORT_FRAMES frames
+    void endFrame();
+
+private:
+    // what a layer of the static cache was drawn with
+    struct StaticCache
+    {
+        bool       valid;
+        glm::vec3  lightDirection;
+        float      texelSize;
+        float      zNear, zFar;
+        glm::ivec2 origin;          // the grid texels it holds, origin to origin + size
+        bool       dirty;           // texels of dirtyMin to dirtyMax (exclusive) changed since
+        glm::ivec2 dirtyMin, dirtyMax;
+    };
+
+    // a cascadeCount layer depth array and a framebuffer per layer
+    void createLayers(unsigned int& layers, unsigned int* layerFramebuffers);
+    // queue the grid texels first to first + extent of the cascade for a redraw
+    void addStaticRegion(ShadowCascade& cascade, const StaticCache& cache, glm::ivec2 first, glm::ivec2 extent);
+
+    glm::vec3        lightDirection;
+    float            nearPlane;
+    glm::mat4        lightView;
+    StaticCache      staticCaches[SHADOW_MAX_CASCADES];
+    ShadowCacheStats stats;
+    unsigned int     statFrames;
+};
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include "skybox.h"
+#include "gl_state.h"
 
 vector<string> faces
 {
@@ -63,8 +64,8 @@ Skybox::Skybox(const string& path)
 {
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::bindVertexArray(VAO);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
@@ -75,20 +76,18 @@ Skybox::Skybox(const string& path)
 void Skybox::draw(const Shader& shader)
 {
     shader.setInt("skybox", 0);
-    glDepthFunc(GL_LEQUAL);
-    glBindVertexArray(VAO);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLState::depthFunc(GL_LEQUAL);
+    GLState::bindVertexArray(VAO);
+    GLState::bindTextureUnit(0, GL_TEXTURE_CUBE_MAP, textureID);
     glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
-    glDepthFunc(GL_LESS);
+    GLState::depthFunc(GL_LESS);
 }
 
 
 unsigned int Skybox::loadCubemap(const string& path)
 {
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    GLState::bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++)
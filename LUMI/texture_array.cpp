@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <utility>
+
+#include "texture_array.h"
+#include "gl_state.h"
+#include "shader.h"
+
+
+namespace
+{
+    const char* const SLOT_LABELS[MATERIAL_SLOT_COUNT] = { "diffuse", "specular", "normal", "height" };
+
+    // what layer 0 holds, the value of a missing map
+    const GLfloat SLOT_DEFAULTS[MATERIAL_SLOT_COUNT][4] = {
+        { 1.0f, 1.0f, 1.0f, 1.0f },
+        { 0.0f, 0.0f, 0.0f, 1.0f },
+        { 0.5f, 0.5f, 1.0f, 1.0f },
+        { 0.0f, 0.0f, 0.0f, 1.0f }
+    };
+
+    pair<GLsizei, GLsizei> textureSize(unsigned int texture)
+    {
+        GLint width = 0, height = 0;
+        // bindTexture() leaves unit 0 active even when texture is already cached there
+        GLState::activeTexture(GL_TEXTURE0);
+        GLState::bindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+        return make_pair(width, height);
+    }
+
+    size_t mipChainBytes(GLsizei width, GLsizei height, GLsizei layers)
+    {
+        size_t total = 0;
+        while (true)
+        {
+            total += size_t(width) * height * 4 * layers;
+            if (width == 1 && height == 1)
+                return total;
+            width = max(width / 2, 1);
+            height = max(height / 2, 1);
+        }
+    }
+}
+
+
+MaterialTextureArrays::MaterialTextureArrays()
+{
+    material = 0;
+    for (unsigned int& array : arrays)
+        array = 0;
+    bytes = 0;
+    built = false;
+}
+
+
+MaterialTextureArrays::~MaterialTextureArrays()
+{
+    release();
+}
+
+
+bool MaterialTextureArrays::build(const vector<unsigned int>& materials)
+{
+    release();
+
+    // distinct textures per slot, in first use order
+    vector<unsigned int> textures[MATERIAL_SLOT_COUNT];
+    bool any = false;
+    for (unsigned int id : materials)
+    {
+        const Material& source = MaterialLibrary::get(id);
+        if (source.target != GL_TEXTURE_2D)
+            return false;
+        for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+        {
+            unsigned int texture = source.textures[slot];
+            if (texture != 0 && find(textures[slot].begin(), textures[slot].end(), texture) == textures[slot].end())
+            {
+                textures[slot].push_back(texture);
+                any = true;
+            }
+        }
+    }
+    if (!any)
+        return false;
+    for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+    {
+        if (textures[slot].size() + 1 > TEXTURE_ARRAY_MAX_LAYERS)
+        {
+            cout << "WARNING::TEXTURE_ARRAYS:: " << textures[slot].size() << " " << SLOT_LABELS[slot]
+                << " textures do not fit one array, drawing per material" << endl;
+            return false;
+        }
+    }
+
+    // the copies render into the layers: keep the caller's framebuffer, viewport and blending
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    bool blend = glIsEnabled(GL_BLEND) == GL_TRUE;
+    GLState::disable(GL_BLEND);
+
+    Shader copyShader("glsl/texture_array_copy.vert", "glsl/texture_array_copy.frag");
+    copyShader.use();
+    copyShader.setInt("source", 0);
+
+    for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+    {
+        if (textures[slot].empty())
+            continue;
+
+        // size bucket: the most common size, everything else is resized into it
+        map<pair<GLsizei, GLsizei>, unsigned int> sizes;
+        for (unsigned int texture : textures[slot])
+            sizes[textureSize(texture)]++;
+        pair<GLsizei, GLsizei> bucket = sizes.begin()->first;
+        for (const auto& size : sizes)
+            if (size.second > sizes[bucket])
+                bucket = size.first;
+        while (bucket.first > TEXTURE_ARRAY_MAX_SIZE || bucket.second > TEXTURE_ARRAY_MAX_SIZE)
+            bucket = make_pair(max(bucket.first / 2, 1), max(bucket.second / 2, 1));
+
+        arrays[slot] = copyToArray(static_cast<MaterialSlot>(slot), textures[slot], bucket.first, bucket.second, copyShader.ID);
+        size_t arrayBytes = mipChainBytes(bucket.first, bucket.second, GLsizei(textures[slot].size() + 1));
+        bytes += arrayBytes;
+        cout << "TEXTURE_ARRAYS:: " << SLOT_LABELS[slot] << ": " << textures[slot].size() << " layers of "
+            << bucket.first << "x" << bucket.second << " (" << textures[slot].size() - sizes[bucket] << " resized), "
+            << arrayBytes / (1024 * 1024) << " MB" << endl;
+    }
+
+    GLState::deleteProgram(copyShader.ID);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    GLState::viewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    if (blend)
+        GLState::enable(GL_BLEND);
+
+    for (unsigned int id : materials)
+    {
+        const Material& source = MaterialLibrary::get(id);
+        MaterialLayers layer(0);
+        for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+        {
+            auto found = find(textures[slot].begin(), textures[slot].end(), source.textures[slot]);
+            if (source.textures[slot] != 0 && found != textures[slot].end())
+                layer[slot] = static_cast<glm::u8>(found - textures[slot].begin() + 1);
+        }
+        layers[id] = layer;
+    }
+
+    Material arrayMaterial = {};
+    arrayMaterial.target = GL_TEXTURE_2D_ARRAY;
+    arrayMaterial.params = MaterialLibrary::defaultParams();
+    for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+        arrayMaterial.textures[slot] = arrays[slot];
+    material = MaterialLibrary::add(arrayMaterial);
+    built = true;
+    return true;
+}
+
+
+unsigned int MaterialTextureArrays::copyToArray(MaterialSlot slot, const vector<unsigned int>& textures,
+    GLsizei width, GLsizei height, unsigned int copyProgram)
+{
+    GLsizei layerCount = static_cast<GLsizei>(textures.size() + 1);
+    unsigned int array;
+    glGenTextures(1, &array);
+    GLState::activeTexture(GL_TEXTURE0);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, array);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // attribute-less fullscreen triangle, the core profile still wants a vertex array bound
+    unsigned int framebuffer, vertexArray;
+    glGenFramebuffers(1, &framebuffer);
+    glGenVertexArrays(1, &vertexArray);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    GLState::bindVertexArray(vertexArray);
+    GLState::useProgram(copyProgram);
+    GLState::viewport(0, 0, width, height);
+
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array, 0, 0);
+    glClearBufferfv(GL_COLOR, 0, SLOT_DEFAULTS[slot]);
+    for (size_t i = 0; i < textures.size(); i++)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array, 0, static_cast<GLint>(i + 1));
+        GLState::bindTextureUnit(0, GL_TEXTURE_2D, textures[i]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::deleteFramebuffers(1, &framebuffer);
+    GLState::deleteVertexArrays(1, &vertexArray);
+
+    // the copies sampled through bindTextureUnit(), which leaves GL's active unit anywhere
+    GLState::activeTexture(GL_TEXTURE0);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, array);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    return array;
+}
+
+
+MaterialLayers MaterialTextureArrays::layersOf(unsigned int material) const
+{
+    auto found = layers.find(material);
+    return found != layers.end() ? found->second : MaterialLayers(0);
+}
+
+
+void MaterialTextureArrays::release()
+{
+    for (unsigned int& array : arrays)
+    {
+        if (array != 0)
+            GLState::deleteTextures(1, &array);
+        array = 0;
+    }
+    layers.clear();
+    bytes = 0;
+    built = false;
+}
\ No newline at end of file
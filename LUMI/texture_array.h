@@ -0,0 +1,72 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "material.h"
+using namespace std;
+
+// layers are copied at most this large, larger buckets are halved until they fit
+#define TEXTURE_ARRAY_MAX_SIZE 1024
+// layer indices travel as unsigned bytes, layer 0 is the slot's default
+#define TEXTURE_ARRAY_MAX_LAYERS 255
+// vertex attribute of the per-vertex layer indices (uvec4, one layer per material slot)
+#define TEXTURE_ARRAY_LAYER_ATTRIBUTE 7
+
+
+// layer of each material slot
+typedef glm::u8vec4 MaterialLayers;
+
+
+/*
+* The textures of a set of materials copied into one GL_TEXTURE_2D_ARRAY per
+* material slot, so meshes with different materials can share a draw.
+*
+* Every slot gets a single size bucket: the size most of its textures have
+* (capped at TEXTURE_ARRAY_MAX_SIZE). Outliers are resized into it by the
+* copy, which renders each source into its layer, so any source format works
+* and the arrays are plain RGBA8 with their own mipmaps. Layer 0 holds the
+* value a material without a map of that slot would sample: white diffuse,
+* no specular, a flat normal, zero height.
+*
+* The arrays are bound as a MaterialLibrary record like any other material,
+* shaders sample them through texture_<type>_array samplers on the slot's
+* fixed unit and pick the layer from the TEXTURE_ARRAY_LAYER_ATTRIBUTE stream.
+*/
+class MaterialTextureArrays
+{
+public:
+    // MaterialLibrary record binding the arrays, valid after a successful build()
+    unsigned int material;
+
+
+    MaterialTextureArrays();
+    ~MaterialTextureArrays();
+
+    MaterialTextureArrays(const MaterialTextureArrays&) = delete;
+    MaterialTextureArrays& operator=(const MaterialTextureArrays&) = delete;
+
+    // copy the textures of the MaterialLibrary records, false (and nothing built) if
+    // there is nothing to copy or a slot needs more than TEXTURE_ARRAY_MAX_LAYERS layers
+    bool build(const vector<unsigned int>& materials);
+
+    bool isBuilt() const { return built; }
+
+    // layers of a material passed to build()
+    MaterialLayers layersOf(unsigned int material) const;
+
+    size_t gpuBytes() const { return bytes; }
+
+private:
+    // copy every texture into a new array of the given size, returns its id
+    unsigned int copyToArray(MaterialSlot slot, const vector<unsigned int>& textures,
+        GLsizei width, GLsizei height, unsigned int copyProgram);
+
+    void release();
+
+    unsigned int                                   arrays[MATERIAL_SLOT_COUNT];
+    unordered_map<unsigned int, MaterialLayers>    layers;
+    size_t                                         bytes;
+    bool                                           built;
+};
\ No newline at end of file
@@ -0,0 +1,608 @@
+#include <stb_image/stb_image.h>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "texture_cooker.h"
+#include "gl_state.h"
+
+const uint32_t DDS_MAGIC = 0x20534444;          // "DDS "
+const uint32_t DDS_FOURCC_DX10 = 0x30315844;    // "DX10"
+const uint32_t DDS_FOURCC_DXT1 = 0x31545844;    // "DXT1"
+const uint32_t DDS_FOURCC_DXT5 = 0x35545844;    // "DXT5"
+const uint32_t DDS_FOURCC_ATI1 = 0x31495441;    // "ATI1"
+const uint32_t DDS_FOURCC_ATI2 = 0x32495441;    // "ATI2"
+const uint32_t DDS_FOURCC_BC4U = 0x55344342;    // "BC4U"
+const uint32_t DDS_FOURCC_BC5U = 0x55354342;    // "BC5U"
+const uint32_t COOKER_TAG = 0x494D554C;         // "LUMI", stored in dwReserved1[0]
+
+// DXGI_FORMAT values used in the DX10 header
+const uint32_t DXGI_FORMAT_BC1_UNORM = 71;
+const uint32_t DXGI_FORMAT_BC3_UNORM = 77;
+const uint32_t DXGI_FORMAT_BC4_UNORM = 80;
+const uint32_t DXGI_FORMAT_BC5_UNORM = 83;
+const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+
+struct DDSPixelFormat
+{
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t masks[4];
+};
+
+struct DDSHeader
+{
+    uint32_t       size;
+    uint32_t       flags;
+    uint32_t       height;
+    uint32_t       width;
+    uint32_t       pitchOrLinearSize;
+    uint32_t       depth;
+    uint32_t       mipMapCount;
+    uint32_t       reserved1[11];
+    DDSPixelFormat pixelFormat;
+    uint32_t       caps;
+    uint32_t       caps2;
+    uint32_t       caps3;
+    uint32_t       caps4;
+    uint32_t       reserved2;
+};
+
+struct DDSHeaderDX10
+{
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+
+static size_t blockBytes(GLenum format)
+{
+    return (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1) ? 8 : 16;
+}
+
+
+static size_t levelBytes(GLenum format, int width, int height)
+{
+    return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+
+static bool statTime(const string& path, int64_t& mtime)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path.c_str(), &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+#endif
+    mtime = static_cast<int64_t>(st.st_mtime);
+    return true;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// block encoders, input is always a 4x4 block of RGBA8 pixels
+// -------------------------------------------------------------------------------------------------
+
+static uint16_t packRGB565(const float color[3])
+{
+    int r = min(31, max(0, int(color[0] * 31.0f / 255.0f + 0.5f)));
+    int g = min(63, max(0, int(color[1] * 63.0f / 255.0f + 0.5f)));
+    int b = min(31, max(0, int(color[2] * 31.0f / 255.0f + 0.5f)));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+
+static void unpackRGB565(uint16_t packed, int color[3])
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+
+// endpoints along the principal axis of the block colors, 4 color mode
+static void encodeBC1Block(const unsigned char block[16][4], unsigned char* out)
+{
+    float mean[3] = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += block[i][c] / 16.0f;
+
+    float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; i++)
+    {
+        float r = block[i][0] - mean[0], g = block[i][1] - mean[1], b = block[i][2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+
+    // power iteration for the principal axis
+    float axis[3] = { 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float length = max(fabs(x), max(fabs(y), fabs(z)));
+        if (length < 1e-6f)
+            break;
+        axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+    }
+
+    float minT = 1e30f, maxT = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] +
+            (block[i][2] - mean[2]) * axis[2];
+        minT = min(minT, t);
+        maxT = max(maxT, t);
+    }
+    float axisLength2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+    if (axisLength2 > 0.0f)
+    {
+        minT /= axisLength2;
+        maxT /= axisLength2;
+    }
+
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++)
+    {
+        end0[c] = min(255.0f, max(0.0f, mean[c] + axis[c] * maxT));
+        end1[c] = min(255.0f, max(0.0f, mean[c] + axis[c] * minT));
+    }
+    uint16_t c0 = packRGB565(end0), c1 = packRGB565(end1);
+    if (c0 < c1)
+        swap(c0, c1);
+
+    int palette[4][3];
+    unpackRGB565(c0, palette[0]);
+    unpackRGB565(c1, palette[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t indices = 0;
+    if (c0 != c1)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; p++)
+            {
+                int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+                int error = dr * dr + dg * dg + db * db;
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices |= uint32_t(best) << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xFF; out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF; out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+
+// 8 value mode (a0 > a1) spanning the block range
+static void encodeBC4Block(const unsigned char values[16], unsigned char* out)
+{
+    int lo = 255, hi = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        lo = min(lo, int(values[i]));
+        hi = max(hi, int(values[i]));
+    }
+
+    uint64_t indices = 0;
+    if (hi != lo)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            // 0 -> a0 (hi), 7 -> a1 (lo), interpolated steps map to palette 2..7
+            int t = ((hi - values[i]) * 14 + (hi - lo)) / (2 * (hi - lo));
+            int index = t == 0 ? 0 : (t == 7 ? 1 : t + 1);
+            indices |= uint64_t(index) << (3 * i);
+        }
+    }
+
+    out[0] = static_cast<unsigned char>(hi);
+    out[1] = static_cast<unsigned char>(lo);
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (indices >> (8 * i)) & 0xFF;
+}
+
+
+static void encodeBlock(const unsigned char block[16][4], TextureCodec codec, unsigned char* out)
+{
+    unsigned char channel[16];
+    switch (codec)
+    {
+    case TextureCodec::BC1:
+        encodeBC1Block(block, out);
+        break;
+    case TextureCodec::BC3:
+        for (int i = 0; i < 16; i++)
+            channel[i] = block[i][3];
+        encodeBC4Block(channel, out);
+        encodeBC1Block(block, out + 8);
+        break;
+    case TextureCodec::BC4:
+        for (int i = 0; i < 16; i++)
+            channel[i] = block[i][0];
+        encodeBC4Block(channel, out);
+        break;
+    case TextureCodec::BC5:
+        for (int c = 0; c < 2; c++)
+        {
+            for (int i = 0; i < 16; i++)
+                channel[i] = block[i][c];
+            encodeBC4Block(channel, out + 8 * c);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+
+// 2x2 box filter, odd edges clamp; normal maps are renormalized
+static vector<unsigned char> downsample(const vector<unsigned char>& rgba, int width, int height,
+    bool normalMap)
+{
+    int newWidth = max(1, width / 2), newHeight = max(1, height / 2);
+    vector<unsigned char> result(size_t(newWidth) * newHeight * 4);
+    for (int y = 0; y < newHeight; y++)
+    {
+        for (int x = 0; x < newWidth; x++)
+        {
+            float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for (int dy = 0; dy < 2; dy++)
+            {
+                for (int dx = 0; dx < 2; dx++)
+                {
+                    int sx = min(width - 1, 2 * x + dx), sy = min(height - 1, 2 * y + dy);
+                    const unsigned char* texel = &rgba[(size_t(sy) * width + sx) * 4];
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += texel[c] * 0.25f;
+                }
+            }
+            if (normalMap)
+            {
+                float n[3], length = 0.0f;
+                for (int c = 0; c < 3; c++)
+                {
+                    n[c] = sum[c] / 127.5f - 1.0f;
+                    length += n[c] * n[c];
+                }
+                length = sqrt(max(length, 1e-8f));
+                for (int c = 0; c < 3; c++)
+                    sum[c] = (n[c] / length + 1.0f) * 127.5f;
+            }
+            unsigned char* texel = &result[(size_t(y) * newWidth + x) * 4];
+            for (int c = 0; c < 4; c++)
+                texel[c] = static_cast<unsigned char>(min(255.0f, max(0.0f, sum[c] + 0.5f)));
+        }
+    }
+    return result;
+}
+
+
+TextureCodec TextureCooker::chooseCodec(const string& path, const unsigned char* pixels,
+    int width, int height, int components)
+{
+    string name = path;
+    for (char& c : name)
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+
+    if (name.find("_norm") != string::npos || name.find("_nrm") != string::npos)
+        return TextureCodec::BC5;
+    if (components == 1 || name.find("_mask") != string::npos)
+        return TextureCodec::BC4;
+    if (components == 2 || components == 4)
+    {
+        size_t count = size_t(width) * height;
+        for (size_t i = 0; i < count; i++)
+            if (pixels[i * components + components - 1] != 255)
+                return TextureCodec::BC3;
+    }
+    return TextureCodec::BC1;
+}
+
+
+CompressedImage TextureCooker::compress(const unsigned char* pixels, int width, int height,
+    int components, TextureCodec codec)
+{
+    CompressedImage image;
+    image.width = width;
+    image.height = height;
+    switch (codec)
+    {
+    case TextureCodec::BC1: image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;
+    case TextureCodec::BC3: image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+    case TextureCodec::BC4: image.format = GL_COMPRESSED_RED_RGTC1; break;
+    case TextureCodec::BC5: image.format = GL_COMPRESSED_RG_RGTC2; break;
+    case TextureCodec::BC7: image.format = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
+    }
+    if (codec == TextureCodec::BC7)
+    {
+        cout << "TEXTURE_COOKER:: BC7 encoding is not supported, use an external encoder" << endl;
+        return image;
+    }
+
+    // expand to RGBA8, grayscale goes to every color channel
+    vector<unsigned char> level(size_t(width) * height * 4);
+    for (size_t i = 0; i < size_t(width) * height; i++)
+    {
+        const unsigned char* src = pixels + i * components;
+        unsigned char* dst = &level[i * 4];
+        dst[0] = src[0];
+        dst[1] = components >= 3 ? src[1] : src[0];
+        dst[2] = components >= 3 ? src[2] : src[0];
+        dst[3] = components == 4 ? src[3] : (components == 2 ? src[1] : 255);
+    }
+
+    int levelWidth = width, levelHeight = height;
+    for (;;)
+    {
+        size_t offset = image.data.size();
+        image.levelOffsets.push_back(offset);
+        image.levelSizes.push_back(levelBytes(image.format, levelWidth, levelHeight));
+        image.data.resize(offset + image.levelSizes.back());
+
+        unsigned char* out = &image.data[offset];
+        for (int by = 0; by < levelHeight; by += 4)
+        {
+            for (int bx = 0; bx < levelWidth; bx += 4)
+            {
+                unsigned char block[16][4];
+                for (int i = 0; i < 16; i++)
+                {
+                    int x = min(levelWidth - 1, bx + (i & 3)), y = min(levelHeight - 1, by + (i >> 2));
+                    memcpy(block[i], &level[(size_t(y) * levelWidth + x) * 4], 4);
+                }
+                encodeBlock(block, codec, out);
+                out += blockBytes(image.format);
+            }
+        }
+
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        level = downsample(level, levelWidth, levelHeight, codec == TextureCodec::BC5);
+        levelWidth = max(1, levelWidth / 2);
+        levelHeight = max(1, levelHeight / 2);
+    }
+    return image;
+}
+
+
+bool TextureCooker::cook(const string& sourcePath)
+{
+    int width, height, components;
+    unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &components, 0);
+    if (!pixels)
+        return false;
+
+    TextureCodec codec = chooseCodec(sourcePath, pixels, width, height, components);
+    CompressedImage image = compress(pixels, width, height, components, codec);
+    stbi_image_free(pixels);
+    return !image.data.empty() && write(sourcePath + COOKED_TEXTURE_EXTENSION, image);
+}
+
+
+bool TextureCooker::isFresh(const string& sourcePath)
+{
+    string cookedPath = sourcePath + COOKED_TEXTURE_EXTENSION;
+    int64_t sourceTime, cookedTime;
+    if (!statTime(sourcePath, sourceTime) || !statTime(cookedPath, cookedTime) || cookedTime < sourceTime)
+        return false;
+
+    ifstream file(cookedPath, ios::binary);
+    uint32_t magic;
+    DDSHeader header;
+    if (!file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) ||
+        !file.read(reinterpret_cast<char*>(&header), sizeof(header)) || magic != DDS_MAGIC)
+        return false;
+    // files from external tools carry no tag and are trusted as they are
+    return header.reserved1[0] != COOKER_TAG || header.reserved1[1] == TEXTURE_COOKER_VERSION;
+}
+
+
+bool TextureCooker::read(const string& cookedPath, CompressedImage& image)
+{
+    ifstream file(cookedPath, ios::binary);
+    uint32_t magic;
+    DDSHeader header;
+    if (!file.read(reinterpret_cast<char*>(&magic), sizeof(magic)) ||
+        !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        magic != DDS_MAGIC || header.size != sizeof(DDSHeader))
+        return false;
+
+    uint32_t fourCC = header.pixelFormat.fourCC;
+    if (fourCC == DDS_FOURCC_DX10)
+    {
+        DDSHeaderDX10 dx10;
+        if (!file.read(reinterpret_cast<char*>(&dx10), sizeof(dx10)) || dx10.arraySize > 1)
+            return false;
+        switch (dx10.dxgiFormat)
+        {
+        case DXGI_FORMAT_BC1_UNORM: image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; break;
+        case DXGI_FORMAT_BC3_UNORM: image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+        case DXGI_FORMAT_BC4_UNORM: image.format = GL_COMPRESSED_RED_RGTC1; break;
+        case DXGI_FORMAT_BC5_UNORM: image.format = GL_COMPRESSED_RG_RGTC2; break;
+        case DXGI_FORMAT_BC7_UNORM: image.format = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
+        default: return false;
+        }
+    }
+    else if (fourCC == DDS_FOURCC_DXT1)
+        image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    else if (fourCC == DDS_FOURCC_DXT5)
+        image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    else if (fourCC == DDS_FOURCC_ATI1 || fourCC == DDS_FOURCC_BC4U)
+        image.format = GL_COMPRESSED_RED_RGTC1;
+    else if (fourCC == DDS_FOURCC_ATI2 || fourCC == DDS_FOURCC_BC5U)
+        image.format = GL_COMPRESSED_RG_RGTC2;
+    else
+        return false;
+
+    image.width = static_cast<int>(header.width);
+    image.height = static_cast<int>(header.height);
+    int levels = max(1u, header.mipMapCount);
+    int levelWidth = image.width, levelHeight = image.height;
+    size_t total = 0;
+    image.levelOffsets.clear();
+    image.levelSizes.clear();
+    for (int i = 0; i < levels; i++)
+    {
+        image.levelOffsets.push_back(total);
+        image.levelSizes.push_back(levelBytes(image.format, levelWidth, levelHeight));
+        total += image.levelSizes.back();
+        levelWidth = max(1, levelWidth / 2);
+        levelHeight = max(1, levelHeight / 2);
+    }
+
+    image.data.resize(total);
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(image.data.data()), total));
+}
+
+
+bool TextureCooker::write(const string& cookedPath, const CompressedImage& image)
+{
+    DDSHeader header = {};
+    header.size = sizeof(DDSHeader);
+    // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+    header.height = image.height;
+    header.width = image.width;
+    header.pitchOrLinearSize = static_cast<uint32_t>(image.levelSizes.empty() ? 0 : image.levelSizes[0]);
+    header.mipMapCount = static_cast<uint32_t>(image.levelSizes.size());
+    header.reserved1[0] = COOKER_TAG;
+    header.reserved1[1] = TEXTURE_COOKER_VERSION;
+    header.pixelFormat.size = sizeof(DDSPixelFormat);
+    header.pixelFormat.flags = 0x4;     // DDPF_FOURCC
+    header.pixelFormat.fourCC = DDS_FOURCC_DX10;
+    header.caps = 0x1000 | 0x400000 | 0x8;  // TEXTURE | MIPMAP | COMPLEX
+
+    DDSHeaderDX10 dx10 = {};
+    dx10.resourceDimension = 3;     // TEXTURE2D
+    dx10.arraySize = 1;
+    switch (image.format)
+    {
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: dx10.dxgiFormat = DXGI_FORMAT_BC1_UNORM; break;
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: dx10.dxgiFormat = DXGI_FORMAT_BC3_UNORM; break;
+    case GL_COMPRESSED_RED_RGTC1: dx10.dxgiFormat = DXGI_FORMAT_BC4_UNORM; break;
+    case GL_COMPRESSED_RG_RGTC2: dx10.dxgiFormat = DXGI_FORMAT_BC5_UNORM; break;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM: dx10.dxgiFormat = DXGI_FORMAT_BC7_UNORM; break;
+    default: return false;
+    }
+
+    // write to a temporary file first so a half written texture is never picked up
+    string tempPath = cookedPath + ".tmp";
+    {
+        ofstream file(tempPath, ios::binary | ios::trunc);
+        if (!file)
+            return false;
+        file.write(reinterpret_cast<const char*>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(&dx10), sizeof(dx10));
+        file.write(reinterpret_cast<const char*>(image.data.data()), image.data.size());
+        if (!file)
+        {
+            file.close();
+            remove(tempPath.c_str());
+            return false;
+        }
+    }
+    remove(cookedPath.c_str());
+    if (rename(tempPath.c_str(), cookedPath.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+bool TextureCooker::isSupported(GLenum format)
+{
+    // RGTC is core since 3.0, S3TC and BPTC are extensions on a 3.3 context
+    static int s3tc = -1, bptc = -1;
+    if (s3tc < 0)
+    {
+        s3tc = bptc = 0;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (!name)
+                continue;
+            if (strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+                s3tc = 1;
+            else if (strcmp(name, "GL_ARB_texture_compression_bptc") == 0)
+                bptc = 1;
+        }
+    }
+
+    switch (format)
+    {
+    case GL_COMPRESSED_RED_RGTC1:
+    case GL_COMPRESSED_RG_RGTC2:
+        return true;
+    case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return s3tc == 1;
+    case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        return bptc == 1;
+    default:
+        return false;
+    }
+}
+
+
+unsigned int TextureCooker::upload(const CompressedImage& image)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
+
+    int levelWidth = image.width, levelHeight = image.height;
+    for (size_t i = 0; i < image.levelSizes.size(); i++)
+    {
+        glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), image.format, levelWidth, levelHeight, 0,
+            static_cast<GLsizei>(image.levelSizes[i]), &image.data[image.levelOffsets[i]]);
+        levelWidth = max(1, levelWidth / 2);
+        levelHeight = max(1, levelHeight / 2);
+    }
+
+    // precomputed chain, incomplete chains must not sample missing levels
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.levelSizes.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.levelSizes.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
\ No newline at end of file
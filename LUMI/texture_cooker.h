@@ -0,0 +1,71 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+// GL_EXT_texture_compression_s3tc / GL_ARB_texture_compression_bptc, not part of the 3.3 core loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+// cooked textures are stored next to their source, e.g. lion.png -> lion.png.dds
+#define COOKED_TEXTURE_EXTENSION ".dds"
+// bump whenever the encoder output changes so old cooked files are rebuilt
+#define TEXTURE_COOKER_VERSION 1
+// cook missing/stale textures while loading models (first run is slower, later runs upload BCn)
+#define TEXTURE_COOK_ON_LOAD 1
+
+
+enum class TextureCodec
+{
+    BC1,    // opaque color
+    BC3,    // color + alpha
+    BC4,    // single channel: masks, grayscale specular
+    BC5,    // two channel tangent space normal maps, z is reconstructed in the shader
+    BC7     // loaded if present, not produced by the cooker
+};
+
+
+// block compressed image with its full mip chain, as stored in a DDS file
+struct CompressedImage
+{
+    GLenum                format;
+    int                   width;
+    int                   height;
+    vector<unsigned char> data;
+    vector<size_t>        levelOffsets;
+    vector<size_t>        levelSizes;
+};
+
+
+class TextureCooker
+{
+public:
+    // pick a codec from the file name and the pixels (normal maps, masks, alpha)
+    static TextureCodec chooseCodec(const string& path, const unsigned char* pixels,
+        int width, int height, int components);
+
+    // build the mip chain (box filter) and encode every level, CPU only
+    static CompressedImage compress(const unsigned char* pixels, int width, int height,
+        int components, TextureCodec codec);
+
+    // cook sourcePath into sourcePath + COOKED_TEXTURE_EXTENSION, CPU only (offline tool: TextureCook.cpp)
+    static bool cook(const string& sourcePath);
+
+    // cooked file exists, is newer than its source and was written by this cooker version
+    static bool isFresh(const string& sourcePath);
+
+    static bool read(const string& cookedPath, CompressedImage& image);
+    static bool write(const string& cookedPath, const CompressedImage& image);
+
+    // GL thread only
+    static bool isSupported(GLenum format);
+    static unsigned int upload(const CompressedImage& image);
+};
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include <glad/glad.h>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "texture_registry.h"
+#include "gl_state.h"
+
+
+TextureRegistry& TextureRegistry::instance()
+{
+    static TextureRegistry registry;
+    return registry;
+}
+
+
+TextureRegistry::TextureRegistry()
+{
+    stats = {};
+}
+
+
+unsigned int TextureRegistry::acquire(const string& key)
+{
+    lock_guard<mutex> lock(registryMutex);
+    auto found = byPath.find(key);
+    if (found == byPath.end())
+        return 0;
+
+    Entry& entry = entries[found->second];
+    entry.refCount++;
+    stats.pathHits++;
+    stats.bytesSaved += entry.bytes;
+    return found->second;
+}
+
+
+// level 0 of a registered texture holds the same bytes, read back on the GL thread
+static bool levelMatches(unsigned int id, const TextureContent& content)
+{
+    GLState::activeTexture(GL_TEXTURE0);
+    GLState::bindTexture(GL_TEXTURE_2D, id);
+    vector<unsigned char> level(content.levelSize);
+    if (content.compressed)
+    {
+        GLint size = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+        if (size_t(size) != content.levelSize)
+            return false;
+        glGetCompressedTexImage(GL_TEXTURE_2D, 0, level.data());
+    }
+    else
+    {
+        // rows of the decoded pixels are tightly packed
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, content.format, GL_UNSIGNED_BYTE, level.data());
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
+    return memcmp(level.data(), content.level, content.levelSize) == 0;
+}
+
+
+unsigned int TextureRegistry::acquireByContent(const string& key, const TextureContent& content)
+{
+    lock_guard<mutex> lock(registryMutex);
+    auto found = byContent.find(content.hash);
+    if (content.hash == 0 || found == byContent.end())
+        return 0;
+
+    // a 64 bit hash can collide, only identical images are shared
+    Entry& entry = entries[found->second];
+    if (entry.width != content.width || entry.height != content.height || entry.format != content.format ||
+        !levelMatches(found->second, content))
+        return 0;
+
+    entry.refCount++;
+    stats.contentHits++;
+    stats.bytesSaved += entry.bytes;
+    byPath[key] = found->second;
+    return found->second;
+}
+
+
+void TextureRegistry::add(const string& key, const TextureContent& content, unsigned int id, size_t bytes)
+{
+    lock_guard<mutex> lock(registryMutex);
+    Entry entry;
+    entry.refCount = 1;
+    entry.contentHash = content.hash;
+    entry.width = content.width;
+    entry.height = content.height;
+    entry.format = content.format;
+    entry.bytes = bytes;
+    entries[id] = entry;
+    byPath[key] = id;
+    // images that failed to decode have no content to share, a colliding hash keeps its first texture
+    if (content.hash != 0)
+        byContent.emplace(content.hash, id);
+    stats.misses++;
+    stats.bytesResident += bytes;
+}
+
+
+void TextureRegistry::release(unsigned int id)
+{
+    lock_guard<mutex> lock(registryMutex);
+    auto found = entries.find(id);
+    if (found == entries.end() || --found->second.refCount > 0)
+        return;
+
+    auto content = byContent.find(found->second.contentHash);
+    if (content != byContent.end() && content->second == id)
+        byContent.erase(content);
+    for (auto path = byPath.begin(); path != byPath.end();)
+    {
+        if (path->second == id)
+            path = byPath.erase(path);
+        else
+            ++path;
+    }
+    stats.bytesResident -= found->second.bytes;
+    entries.erase(found);
+    GLState::deleteTextures(1, &id);
+}
+
+
+TextureRegistryStats TextureRegistry::getStats()
+{
+    lock_guard<mutex> lock(registryMutex);
+    return stats;
+}
+
+
+void TextureRegistry::printStats()
+{
+    size_t count;
+    TextureRegistryStats current;
+    {
+        lock_guard<mutex> lock(registryMutex);
+        count = entries.size();
+        current = stats;
+    }
+    cout << "TEXTURE_REGISTRY:: " << count << " textures, "
+        << current.bytesResident / (1024.0 * 1024.0) << " MB resident, "
+        << current.misses << " misses, " << current.pathHits << " path hits, "
+        << current.contentHits << " content hits, "
+        << current.bytesSaved / (1024.0 * 1024.0) << " MB saved" << endl;
+}
+
+
+string TextureRegistry::canonicalPath(const string& path)
+{
+    string unified = path;
+    for (char& c : unified)
+    {
+        if (c == '\\')
+            c = '/';
+#ifdef _WIN32
+        c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+#endif
+    }
+
+    // resolve "." and ".." segments
+    vector<string> segments;
+    bool absolute = !unified.empty() && unified[0] == '/';
+    size_t start = 0;
+    while (start <= unified.size())
+    {
+        size_t end = unified.find('/', start);
+        if (end == string::npos)
+            end = unified.size();
+        string segment = unified.substr(start, end - start);
+        if (segment == "..")
+        {
+            if (!segments.empty() && segments.back() != "..")
+                segments.pop_back();
+            else if (!absolute)
+                segments.push_back(segment);
+        }
+        else if (!segment.empty() && segment != ".")
+            segments.push_back(segment);
+        start = end + 1;
+    }
+
+    string canonical = absolute ? "/" : "";
+    for (size_t i = 0; i < segments.size(); i++)
+    {
+        if (i > 0)
+            canonical += '/';
+        canonical += segments[i];
+    }
+    return canonical;
+}
+
+
+// MurmurHash64A over the pixels, seeded with the image dimensions
+uint64_t TextureRegistry::hashContent(const unsigned char* data, int width, int height, int components)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    size_t length = size_t(width) * height * components;
+    uint64_t seed = (uint64_t(width) << 32) ^ (uint64_t(height) << 8) ^ uint64_t(components);
+    uint64_t h = seed ^ (length * m);
+
+    size_t blocks = length / 8;
+    for (size_t i = 0; i < blocks; i++)
+    {
+        uint64_t k;
+        memcpy(&k, data + i * 8, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char* tail = data + blocks * 8;
+    switch (length & 7)
+    {
+    case 7: h ^= uint64_t(tail[6]) << 48;
+    case 6: h ^= uint64_t(tail[5]) << 40;
+    case 5: h ^= uint64_t(tail[4]) << 32;
+    case 4: h ^= uint64_t(tail[3]) << 24;
+    case 3: h ^= uint64_t(tail[2]) << 16;
+    case 2: h ^= uint64_t(tail[1]) << 8;
+    case 1: h ^= uint64_t(tail[0]);
+        h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h != 0 ? h : 1;
+}
\ No newline at end of file
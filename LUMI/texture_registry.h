@@ -0,0 +1,90 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+using namespace std;
+
+
+struct TextureRegistryStats
+{
+    unsigned int pathHits;      // same canonical path requested again
+    unsigned int contentHits;   // different path, identical decoded image
+    unsigned int misses;        // new GL texture created
+    size_t       bytesResident; // approximate GPU bytes of live textures
+    size_t       bytesSaved;    // GPU bytes not allocated thanks to hits
+};
+
+
+// a decoded image as acquireByContent compares it before sharing a texture
+struct TextureContent
+{
+    uint64_t             hash;          // hashContent, 0: nothing to share
+    int                  width;
+    int                  height;
+    GLenum               format;        // GL_RED/GL_RGB/GL_RGBA pixels or a compressed format
+    bool                 compressed;
+    const unsigned char* level;         // level 0, pixels or compressed blocks
+    size_t               levelSize;
+};
+
+
+/*
+* Process wide, reference counted table of GL textures shared by every Model.
+*
+* Textures are looked up by canonical path first and, once decoded, by a
+* hash of their pixels, so the same image reached through different models
+* or different relative paths maps to one GL texture. A hash hit is only
+* shared once the size, the format and the level 0 bytes, read back from the
+* registered texture, match as well. All calls come from
+* the thread owning the GL context; the table itself is locked so other
+* threads may query it.
+*/
+class TextureRegistry
+{
+public:
+    static TextureRegistry& instance();
+
+    // id of the texture registered under key and take a reference, 0 if unknown
+    unsigned int acquire(const string& key);
+
+    // id of a texture with identical content, registered under key as well, 0 if unknown
+    unsigned int acquireByContent(const string& key, const TextureContent& content);
+
+    // register a freshly uploaded texture with one reference
+    void add(const string& key, const TextureContent& content, unsigned int id, size_t bytes);
+
+    // drop a reference, the GL texture is deleted with the last one
+    void release(unsigned int id);
+
+    TextureRegistryStats getStats();
+    void printStats();
+
+    // absolute-ish lookup key: unified separators, "." and ".." resolved
+    static string canonicalPath(const string& path);
+
+    // hash of decoded pixels including their dimensions, never 0
+    static uint64_t hashContent(const unsigned char* data, int width, int height, int components);
+
+private:
+    TextureRegistry();
+    TextureRegistry(const TextureRegistry&) = delete;
+    TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+    struct Entry
+    {
+        unsigned int refCount;
+        uint64_t     contentHash;
+        int          width;
+        int          height;
+        GLenum       format;
+        size_t       bytes;
+    };
+
+    mutex                                  registryMutex;
+    unordered_map<string, unsigned int>    byPath;
+    unordered_map<uint64_t, unsigned int>  byContent;
+    unordered_map<unsigned int, Entry>     entries;
+    TextureRegistryStats                   stats;
+};
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+using namespace std;
+
+
+// fixed size pool of worker threads for CPU side loading work, never touches GL
+class ThreadPool
+{
+public:
+    ThreadPool(unsigned int threadCount) : stopping(false)
+    {
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (thread& worker : workers)
+            worker.join();
+    }
+
+    // process wide pool, one thread per core minus the one owning the GL context
+    static ThreadPool& shared()
+    {
+        static ThreadPool pool(max(2u, thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    unsigned int size() const { return static_cast<unsigned int>(workers.size()); }
+
+    template<typename F>
+    auto submit(F&& task) -> future<decltype(task())>
+    {
+        typedef decltype(task()) Result;
+        auto job = make_shared<packaged_task<Result()>>(forward<F>(task));
+        future<Result> result = job->get_future();
+        {
+            lock_guard<mutex> lock(queueMutex);
+            jobs.push([job] { (*job)(); });
+        }
+        wakeup.notify_one();
+        return result;
+    }
+
+private:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            function<void()> job;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                wakeup.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+
+    vector<thread>           workers;
+    queue<function<void()>>  jobs;
+    mutex                    queueMutex;
+    condition_variable       wakeup;
+    bool                     stopping;
+};
\ No newline at end of file
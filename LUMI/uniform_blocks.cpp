@@ -0,0 +1,98 @@
+#include "uniform_blocks.h"
+#include "gl_state.h"
+
+
+FrameBlock FrameBlock::fromCamera(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition,
+    float width, float height, float nearPlane, float farPlane)
+{
+    FrameBlock frame;
+    frame.projection = projection;
+    frame.view = view;
+    frame.viewProjection = projection * view;
+    frame.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+    frame.viewport = glm::vec4(width, height, nearPlane, farPlane);
+    return frame;
+}
+
+
+bool LightBlock::add(const glm::vec3& position, const glm::vec3& color, float linear, float quadratic)
+{
+    if (count >= LIGHT_BLOCK_MAX_LIGHTS)
+        return false;
+    PointLight& light = lights[count++];
+    light.position = position;
+    light.linear = linear;
+    light.color = color;
+    light.quadratic = quadratic;
+    return true;
+}
+
+
+UniformBuffer::UniformBuffer(GLuint binding, GLsizeiptr size, const void* data, GLenum usage)
+{
+    this->binding = binding;
+    this->size = size;
+    this->usage = usage;
+    glGenBuffers(1, &UBO);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, size, data, usage);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+    bind();
+}
+
+
+UniformBuffer::~UniformBuffer()
+{
+    GLState::deleteBuffers(1, &UBO);
+}
+
+
+void UniformBuffer::update(const void* data)
+{
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, usage);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+    bind();
+}
+
+
+void UniformBuffer::bind() const
+{
+    GLState::bindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+}
+
+
+void UniformBuffer::bindRange(GLintptr offset, GLsizeiptr bytes) const
+{
+    GLState::bindBufferRange(GL_UNIFORM_BUFFER, binding, UBO, offset, bytes);
+}
+
+
+GLsizeiptr UniformBuffer::alignedSize(GLsizeiptr bytes)
+{
+    static GLint alignment = 0;
+    if (alignment == 0)
+    {
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        if (alignment <= 0)
+            alignment = 256;
+    }
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+
+int UniformBuffer::bindingPoint(const string& blockName)
+{
+    if (blockName == "FrameBlock")
+        return UNIFORM_BINDING_FRAME;
+    if (blockName == "LightBlock")
+        return UNIFORM_BINDING_LIGHTS;
+    if (blockName == "SsaoKernelBlock")
+        return UNIFORM_BINDING_SSAO_KERNEL;
+    if (blockName == "MaterialBlock")
+        return UNIFORM_BINDING_MATERIAL;
+    if (blockName == "ShadowBlock")
+        return UNIFORM_BINDING_SHADOW;
+    return -1;
+}
\ No newline at end of file
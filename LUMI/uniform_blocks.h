@@ -0,0 +1,131 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <string>
+using namespace std;
+
+// binding points shared by every program, Shader binds blocks with these names when it links
+#define UNIFORM_BINDING_FRAME       0
+#define UNIFORM_BINDING_LIGHTS      1
+#define UNIFORM_BINDING_SSAO_KERNEL 2
+#define UNIFORM_BINDING_MATERIAL    3
+#define UNIFORM_BINDING_SHADOW      4
+
+// array sizes, the GLSL declarations use the same numbers
+#define LIGHT_BLOCK_MAX_LIGHTS 32
+#define SSAO_KERNEL_SIZE       64
+#define SHADOW_MAX_CASCADES    4
+
+
+/*
+* C++ mirrors of the std140 blocks declared in the shaders. Members are laid
+* out so the C++ and std140 offsets agree without hidden padding: matrices and
+* vec4s first, a vec3 is always followed by a float, arrays of vec3 are
+* declared as vec4. Keep these in sync with the GLSL declarations.
+*/
+
+// FrameBlock: camera constants, written once per frame
+struct FrameBlock
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 viewProjection;
+    glm::vec4 cameraPosition;   // w unused
+    glm::vec4 viewport;         // width, height, near plane, far plane
+
+    static FrameBlock fromCamera(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition,
+        float width, float height, float nearPlane, float farPlane);
+};
+
+struct PointLight
+{
+    glm::vec3 position;
+    float     linear;
+    glm::vec3 color;
+    float     quadratic;
+};
+
+// LightBlock: the light list of a frame
+struct LightBlock
+{
+    int        count;
+    int        padding[3];
+    PointLight lights[LIGHT_BLOCK_MAX_LIGHTS];
+
+    // false once the block is full
+    bool add(const glm::vec3& position, const glm::vec3& color, float linear = 0.0f, float quadratic = 0.0f);
+};
+
+// SsaoKernelBlock: hemisphere samples, xyz used
+struct SsaoKernelBlock
+{
+    glm::vec4 samples[SSAO_KERNEL_SIZE];
+};
+
+// MaterialBlock: scalar parameters of one material
+struct MaterialBlock
+{
+    glm::vec4 albedo;           // multiplies the albedo map
+    float     metallic;
+    float     roughness;
+    float     ao;
+    float     padding;
+};
+
+// ShadowBlock: the cascades of the shadow map, written when they move
+struct ShadowBlock
+{
+    glm::mat4 cascadeMatrices[SHADOW_MAX_CASCADES];     // world to each cascade's light clip space
+    glm::vec4 cascadeSplits;        // far end of each cascade, view distance
+    glm::vec4 cascadeTexelSizes;    // world units per shadow texel of each cascade
+    glm::vec4 shadowParams;         // cascade count, blend fraction, 1 / map size, near end of the first cascade
+    glm::vec4 lightDirection;       // direction the light travels, w unused
+};
+
+static_assert(sizeof(FrameBlock) == 224, "FrameBlock does not match its std140 layout");
+static_assert(sizeof(PointLight) == 32, "PointLight does not match its std140 layout");
+static_assert(sizeof(LightBlock) == 16 + 32 * LIGHT_BLOCK_MAX_LIGHTS, "LightBlock does not match its std140 layout");
+static_assert(sizeof(SsaoKernelBlock) == 16 * SSAO_KERNEL_SIZE, "SsaoKernelBlock does not match its std140 layout");
+static_assert(sizeof(MaterialBlock) == 32, "MaterialBlock does not match its std140 layout");
+static_assert(sizeof(ShadowBlock) == 64 * SHADOW_MAX_CASCADES + 64, "ShadowBlock does not match its std140 layout");
+static_assert(SHADOW_MAX_CASCADES <= 4, "ShadowBlock keeps one value per cascade in a vec4");
+
+
+/*
+* A uniform buffer attached to one binding point. update() replaces the whole
+* buffer with one upload (the old storage is orphaned so a frame still in
+* flight keeps reading its copy). Buffers holding an array of records, such as
+* materials, bind one record at a time with bindRange().
+*/
+class UniformBuffer
+{
+public:
+    unsigned int UBO;
+    GLuint       binding;
+    GLsizeiptr   size;
+
+
+    UniformBuffer(GLuint binding, GLsizeiptr size, const void* data = nullptr, GLenum usage = GL_DYNAMIC_DRAW);
+    ~UniformBuffer();
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    // replace the whole buffer and bind it to its binding point
+    void update(const void* data);
+
+    // whole buffer at the binding point
+    void bind() const;
+
+    // one record at the binding point, offset has to be a multiple of alignedSize
+    void bindRange(GLintptr offset, GLsizeiptr bytes) const;
+
+    // record size rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+    static GLsizeiptr alignedSize(GLsizeiptr bytes);
+
+    // binding point of a block declared in the shaders, -1 for unknown block names
+    static int bindingPoint(const string& blockName);
+
+private:
+    GLenum usage;
+};
\ No newline at end of file